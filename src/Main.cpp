@@ -1,19 +1,352 @@
 #include <RenderBase.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <exception>
+#include <optional>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
 #include <argparse/argparse.hpp>
+#include <tbb/global_control.h>
+#include <thread>
+
+#include "loaders/GltfLoader.hpp"
+#include "loaders/HdrLoader.hpp"
+#include "loaders/ImageCache.hpp"
+#include "loaders/ObjLoader.hpp"
+#include "loaders/PlyLoader.hpp"
+#include "loaders/TexelCodec.hpp"
+#include "mesh/ClusterFile.hpp"
+#include "mesh/VertexUnifier.hpp"
+#include "stb_image.h"
 
 namespace renderer {
+    struct LoadTimes {
+        double load_ms = 0.0;
+        double build_ms = 0.0;
+        size_t triangles = 0;
+    };
+
+    std::optional<LoadTimes> time_obj_load(const std::string& model_path) {
+        using clock = std::chrono::high_resolution_clock;
+        ObjLoader::Config config;
+        config.loadFlags = ObjLoader::LoadFlags::Vertices | ObjLoader::LoadFlags::Normals | ObjLoader::LoadFlags::TexCoords;
+        config.cache = false;
+        ObjLoader loader(config);
+
+        const auto start = clock::now();
+        if (!loader.load(model_path)) return std::nullopt;
+        const auto loaded = clock::now();
+        const HostMesh mesh = VertexUnifier::unify(loader.get_views());
+        const auto end = clock::now();
+        return LoadTimes {
+            std::chrono::duration<double, std::milli>(loaded - start).count(),
+            std::chrono::duration<double, std::milli>(end - loaded).count(),
+            mesh.indices.size(),
+        };
+    }
+
+    std::optional<LoadTimes> time_gltf_load(const std::string& model_path) {
+        using clock = std::chrono::high_resolution_clock;
+        GltfLoader loader({});
+
+        const auto start = clock::now();
+        if (!loader.load(model_path)) return std::nullopt;
+        const auto loaded = clock::now();
+        size_t triangles = 0;
+        for (const GltfLoader::Mesh& mesh : loader.get_meshes()) {
+            for (const GltfLoader::Primitive& primitive : mesh.primitives) {
+                triangles += VertexUnifier::convert(primitive.views).indices.size();
+            }
+        }
+        const auto end = clock::now();
+        return LoadTimes {
+            std::chrono::duration<double, std::milli>(loaded - start).count(),
+            std::chrono::duration<double, std::milli>(end - loaded).count(),
+            triangles,
+        };
+    }
+
+    std::optional<LoadTimes> time_ply_load(const std::string& model_path) {
+        using clock = std::chrono::high_resolution_clock;
+        PlyLoader loader({});
+
+        const auto start = clock::now();
+        if (!loader.load(model_path)) return std::nullopt;
+        const auto loaded = clock::now();
+        const HostMesh mesh = VertexUnifier::convert(loader.get_views());
+        const auto end = clock::now();
+        return LoadTimes {
+            std::chrono::duration<double, std::milli>(loaded - start).count(),
+            std::chrono::duration<double, std::milli>(end - loaded).count(),
+            mesh.indices.size(),
+        };
+    }
+
+    /**
+     * Time model loading and building the interleaved meshes with 1, 2, 4, ... worker threads.
+     * Run it on an OBJ and a glTF export of the same model to compare the two paths.
+     * NOTE: rapidobj parses with its own threads, the limit only applies to the TBB stages.
+     */
+    void bench_load(const std::string& model_path) {
+        const bool gltf = GltfLoader::handles(model_path);
+        const bool ply = PlyLoader::handles(model_path);
+        const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+            tbb::global_control limit(tbb::global_control::max_allowed_parallelism, threads);
+            const std::optional<LoadTimes> times = gltf ? time_gltf_load(model_path)
+                : ply ? time_ply_load(model_path) : time_obj_load(model_path);
+            if (!times) return;
+
+            spdlog::info("Bench: {:3} threads, load {:8.1f} ms, {} {:8.1f} ms, {} triangles", threads, times->load_ms,
+                         gltf || ply ? "interleave" : "unify", times->build_ms, times->triangles);
+            if (threads == max_threads) break;
+        }
+    }
+
+    /**
+     * Time decoding an .hdr environment map with stb_image and with HdrLoader on 1, 2, 4, ... worker threads,
+     * then encode it in every texel format and report size, encode time and error against the decoded floats.
+     * Run it on HDRIs of several resolutions, the file is decoded once first so every run reads it from the page cache.
+     */
+    void bench_env_map(const std::string& path) {
+        using clock = std::chrono::high_resolution_clock;
+        int width, height;
+        if (!HdrLoader::load(path, width, height)) return;
+
+        int channels;
+        const auto start = clock::now();
+        float* reference = stbi_loadf(path.c_str(), &width, &height, &channels, 4);
+        const double stb_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        if (!reference) {
+            spdlog::error("Bench: stb_image cannot read {}", path);
+            return;
+        }
+        spdlog::info("Bench: {}x{}, stb_image {:8.1f} ms", width, height, stb_ms);
+
+        const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (int threads = 1; ; threads = std::min(2 * threads, max_threads)) {
+            tbb::global_control limit(tbb::global_control::max_allowed_parallelism, threads);
+            int w, h;
+            const auto begin = clock::now();
+            const std::unique_ptr<float[]> pixels = HdrLoader::load(path, w, h);
+            const double ms = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+            if (!pixels) break;
+
+            const bool identical = w == width && h == height
+                && std::memcmp(pixels.get(), reference, 4 * sizeof(float) * w * h) == 0;
+            spdlog::info("Bench: {:3} threads, HdrLoader {:8.1f} ms, {:5.2f}x stb_image, {}", threads, ms, stb_ms / ms,
+                         identical ? "identical" : "pixels differ");
+            if (threads == max_threads) break;
+        }
+
+        for (const Trace::TexelFormat format : { Trace::TexelFormat::RGBA16F, Trace::TexelFormat::RGB9E5, Trace::TexelFormat::BC6H }) {
+            const auto begin = clock::now();
+            const TexelCodec::Image image = TexelCodec::encode(reference, width, height, format);
+            const double ms = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+            const TexelCodec::Error error = TexelCodec::measure(reference, image);
+            spdlog::info("Bench: {:7} {:8.1f} MB ({:4.1f}% of RGBA32F), encode {:8.1f} ms, RMSE {:.4g}, mean relative error {:.3f}%",
+                         TexelCodec::name(format), image.data.size() / 1048576.0,
+                         100.0 * image.data.size() / (16.0 * width * height), ms, error.rmse, 100.0 * error.mean_relative);
+        }
+        stbi_image_free(reference);
+    }
+
+    /**
+     * Parse path[@t=x,y,z][@r=degrees][@s=scale]. Rotation is about +y, scale is uniform or per axis.
+     * The model is scaled first, then rotated and moved.
+     */
+    TraceHost::Model parse_model(const std::string& spec) {
+        vec3f translation(0.f);
+        vec3f scale(1.f);
+        float degrees = 0.f;
+        size_t at = spec.find('@');
+        const std::string path = spec.substr(0, at);
+        while (at != std::string::npos) {
+            const size_t next = spec.find('@', at + 1);
+            const std::string option = spec.substr(at + 1, next == std::string::npos ? std::string::npos : next - at - 1);
+            at = next;
+
+            std::vector<float> values;
+            for (size_t begin = 2; option.size() > 2 && begin <= option.size(); ) {
+                const size_t comma = std::min(option.find(',', begin), option.size());
+                values.push_back(std::stof(option.substr(begin, comma - begin)));
+                begin = comma + 1;
+            }
+            const char key = option.size() > 2 && option[1] == '=' ? option[0] : '\0';
+            if (key == 't' && values.size() == 3) {
+                translation = vec3f(values[0], values[1], values[2]);
+            }
+            else if (key == 'r' && values.size() == 1) {
+                degrees = values[0];
+            }
+            else if (key == 's' && (values.size() == 1 || values.size() == 3)) {
+                scale = values.size() == 1 ? vec3f(values[0]) : vec3f(values[0], values[1], values[2]);
+            }
+            else {
+                throw std::runtime_error("Invalid model option '" + option + "' in " + spec);
+            }
+        }
+        const affine3f transform = affine3f::translate(translation)
+            * affine3f::rotate(vec3f(0.f, 1.f, 0.f), degrees * static_cast<float>(M_PI) / 180.f)
+            * affine3f::scale(scale);
+        return { path, transform };
+    }
+
+    /**
+     * Cut an OBJ or PLY model into the clusters of a streaming file.
+     * The source has to fit in host memory once: a first OBJ load parses it in memory, later builds map its
+     * .meshcache; a PLY maps its positions but converts the faces into a 12 byte per triangle index list.
+     */
+    bool build_clusters(const std::string& model_path, const std::string& output_path) {
+        if (PlyLoader::handles(model_path)) {
+            PlyLoader loader({});
+            return loader.load(model_path) && ClusterFile::write(output_path, loader.get_views(), {});
+        }
+        ObjLoader::Config config;
+        config.loadFlags = ObjLoader::LoadFlags::Vertices | ObjLoader::LoadFlags::Normals | ObjLoader::LoadFlags::TexCoords;
+        ObjLoader loader(config);
+        return loader.load(model_path) && ClusterFile::write(output_path, loader.get_views(), {});
+    }
+
     extern "C" int main(int argc, char* argv[]) {
         argparse::ArgumentParser program("OptixPathtracer");
         program.add_argument("--model-path")
-            .help("Path to the model file")
+            .help("Path to the model file, .obj, .glb, .ply or .clusters")
             .default_value("");
 
+        program.add_argument("--model")
+            .help("Additional model as path[@t=x,y,z][@r=degrees][@s=scale], repeat to load several at once")
+            .append()
+            .default_value(std::vector<std::string>{});
+
+        program.add_argument("--shapes")
+            .help("Only load these shapes of OBJ models, by index or name")
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .default_value(std::vector<std::string>{});
+
+        program.add_argument("--crease-angle")
+            .help("Faces further apart than this many degrees stay sharp when generating missing normals")
+            .default_value(180.f)
+            .scan<'g', float>();
+
+        program.add_argument("--optimize-mesh")
+            .help("Weld vertices, drop degenerate triangles and Morton order the mesh before building the BVH")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--compress-mesh")
+            .help("Store mesh positions as 16 bit fixed point, normals octahedral encoded and indices as 16 bit offsets")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--lod")
+            .help("Simplify meshes into levels of detail and pick one per instance from its distance to the camera")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--lod-error")
+            .help("Largest error in pixels a level of detail may show")
+            .default_value(1.f)
+            .scan<'g', float>();
+
         program.add_argument("--env-map")
             .help("Path to the environment map file")
             .default_value("");
 
+        program.add_argument("--env-format")
+            .help("Device storage of the environment map: rgba32f, rgba16f, rgb9e5 or bc6h")
+            .default_value("rgba32f");
+
+        program.add_argument("--path-guiding")
+            .help("Learn a spatial-directional guide over the first passes and sample from it")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--radiance-cache")
+            .help("Terminate most paths early into a world-space radiance cache")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--cache-cell-size")
+            .help("World-space edge length of a radiance cache cell, greater than 0")
+            .default_value(0.25f)
+            .scan<'g', float>();
+
+        program.add_argument("--cache-capacity")
+            .help("Log2 of the number of radiance cache cells, 10 to 28")
+            .default_value(20)
+            .scan<'i', int>();
+
+        program.add_argument("--reprojection")
+            .help("Reproject accumulated samples through camera motion")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--gbuffer-cache")
+            .help("Cache stratified primary hits and only trace secondary bounces while the camera is still, "
+                  "antialiasing converges to 2x2 fixed subpixel positions")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--target-frame-ms")
+            .help("Lower the internal resolution during camera motion to hold this frame time")
+            .default_value(0.f)
+            .scan<'g', float>();
+
+        program.add_argument("--progressive")
+            .help("Render Adam7 interleaved pixel subsets first after every reset")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--max-time")
+            .help("Stop accumulating after this many seconds")
+            .default_value(0.f)
+            .scan<'g', float>();
+
+        program.add_argument("--max-spp")
+            .help("Stop accumulating after this many samples per pixel")
+            .default_value(0)
+            .scan<'i', int>();
+
+        program.add_argument("--target-error")
+            .help("Stop accumulating once the estimated mean relative error drops below this")
+            .default_value(0.f)
+            .scan<'g', float>();
+
+        program.add_argument("--output")
+            .help("Write the image here (.hdr, .png or .jpg) when a target is reached and exit, needs a target")
+            .default_value("");
+
+        program.add_argument("--denoise")
+            .help("Filter the accumulated image with an albedo and normal guided a-trous denoiser")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--bench-load")
+            .help("Time loading --model-path with an increasing number of threads and exit")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--bench-env-map")
+            .help("Time decoding --env-map with stb_image and the parallel .hdr reader and exit")
+            .default_value(false)
+            .implicit_value(true);
+
+        program.add_argument("--build-clusters")
+            .help("Write --model-path as a paged cluster file for streaming and exit")
+            .default_value("");
+
+        program.add_argument("--stream-budget")
+            .help("Device memory in MB for clusters streamed from a .clusters model")
+            .default_value(1024)
+            .scan<'i', int>();
+
+        program.add_argument("--image-cache")
+            .help("Host memory in MB for decoded images shared by all image loaders")
+            .default_value(2048)
+            .scan<'i', int>();
 
         try {
             program.parse_args(argc, argv);
@@ -25,11 +358,80 @@ namespace renderer {
                 spdlog::warn("No environment map provided, using default.");
                 config.env_map = std::nullopt; // Assuming this function exists
             }
+            const std::string env_format = program.get<std::string>("--env-format");
+            const std::optional<Trace::TexelFormat> format = TexelCodec::parse(env_format);
+            if (!format) {
+                throw std::runtime_error("Unknown --env-format " + env_format);
+            }
+            config.env_format = format.value();
+            ImageCache::instance().set_budget(static_cast<size_t>(std::max(program.get<int>("--image-cache"), 0)) << 20);
+            for (const std::string& spec : program.get<std::vector<std::string>>("--model")) {
+                config.models.push_back(parse_model(spec));
+            }
             config.model = program.get<std::string>("--model-path");
             if (config.model.value().empty()) {
-                spdlog::warn("No model path provided, using default.");
+                if (config.models.empty()) {
+                    spdlog::warn("No model path provided, using default.");
+                }
                 config.model = std::nullopt; // Assuming this function exists
             }
+            else if (ClusterFile::handles(config.model.value()) && !config.models.empty()) {
+                throw std::runtime_error("A streamed .clusters --model-path can not be combined with --model");
+            }
+            config.shapes = program.get<std::vector<std::string>>("--shapes");
+            config.crease_angle = program.get<float>("--crease-angle");
+            config.optimize_mesh = program.get<bool>("--optimize-mesh");
+            config.compress_mesh = program.get<bool>("--compress-mesh");
+            config.lod = program.get<bool>("--lod");
+            config.lod_pixel_error = program.get<float>("--lod-error");
+            config.stream_budget_mb = static_cast<size_t>(std::max(program.get<int>("--stream-budget"), 1));
+            const std::string clusters_path = program.get<std::string>("--build-clusters");
+            if (!clusters_path.empty()) {
+                if (!config.model || !build_clusters(config.model.value(), clusters_path)) {
+                    spdlog::error("Failed to build clusters");
+                    return EXIT_FAILURE;
+                }
+                return EXIT_SUCCESS;
+            }
+            if (program.get<bool>("--bench-env-map")) {
+                if (config.env_map) {
+                    bench_env_map(config.env_map.value());
+                }
+                return EXIT_SUCCESS;
+            }
+            if (program.get<bool>("--bench-load")) {
+                if (config.model) {
+                    bench_load(config.model.value());
+                }
+                return EXIT_SUCCESS;
+            }
+            config.path_guiding = program.get<bool>("--path-guiding");
+            config.radiance_cache = program.get<bool>("--radiance-cache");
+            config.cache_cell_size = program.get<float>("--cache-cell-size");
+            config.cache_capacity_log2 = program.get<int>("--cache-capacity");
+            // Cells are keyed by position / cell size and the table is 1 << capacity cells
+            if (!(config.cache_cell_size > 0.f) || !std::isfinite(config.cache_cell_size)) {
+                throw std::runtime_error("--cache-cell-size must be greater than 0");
+            }
+            if (config.cache_capacity_log2 < 10 || config.cache_capacity_log2 > 28) {
+                throw std::runtime_error("--cache-capacity must be between 10 and 28");
+            }
+            config.reprojection = program.get<bool>("--reprojection");
+            config.gbuffer_cache = program.get<bool>("--gbuffer-cache");
+            config.target_frame_ms = program.get<float>("--target-frame-ms");
+            config.progressive = program.get<bool>("--progressive");
+            config.max_time_s = program.get<float>("--max-time");
+            config.max_spp = program.get<int>("--max-spp");
+            config.target_error = program.get<float>("--target-error");
+            const std::string output = program.get<std::string>("--output");
+            if (!output.empty()) {
+                // The image is written when a target is reached, without one it would never be
+                if (config.max_time_s <= 0.f && config.max_spp <= 0 && config.target_error <= 0.f) {
+                    throw std::runtime_error("--output needs --max-time, --max-spp or --target-error");
+                }
+                config.output = output;
+            }
+            config.denoise = program.get<bool>("--denoise");
 
             RenderBase app(config);
             app.run();
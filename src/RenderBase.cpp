@@ -139,11 +139,33 @@ void RenderBase::init_glfw() {
 void RenderBase::init_programs() {
     spdlog::info("Initializing device code...");
     optix = new TraceHost({
-        "shaders/CMakeFiles/TracePtx.dir/Trace.ptx",
-        config.model,
-        config.env_map,
-        config.window_width,
-        config.window_height,
+        .ptx_source = "shaders/CMakeFiles/TracePtx.dir/Trace.ptx",
+        .model = config.model,
+        .models = config.models,
+        .shapes = config.shapes,
+        .crease_angle = config.crease_angle,
+        .optimize_mesh = config.optimize_mesh,
+        .compress_mesh = config.compress_mesh,
+        .lod = config.lod,
+        .lod_pixel_error = config.lod_pixel_error,
+        .stream_budget_mb = config.stream_budget_mb,
+        .env_map = config.env_map,
+        .env_format = config.env_format,
+        .width = config.window_width,
+        .height = config.window_height,
+        .path_guiding = config.path_guiding,
+        .radiance_cache = config.radiance_cache,
+        .cache_cell_size = config.cache_cell_size,
+        .cache_capacity_log2 = config.cache_capacity_log2,
+        .reprojection = config.reprojection,
+        .gbuffer_cache = config.gbuffer_cache,
+        .target_frame_ms = config.target_frame_ms,
+        .progressive = config.progressive,
+        .max_time_s = config.max_time_s,
+        .max_spp = config.max_spp,
+        .target_error = config.target_error,
+        .output = config.output,
+        .denoise = config.denoise,
     });
     optix->init();
 }
@@ -248,6 +270,10 @@ void RenderBase::render_loop() {
         // Run optix texture program
         if (optix) {
            optix->gl_draw();
+           // Batch renders exit once the output image is written
+           if (optix->finished()) {
+               glfwSetWindowShouldClose(state.window, true);
+           }
         }
 
         // Render ImGui
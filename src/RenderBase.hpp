@@ -18,7 +18,29 @@ public:
         int window_width = 1280;
         int window_height = 720;
         std::optional<std::string> model;
+        std::vector<TraceHost::Model> models;
+        std::vector<std::string> shapes;
+        float crease_angle = 180.f;
+        bool optimize_mesh = false;
+        bool compress_mesh = false;
+        bool lod = false;
+        float lod_pixel_error = 1.f;
+        size_t stream_budget_mb = 1024;
         std::optional<std::string> env_map;
+        Trace::TexelFormat env_format = Trace::TexelFormat::RGBA32F;
+        bool path_guiding = false;
+        bool radiance_cache = false;
+        float cache_cell_size = 0.25f;
+        int cache_capacity_log2 = 20;
+        bool reprojection = false;
+        bool gbuffer_cache = false;
+        float target_frame_ms = 0.f;
+        bool progressive = false;
+        float max_time_s = 0.f;
+        int max_spp = 0;
+        float target_error = 0.f;
+        std::optional<std::string> output;
+        bool denoise = false;
     } config;
 
     RenderBase(const Config& config);
@@ -146,4 +146,8 @@ void Shader::set_int(const std::string& name, int value) const {
 
 void Shader::set_float(const std::string& name, float value) const {
     glUniform1f(glGetUniformLocation(program_id, name.c_str()), value);
+}
+
+void Shader::set_vec2(const std::string& name, float x, float y) const {
+    glUniform2f(glGetUniformLocation(program_id, name.c_str()), x, y);
 }
\ No newline at end of file
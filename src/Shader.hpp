@@ -23,6 +23,7 @@ public:
   void set_bool(const std::string& name, bool value) const;
   void set_int(const std::string& name, int value) const;
   void set_float(const std::string& name, float value) const;
+  void set_vec2(const std::string& name, float x, float y) const;
 };
 
 
@@ -6,21 +6,42 @@
 #include "TraceHost.hpp"
 #include "shaders/Trace.cuh"
 
+#include <algorithm>
+#include <exception>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
 #include <cuda_runtime.h>
 #include <cuda_gl_interop.h>
 #include <fstream>
+#include <functional>
 #include <imgui.h>
+#include <numeric>
 #include <owl/owl.h>
 #include <optional>
+#include <unordered_map>
 #include <vector>
+#include <loaders/GltfLoader.hpp>
 #include <loaders/ObjLoader.hpp>
+#include <loaders/PlyLoader.hpp>
 #include <loaders/ImageLoader.hpp>
+#include <loaders/ImageWriter.hpp>
 #include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/task_group.h>
 
 #include "Shader.hpp"
 #include "geometry/Sphere.hpp"
 #include "Trace.ptx.hpp"
 #include "geometry/TriangleMesh.hpp"
+#include "mesh/ClusterBvh.hpp"
+#include "mesh/LodCache.hpp"
+#include "mesh/MeshCompressor.hpp"
+#include "mesh/MeshOptimizer.hpp"
+#include "mesh/VertexUnifier.hpp"
 
 template<typename T>
 void mapBufferToDevice(T* hostBuffer, size_t size, void** deviceBuffer) {
@@ -88,12 +109,43 @@ namespace Screen {
     in vec2 TexCoord;
 
     uniform sampler2D texture1;
+    uniform vec2 uv_scale;
+    uniform vec2 uv_max;
     uniform float num_samples;
+    uniform float max_samples;
+    uniform int display_mode;
+
+    // Blue to red ramp for diagnostics
+    vec3 heat(float t) {
+        t = clamp(t, 0.0, 1.0);
+        return clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+    }
 
     void main()
     {
-        vec4 texColor = texture(texture1, TexCoord);
-        FragColor = texColor / num_samples;
+        // Only the rendered sub-rectangle is valid, bilinear filtering upscales it without reaching past its edges
+        vec2 uv = clamp(TexCoord * uv_scale, 0.5 / vec2(textureSize(texture1, 0)), uv_max);
+        // w holds the number of frames accumulated into each pixel, filtering blends sums and counts alike
+        vec4 texColor = texture(texture1, uv);
+        // Progressive passes leave holes, fill them from the nearest coarser Adam7 lattice. A filtered sample
+        // next to a filled pixel has a fractional count, so holes are found on the unfiltered texel.
+        ivec2 p = ivec2(uv * vec2(textureSize(texture1, 0)));
+        if (texelFetch(texture1, p, 0).a <= 0.0) {
+            texColor = vec4(0.0);
+            for (int level = 1; level <= 3; level++) {
+                vec4 c = texelFetch(texture1, (p >> level) << level, 0);
+                if (c.a > 0.0) {
+                    texColor = c;
+                    break;
+                }
+            }
+        }
+        if (display_mode == 1) {
+            FragColor = vec4(heat(log2(1.0 + texColor.a) / log2(1.0 + max_samples)), 1.0);
+            return;
+        }
+        // Holes blended into a filtered sample add nothing to either sum, dividing by the count skips them
+        FragColor = vec4(texColor.a > 0.0 ? texColor.rgb / texColor.a : vec3(0.0), 1.0);
     }
     )";
 
@@ -134,9 +186,36 @@ TraceHost::TraceHost(const Config& config)
 
 TraceHost::~TraceHost() {
     if (!initialized) return;
+    /********** Cleanup guiding **********/
+    cudaFree(state.launch_params.guide.spatial);
+    cudaFree(state.launch_params.guide.directional);
+    cudaFree(state.launch_params.guide.samples);
+    cudaFree(state.launch_params.guide.sample_count);
+    cudaFree(state.launch_params.cache.cells);
+    cudaFree(state.launch_params.reproject.history);
+    cudaFree(state.launch_params.reproject.samples);
+    cudaFree(state.launch_params.reproject.positions);
+    cudaFree(state.launch_params.reproject.prev_positions);
+    cudaFree(state.launch_params.gbuffer.hits);
+    cudaFree(state.launch_params.ray_count);
+    cudaFree(state.launch_params.half_buffer);
+    cudaFree(state.launch_params.aov.albedo);
+    cudaFree(state.launch_params.aov.normal);
+#ifdef COST_COUNTERS
+    cudaFree(state.launch_params.cost);
+#endif
+
+    /********** Cleanup environment map **********/
+    if (env_device.env_map.texture) cudaDestroyTextureObject(env_device.env_map.texture);
+    if (env_device.env_map.array) cudaFreeArray(env_device.env_map.array);
+    cudaFree(env_device.dev_pdf_ptr);
+    cudaFree(env_device.dev_alias_pdf_ptr);
+    cudaFree(env_device.dev_alias_i_ptr);
+
     /********** Cleanup OWL **********/
     owlModuleRelease(owl.module);
     owlRayGenRelease(owl.ray_gen);
+    owlRayGenRelease(owl.resolve);
     owlContextDestroy(owl.ctx);
 
     /********** Cleanup GL **********/
@@ -230,10 +309,10 @@ void *TraceHost::init_gl() {
     glGenTextures(1, &gl.disp_tex);
     glBindTexture(GL_TEXTURE_2D, gl.disp_tex);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, config.width, config.height, 0, GL_RGBA, GL_FLOAT, nullptr);
 
@@ -274,14 +353,16 @@ void TraceHost::init_geom_progs() {
     // Set trimesh type
     OWLVarDecl tri_mesh_vars[] = {
         { "vertices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, vertices) },
-        { "normals", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, normals) },
-        { "tex_coords", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, tex_coords) },
         { "indices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, indices) },
-        { "normal_indices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, normal_indices) },
-        { "texcoord_indices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, texcoord_indices) },
+        { "compressed_vertices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, compressed_vertices) },
+        { "short_indices", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, short_indices) },
+        { "cluster_bases", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, cluster_bases) },
+        { "quant_origin", OWL_FLOAT3, OWL_OFFSETOF(TriangleMesh, quant_origin) },
+        { "quant_scale", OWL_FLOAT3, OWL_OFFSETOF(TriangleMesh, quant_scale) },
         { "material_id", OWL_UINT, OWL_OFFSETOF(TriangleMesh, material_id) },
-        { "has_tex", OWL_INT, OWL_OFFSETOF(TriangleMesh, has_tex) },
-        { "tex", OWL_TEXTURE, OWL_OFFSETOF(TriangleMesh, tex) },
+        { "material_ids", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, material_ids) },
+        { "materials", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, materials) },
+        { "textures", OWL_BUFPTR, OWL_OFFSETOF(TriangleMesh, textures) },
         { nullptr }
     };
 
@@ -309,69 +390,20 @@ OWLGroup TraceHost::build_scene() {
     using namespace Geometry;
     using namespace Material;
 
-    OWLGroup world;
-    if (config.model.has_value()) {
-        ObjLoader::Config obj_loader_config;
-        obj_loader_config.loadFlags = ObjLoader::LoadFlags::Vertices | ObjLoader::LoadFlags::Normals | ObjLoader::LoadFlags::TexCoords;
-        ObjLoader obj_loader(obj_loader_config);
-        obj_loader.load(config.model.value());
-
-        const int NUM_VERTICES = 8;
-        vec3f verts[NUM_VERTICES] =
-          {
-            { -1.f,-1.f,-1.f },
-            { +1.f,-1.f,-1.f },
-            { -1.f,+1.f,-1.f },
-            { +1.f,+1.f,-1.f },
-            { -1.f,-1.f,+1.f },
-            { +1.f,-1.f,+1.f },
-            { -1.f,+1.f,+1.f },
-            { +1.f,+1.f,+1.f }
-          };
-
-        const int NUM_INDICES = 12;
-        vec3i inds[NUM_INDICES] =
-          {
-            { 0,1,3 }, { 2,3,0 },
-            { 5,7,6 }, { 5,6,4 },
-            { 0,4,5 }, { 0,5,1 },
-            { 2,3,7 }, { 2,7,6 },
-            { 1,5,7 }, { 1,7,3 },
-            { 4,0,2 }, { 4,2,6 }
-          };
-
-        auto vertices = obj_loader.get<vec3f>(ObjLoader::Attribute::Vertices);
-        auto indices = obj_loader.get<vec3ui>(ObjLoader::Attribute::Indices);
-        auto normals = obj_loader.get<vec3f>(ObjLoader::Attribute::Normals);
-        auto normal_indices = obj_loader.get<vec3ui>(ObjLoader::Attribute::NormalIndices);
-        auto tex_coords = obj_loader.get<vec2f>(ObjLoader::Attribute::TexCoords);
-        auto tex_coord_indices = obj_loader.get<vec3ui>(ObjLoader::Attribute::TexCoordIndices);
-
-        OWLBuffer vb = owlDeviceBufferCreate(owl.ctx, OWL_FLOAT3, vertices.size(), vertices.data());
-        OWLBuffer ib = owlDeviceBufferCreate(owl.ctx, OWL_UINT3, indices.size(), indices.data());
-        OWLBuffer nb = owlDeviceBufferCreate(owl.ctx, OWL_FLOAT3, normals.size(), normals.data());
-        OWLBuffer nib = owlDeviceBufferCreate(owl.ctx, OWL_UINT3, normal_indices.size(), normal_indices.data());
-        //OWLBuffer tb = owlDeviceBufferCreate(owl.ctx, OWL_FLOAT2, tex_coords.size(), tex_coords.data());
-        //OWLBuffer tib = owlDeviceBufferCreate(owl.ctx, OWL_UINT3, tex_coord_indices.size(), tex_coord_indices.data());
+    // Filled once every model is loaded, meshes only hold the handles until the SBT is built
+    owl.materials = owlDeviceBufferCreate(owl.ctx, OWL_USER_TYPE(MeshMaterial), 0, nullptr);
+    owl.textures = owlDeviceBufferCreate(owl.ctx, OWL_TEXTURE, 0, nullptr);
 
-        OWLGeom tri_mesh_geom = owlGeomCreate(owl.ctx, owl.geom_type.tri_mesh);
-        owlTrianglesSetVertices(tri_mesh_geom, vb, vertices.size(), sizeof(vec3f), 0);
-        owlTrianglesSetIndices(tri_mesh_geom, ib, indices.size(), sizeof(vec3ui), 0);
-
-        spdlog::info("{} {} {} {}", vertices.size(), indices.size(), normals.size(), normal_indices.size());
-
-        owlGeomSetBuffer(tri_mesh_geom, "vertices", vb);
-        owlGeomSetBuffer(tri_mesh_geom, "indices", ib);
-        owlGeomSetBuffer(tri_mesh_geom, "normals", nb);
-        owlGeomSetBuffer(tri_mesh_geom, "normal_indices", nib);
-        // owlGeomSetBuffer(tri_mesh_geom, "tex_coords", tb);
-        // owlGeomSetBuffer(tri_mesh_geom, "texcoord_indices", tib);
-        owlGeomSet1i(tri_mesh_geom, "has_tex", 0);
-
-        OWLGroup tri_mesh_group = owlTrianglesGeomGroupCreate(owl.ctx, 1, &tri_mesh_geom);
-        owlGroupBuildAccel(tri_mesh_group);
-        world = owlInstanceGroupCreate(owl.ctx, 1, &tri_mesh_group);
-        owlGroupBuildAccel(world);
+    OWLGroup world;
+    if (config.model.has_value() && ClusterFile::handles(config.model.value())) {
+        world = init_streaming();
+    }
+    else if (config.model.has_value() || !config.models.empty()) {
+        std::vector<Model> models = config.models;
+        if (config.model.has_value()) {
+            models.insert(models.begin(), { config.model.value(), affine3f(one) });
+        }
+        world = build_models_world(models);
     }
     else {
         std::vector<LambertianSphere> spheres;
@@ -401,6 +433,11 @@ OWLGroup TraceHost::build_scene() {
             Lambertian{vec3f(0.7f, 0.6f, 0.5f)}
         });
 
+        for (const LambertianSphere& s : spheres) {
+            state.scene_bounds.extend(s.sphere.center - vec3f(s.sphere.radius));
+            state.scene_bounds.extend(s.sphere.center + vec3f(s.sphere.radius));
+        }
+
         // Setup input buffers
         OWLBuffer lambertian_spheres_buffer = owlDeviceBufferCreate(owl.ctx, OWL_USER_TYPE(spheres[0]), spheres.size(), spheres.data());
         OWLGeom lambertian_spheres_geom = owlGeomCreate(owl.ctx, owl.geom_type.lambertian_sphere);
@@ -419,14 +456,556 @@ OWLGroup TraceHost::build_scene() {
     return world;
 }
 
+/**
+ * Upload meshes as the geometries of one triangle group and build its BVH.
+ */
+OWLGroup TraceHost::build_mesh_group(std::vector<HostMesh>& meshes) {
+    using namespace Geometry;
+    std::vector<OWLGeom> geoms;
+    // Full precision input that compressed meshes only need while the BVH is built
+    std::vector<OWLBuffer> build_only;
+    // Handles dropped once the group holds the buffers, so releasing the group frees them
+    std::vector<OWLBuffer> owned;
+
+    for (HostMesh& mesh : meshes) {
+        // Positions lead every packed vertex, so the BVH reads them from the shading buffer with a stride
+        OWLBuffer vb = owlDeviceBufferCreate(owl.ctx, OWL_USER_TYPE(PackedVertex), mesh.vertices.size(), mesh.vertices.data());
+        OWLBuffer ib = owlDeviceBufferCreate(owl.ctx, OWL_UINT3, mesh.indices.size(), mesh.indices.data());
+
+        OWLGeom tri_mesh_geom = owlGeomCreate(owl.ctx, owl.geom_type.tri_mesh);
+        owlTrianglesSetVertices(tri_mesh_geom, vb, mesh.vertices.size(), sizeof(PackedVertex), OWL_OFFSETOF(PackedVertex, position));
+        owlTrianglesSetIndices(tri_mesh_geom, ib, mesh.indices.size(), sizeof(vec3ui), 0);
+
+        if (config.compress_mesh) {
+            const CompressedMesh compressed = MeshCompressor::compress(mesh);
+            const bool short_indices = !compressed.short_indices.empty();
+            OWLBuffer cvb = owlDeviceBufferCreate(owl.ctx, OWL_USER_TYPE(CompressedVertex), compressed.vertices.size(), compressed.vertices.data());
+            OWLBuffer sib = short_indices ? owlDeviceBufferCreate(owl.ctx, OWL_USER_TYPE(Index16), compressed.short_indices.size(), compressed.short_indices.data()) : nullptr;
+            OWLBuffer cbb = short_indices ? owlDeviceBufferCreate(owl.ctx, OWL_UINT, compressed.cluster_bases.size(), compressed.cluster_bases.data()) : nullptr;
+            owlGeomSetBuffer(tri_mesh_geom, "vertices", nullptr);
+            owlGeomSetBuffer(tri_mesh_geom, "indices", short_indices ? nullptr : ib);
+            owlGeomSetBuffer(tri_mesh_geom, "compressed_vertices", cvb);
+            owlGeomSetBuffer(tri_mesh_geom, "short_indices", sib);
+            owlGeomSetBuffer(tri_mesh_geom, "cluster_bases", cbb);
+            owlGeomSet3f(tri_mesh_geom, "quant_origin", compressed.origin.x, compressed.origin.y, compressed.origin.z);
+            owlGeomSet3f(tri_mesh_geom, "quant_scale", compressed.scale.x, compressed.scale.y, compressed.scale.z);
+            build_only.push_back(vb);
+            if (short_indices) {
+                build_only.push_back(ib);
+                owned.insert(owned.end(), { sib, cbb });
+            }
+            else {
+                owned.push_back(ib);
+            }
+            owned.push_back(cvb);
+        }
+        else {
+            owlGeomSetBuffer(tri_mesh_geom, "vertices", vb);
+            owlGeomSetBuffer(tri_mesh_geom, "indices", ib);
+            owlGeomSetBuffer(tri_mesh_geom, "compressed_vertices", nullptr);
+            owlGeomSetBuffer(tri_mesh_geom, "short_indices", nullptr);
+            owlGeomSetBuffer(tri_mesh_geom, "cluster_bases", nullptr);
+            owned.insert(owned.end(), { vb, ib });
+        }
+        owlGeomSetBuffer(tri_mesh_geom, "materials", owl.materials);
+        owlGeomSetBuffer(tri_mesh_geom, "textures", owl.textures);
+
+        // A single material is stored on the geometry, mixed materials get a per triangle buffer
+        const std::vector<uint32_t>& material_ids = mesh.material_ids;
+        const bool uniform = std::adjacent_find(material_ids.begin(), material_ids.end(), std::not_equal_to<>()) == material_ids.end();
+        owlGeomSet1ui(tri_mesh_geom, "material_id", material_ids.empty() ? UINT32_MAX : material_ids.front());
+        OWLBuffer mb = uniform ? nullptr : owlDeviceBufferCreate(owl.ctx, OWL_UINT, material_ids.size(), material_ids.data());
+        owlGeomSetBuffer(tri_mesh_geom, "material_ids", mb);
+        if (mb) owned.push_back(mb);
+
+        geoms.push_back(tri_mesh_geom);
+    }
+
+    OWLGroup tri_mesh_group = owlTrianglesGeomGroupCreate(owl.ctx, geoms.size(), geoms.data());
+    owlGroupBuildAccel(tri_mesh_group);
+    for (OWLBuffer buffer : build_only) {
+        owlBufferDestroy(buffer);
+    }
+    for (OWLBuffer buffer : owned) {
+        owlBufferRelease(buffer);
+    }
+    for (OWLGeom geom : geoms) {
+        owlGeomRelease(geom);
+    }
+    return tri_mesh_group;
+}
+
+/**
+ * Parse a model file into host meshes. Only reads the config, so it runs on any thread.
+ * Textures are requested from the pool and decode alongside the geometry.
+ */
+TraceHost::HostModel TraceHost::load_model(const std::string& path, TexturePool& textures) const {
+    HostModel model;
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    if (GltfLoader::handles(path)) {
+        GltfLoader gltf_loader({ .crease_angle = config.crease_angle });
+        if (!gltf_loader.load(path)) {
+            throw std::runtime_error("Failed to load model " + path);
+        }
+        for (const GltfLoader::Mesh& gltf_mesh : gltf_loader.get_meshes()) {
+            std::vector<HostMesh>& meshes = model.meshes.emplace_back().levels.emplace_back();
+            for (const GltfLoader::Primitive& primitive : gltf_mesh.primitives) {
+                const MeshCache::Views& views = primitive.views;
+                if (views.indices.empty()) continue;
+                HostMesh& mesh = meshes.emplace_back(VertexUnifier::convert(views));
+                if (primitive.material != UINT32_MAX) {
+                    mesh.material_ids.assign(mesh.indices.size(), primitive.material);
+                }
+            }
+        }
+        for (const GltfLoader::Instance& instance : gltf_loader.get_instances()) {
+            model.instances.push_back({ instance.mesh, instance.transform });
+        }
+        // Embedded images are only shared within their model
+        const std::vector<GltfLoader::Texture>& gltf_textures = gltf_loader.get_textures();
+        auto texture = [&](int32_t index) {
+            if (index < 0 || static_cast<size_t>(index) >= gltf_textures.size()) return -1;
+            const GltfLoader::Texture& t = gltf_textures[index];
+            return static_cast<int>(t.data.empty()
+                ? textures.request((directory / t.uri).string())
+                : textures.request(fmt::format("{}#{}", path, index), t.data));
+        };
+        for (const GltfLoader::Material& m : gltf_loader.get_materials()) {
+            model.materials.push_back({
+                .diffuse = vec3f(m.base_color.x, m.base_color.y, m.base_color.z),
+                .emission = m.emissive,
+                .diffuse_tex = texture(m.base_color_texture),
+                .emission_tex = texture(m.emissive_texture),
+            });
+        }
+    }
+    else if (PlyLoader::handles(path)) {
+        PlyLoader ply_loader({ .crease_angle = config.crease_angle });
+        if (!ply_loader.load(path)) {
+            throw std::runtime_error("Failed to load model " + path);
+        }
+        model.meshes.emplace_back().levels.emplace_back().push_back(VertexUnifier::convert(ply_loader.get_views()));
+        model.instances.push_back({ 0, affine3f(one) });
+    }
+    else if (ClusterFile::handles(path)) {
+        throw std::runtime_error("Cluster files are streamed on their own, pass " + path + " as the only --model-path");
+    }
+    else {
+        ObjLoader::Config obj_loader_config;
+        obj_loader_config.loadFlags = ObjLoader::LoadFlags::Vertices | ObjLoader::LoadFlags::Normals | ObjLoader::LoadFlags::TexCoords;
+        for (const std::string& shape : config.shapes) {
+            // Numbers select shapes by index, anything else by name
+            if (!shape.empty() && std::all_of(shape.begin(), shape.end(), [](unsigned char c) { return std::isdigit(c); })) {
+                obj_loader_config.meshes.push_back(static_cast<uint32_t>(std::stoul(shape)));
+            }
+            else {
+                obj_loader_config.mesh_names.push_back(shape);
+            }
+        }
+        obj_loader_config.crease_angle = config.crease_angle;
+        ObjLoader obj_loader(obj_loader_config);
+        if (!obj_loader.load(path)) {
+            throw std::runtime_error("Failed to load model " + path);
+        }
+        HostMesh& mesh = model.meshes.emplace_back().levels.emplace_back().emplace_back(VertexUnifier::unify(obj_loader.get_views()));
+        model.instances.push_back({ 0, affine3f(one) });
+        // OBJ texture coordinates start at the bottom row, images are decoded top row first
+        for (Geometry::PackedVertex& vertex : mesh.vertices) {
+            vertex.texcoord.y = 1.f - vertex.texcoord.y;
+        }
+        auto texture = [&](const std::string& map) {
+            return map.empty() ? -1 : static_cast<int>(textures.request((directory / map).string()));
+        };
+        for (const MtlLoader::Material& m : obj_loader.get_materials()) {
+            model.materials.push_back({
+                .diffuse = m.diffuse,
+                .emission = m.emission,
+                .diffuse_tex = texture(m.diffuse_map),
+                .emission_tex = texture(m.emission_map),
+            });
+        }
+    }
+
+    size_t num_triangles = 0;
+    for (HostModel::Mesh& mesh : model.meshes) {
+        mesh.errors.push_back(0.f);
+        for (HostMesh& primitive : mesh.levels.front()) {
+            if (config.optimize_mesh) {
+                MeshOptimizer::optimize(primitive, {});
+            }
+            mesh.bounds.extend(primitive.bounds());
+            num_triangles += primitive.indices.size();
+        }
+    }
+    spdlog::info("Model: {} meshes, {} triangles from {}", model.meshes.size(), num_triangles, path);
+    if (config.lod) {
+        build_lod_levels(model, path);
+    }
+    return model;
+}
+
+/**
+ * Simplify every primitive into a chain of levels, or read the chains from the model's LOD cache.
+ * Level k of a mesh takes each primitive at level k, or at its coarsest level when its chain is shorter.
+ */
+void TraceHost::build_lod_levels(HostModel& model, const std::string& path) const {
+    const MeshSimplifier::Config lod_config;
+    std::vector<const HostMesh*> primitives;
+    for (const HostModel::Mesh& mesh : model.meshes) {
+        for (const HostMesh& primitive : mesh.levels.front()) {
+            primitives.push_back(&primitive);
+        }
+    }
+
+    // The optimize flag changes the input, it takes the place of the load flags. Like the mesh cache, OBJ models
+    // loaded with a shape selection are never cached, the chains would not match a load of other shapes.
+    const std::string cache_path = LodCache::path_for(path);
+    const bool partial = !config.shapes.empty() && !GltfLoader::handles(path) && !PlyLoader::handles(path);
+    const std::optional<MeshCache::Source> source = partial
+        ? std::nullopt
+        : MeshCache::stat_source(path, config.optimize_mesh ? 1 : 0, config.crease_angle);
+    std::optional<LodCache::Chains> chains = source ? LodCache::read(cache_path, *source, lod_config) : std::nullopt;
+    if (!chains || chains->size() != primitives.size()) {
+        chains.emplace(primitives.size());
+        tbb::parallel_for(size_t(0), primitives.size(), [&](size_t p) {
+            (*chains)[p] = MeshSimplifier::build_lods(*primitives[p], lod_config);
+        });
+        if (source) {
+            LodCache::write(cache_path, *source, lod_config, *chains);
+        }
+    }
+
+    size_t first = 0;
+    for (HostModel::Mesh& mesh : model.meshes) {
+        const size_t count = mesh.levels.front().size();
+        size_t num_levels = 1;
+        for (size_t p = first; p < first + count; p++) {
+            num_levels = std::max(num_levels, (*chains)[p].size() + 1);
+        }
+        // Levels reference the full resolution primitives while they are filled
+        mesh.levels.reserve(num_levels);
+        for (size_t level = 1; level < num_levels; level++) {
+            std::vector<HostMesh>& meshes = mesh.levels.emplace_back();
+            float error = 0.f;
+            for (size_t p = first; p < first + count; p++) {
+                std::vector<MeshSimplifier::Lod>& chain = (*chains)[p];
+                if (chain.empty()) {
+                    meshes.push_back(mesh.levels.front()[p - first]);
+                    continue;
+                }
+                // The coarsest level is reused by every level past the end of the chain
+                MeshSimplifier::Lod& lod = chain[std::min(level, chain.size()) - 1];
+                meshes.push_back(level < chain.size() ? std::move(lod.mesh) : lod.mesh);
+                error = std::max(error, lod.error);
+            }
+            mesh.errors.push_back(error);
+        }
+        first += count;
+    }
+}
+
+/**
+ * Load all models on the task pool and build the BLASes of each one as soon as it is parsed.
+ * OWL is only called from this thread, device builds overlap with the models still being parsed
+ * and with their textures being decoded.
+ */
+OWLGroup TraceHost::build_models_world(const std::vector<Model>& models) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    // Every distinct file is loaded once and instanced at each of its placements
+    std::vector<std::string> paths;
+    std::vector<std::vector<affine3f>> placements;
+    std::unordered_map<std::string, size_t> unique_paths;
+    for (const Model& model : models) {
+        std::error_code error;
+        const std::filesystem::path canonical = std::filesystem::weakly_canonical(model.path, error);
+        const auto [it, inserted] = unique_paths.try_emplace(error ? model.path : canonical.string(), paths.size());
+        if (inserted) {
+            paths.push_back(model.path);
+            placements.emplace_back();
+        }
+        placements[it->second].push_back(model.transform);
+    }
+
+    TexturePool textures;
+    std::vector<Material::MeshMaterial> materials;
+    std::vector<HostModel> loaded(paths.size());
+    std::vector<std::exception_ptr> errors(paths.size());
+    tbb::concurrent_bounded_queue<size_t> ready;
+    tbb::task_group tasks;
+    for (size_t i = 0; i < paths.size(); i++) {
+        tasks.run([&, i] {
+            try {
+                loaded[i] = load_model(paths[i], textures);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+            ready.push(i);
+        });
+    }
+
+    std::vector<OWLGroup> instance_groups;
+    std::vector<affine3f> transforms;
+    for (size_t n = 0; n < paths.size(); n++) {
+        size_t i;
+        ready.pop(i);
+        if (errors[i]) {
+            tasks.wait();
+            std::rethrow_exception(errors[i]);
+        }
+
+        HostModel& model = loaded[i];
+        // Material ids index the model's own materials until they join the scene table
+        const uint32_t material_offset = static_cast<uint32_t>(materials.size());
+        materials.insert(materials.end(), model.materials.begin(), model.materials.end());
+        for (HostModel::Mesh& mesh : model.meshes) {
+            for (std::vector<HostMesh>& meshes : mesh.levels) {
+                for (HostMesh& primitive : meshes) {
+                    for (uint32_t& id : primitive.material_ids) {
+                        if (id != UINT32_MAX) id += material_offset;
+                    }
+                }
+            }
+        }
+
+        // Index into lod.meshes of every mesh of this model
+        std::vector<uint32_t> lod_mesh(model.meshes.size(), UINT32_MAX);
+        for (size_t m = 0; m < model.meshes.size(); m++) {
+            if (model.meshes[m].levels.front().empty()) continue;
+            LodState::Mesh& lod_levels = lod.meshes.emplace_back();
+            for (std::vector<HostMesh>& meshes : model.meshes[m].levels) {
+                size_t triangles = 0;
+                size_t bytes = 0;
+                for (const HostMesh& mesh : meshes) {
+                    triangles += mesh.indices.size();
+                    bytes += mesh.vertex_bytes() + mesh.index_bytes();
+                }
+                (lod_levels.groups.empty() ? lod.full_bytes : lod.lod_bytes) += bytes;
+                lod_levels.groups.push_back(build_mesh_group(meshes));
+                lod_levels.triangles.push_back(triangles);
+            }
+            lod_levels.errors = model.meshes[m].errors;
+            lod_mesh[m] = static_cast<uint32_t>(lod.meshes.size() - 1);
+        }
+        for (const affine3f& placement : placements[i]) {
+            for (const HostModel::Instance& instance : model.instances) {
+                if (lod_mesh[instance.mesh] == UINT32_MAX) continue;
+                const affine3f transform = placement * instance.transform;
+                const LodState::Mesh& lod_levels = lod.meshes[lod_mesh[instance.mesh]];
+                const box3f bounds = xfmBounds(transform, model.meshes[instance.mesh].bounds);
+                instance_groups.push_back(lod_levels.groups.front());
+                transforms.push_back(transform);
+                state.scene_bounds.extend(bounds);
+                const float scale = std::max({ length(transform.l.vx), length(transform.l.vy), length(transform.l.vz) });
+                lod.instances.push_back({ lod_mesh[instance.mesh], bounds, scale });
+                lod.full_triangles += lod_levels.triangles.front();
+            }
+        }
+        // Host copies are not needed once the geometry is on the device
+        model = HostModel();
+    }
+    tasks.wait();
+    if (instance_groups.empty()) {
+        throw std::runtime_error("Models contain no triangles");
+    }
+
+    // Images that failed to decode become white, so their materials keep the plain color
+    const std::deque<TexturePool::Image>& images = textures.wait();
+    const uint8_t white[4] = { 255, 255, 255, 255 };
+    std::vector<OWLTexture> texture_handles;
+    for (const TexturePool::Image& image : images) {
+        const bool decoded = !image.pixels.empty();
+        texture_handles.push_back(owlTexture2DCreate(
+            owl.ctx,
+            OWL_TEXEL_FORMAT_RGBA8,
+            decoded ? image.width : 1, decoded ? image.height : 1,
+            decoded ? image.pixels.data() : white,
+            OWL_TEXTURE_LINEAR,
+            OWL_TEXTURE_WRAP
+        ));
+    }
+    owlBufferResize(owl.textures, texture_handles.size());
+    owlBufferUpload(owl.textures, texture_handles.data());
+    owlBufferResize(owl.materials, materials.size());
+    owlBufferUpload(owl.materials, materials.data());
+    spdlog::info("Textures: {} images for {} material references, decoded in {:.1f} ms", textures.num_images(),
+                 textures.num_requests(), textures.decode_ms());
+
+    OWLGroup world = owlInstanceGroupCreate(owl.ctx, instance_groups.size(), instance_groups.data());
+    for (size_t i = 0; i < transforms.size(); i++) {
+        owlInstanceGroupSetTransform(world, i, reinterpret_cast<const float*>(&transforms[i]), OWL_MATRIX_FORMAT_OWL);
+    }
+    owlGroupBuildAccel(world);
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("Scene: {} instances from {} models in {} files, {} materials in {:.1f} ms", instance_groups.size(),
+                 models.size(), paths.size(), materials.size(), std::chrono::duration<double, std::milli>(end - start).count());
+    if (config.lod) {
+        lod.world = world;
+        lod.pixel_error = config.lod_pixel_error;
+        lod.traced_triangles = lod.full_triangles;
+        spdlog::info("LOD: coarser levels add {} MB to {} MB of full resolution geometry", lod.lod_bytes >> 20,
+                     lod.full_bytes >> 20);
+    }
+    return world;
+}
+
+/**
+ * Pick the coarsest level of every instance whose error projects to at most lod.pixel_error pixels,
+ * and rebuild the instance group when any instance switched.
+ */
+void TraceHost::update_lods() {
+    if (!lod.world) return;
+
+    // Size of a pixel at unit distance, the image plane spans cos_fov_y vertically
+    const float pixel_size = state.camera.cos_fov_y / static_cast<float>(config.height);
+    bool changed = false;
+    lod.traced_triangles = 0;
+    for (size_t i = 0; i < lod.instances.size(); i++) {
+        LodState::Instance& instance = lod.instances[i];
+        const LodState::Mesh& mesh = lod.meshes[instance.mesh];
+        const float radius = 0.5f * length(instance.bounds.span());
+        const float distance = std::max(length(instance.bounds.center() - state.camera.look_from) - radius, 0.f);
+        const float max_error = lod.pixel_error * pixel_size * distance;
+        uint32_t level = 0;
+        while (level + 1 < mesh.groups.size() && mesh.errors[level + 1] * instance.scale <= max_error) {
+            level++;
+        }
+        if (level != instance.level) {
+            owlInstanceGroupSetChild(lod.world, static_cast<int>(i), mesh.groups[level]);
+            instance.level = level;
+            changed = true;
+        }
+        lod.traced_triangles += mesh.triangles[level];
+    }
+    if (!changed) return;
+
+    // A rebuilt world gets a new traversable, the ray generation records have to pick it up
+    owlGroupBuildAccel(lod.world);
+    owlBuildSBT(owl.ctx);
+    state.launch_params.dirty = true;
+}
+
+/**
+ * Map a cluster file and page in the largest clusters that fit the budget, the camera takes over from the first frame.
+ */
+OWLGroup TraceHost::init_streaming() {
+    if (!stream.file.open(config.model.value())) {
+        throw std::runtime_error("Failed to load model " + config.model.value());
+    }
+
+    const std::span<const ClusterFile::Cluster> clusters = stream.file.clusters();
+    std::vector<box3f> bounds(clusters.size());
+    // The BVH of a cluster is budgeted at the size of its geometry
+    std::vector<size_t> bytes(clusters.size());
+    for (size_t i = 0; i < clusters.size(); i++) {
+        bounds[i] = clusters[i].bounds;
+        bytes[i] = 2 * clusters[i].bytes();
+    }
+    stream.bvh.build(bounds);
+    stream.cache = std::make_unique<ClusterCache>(ClusterCache::Config { .budget_bytes = config.stream_budget_mb << 20 }, std::move(bytes));
+    stream.groups.assign(clusters.size(), nullptr);
+    state.scene_bounds.extend(stream.file.bounds());
+
+    std::vector<uint32_t> wanted(clusters.size());
+    std::iota(wanted.begin(), wanted.end(), 0u);
+    std::sort(wanted.begin(), wanted.end(), [&](uint32_t a, uint32_t b) {
+        return length(bounds[a].span()) > length(bounds[b].span());
+    });
+    // Nothing is wanted more than anything else yet, so updates only load until the budget is full
+    for (;;) {
+        const ClusterCache::Update update = stream.cache->update(wanted);
+        if (update.load.empty()) break;
+        apply_stream_update(update);
+    }
+    if (!build_stream_world()) {
+        throw std::runtime_error("Stream budget is too small for a single cluster");
+    }
+    spdlog::info("Streaming: {} of {} clusters resident, {} MB", stream.cache->resident_count(), clusters.size(),
+                 stream.cache->used_bytes() >> 20);
+    return stream.world;
+}
+
+/**
+ * Page in the visible clusters by their size on screen and rebuild the instance group when residency changed.
+ */
+void TraceHost::update_streaming() {
+    if (!stream.cache) return;
+
+    const vec3f d = normalize(state.camera.look_at - state.camera.look_from);
+    const vec3f right = normalize(cross(d, state.camera.up));
+    const vec3f up = cross(right, d);
+    // Slightly wider than the image so clusters entering at the border are already resident
+    const float hh = 0.55f * state.camera.cos_fov_y;
+    const float hw = hh * state.aspect;
+    const ClusterBvh::Frustum frustum = {
+        state.camera.look_from,
+        {
+            cross(d - hw * right, up),
+            cross(up, d + hw * right),
+            cross(right, d - hh * up),
+            cross(d + hh * up, right),
+        },
+    };
+    const std::vector<ClusterBvh::Visible> visible = stream.bvh.query(frustum);
+    std::vector<uint32_t> wanted(visible.size());
+    std::transform(visible.begin(), visible.end(), wanted.begin(), [](const ClusterBvh::Visible& v) { return v.cluster; });
+    stream.visible = visible.size();
+
+    // Evictions can come without loads when the space they freed still did not fit the next cluster,
+    // their groups have to be released and dropped from the world all the same
+    const ClusterCache::Update update = stream.cache->update(wanted);
+    if (update.load.empty() && update.evict.empty()) return;
+    apply_stream_update(update);
+    build_stream_world();
+    for (OWLRayGen ray_gen : { owl.ray_gen, owl.resolve }) {
+        owlRayGenSetGroup(ray_gen, "world", stream.world);
+    }
+    owlBuildSBT(owl.ctx);
+    state.launch_params.dirty = true;
+}
+
+void TraceHost::apply_stream_update(const ClusterCache::Update& update) {
+    // The previous world still references evicted groups until it is replaced
+    for (const uint32_t cluster : update.evict) {
+        owlGroupRelease(stream.groups[cluster]);
+        stream.groups[cluster] = nullptr;
+    }
+    for (const uint32_t cluster : update.load) {
+        std::vector<HostMesh> meshes;
+        meshes.push_back(stream.file.read(cluster));
+        // Cluster files carry no material library, their ids would index an empty table
+        meshes.front().material_ids.clear();
+        if (config.optimize_mesh) {
+            MeshOptimizer::optimize(meshes.front(), {});
+        }
+        stream.groups[cluster] = build_mesh_group(meshes);
+    }
+}
+
+bool TraceHost::build_stream_world() {
+    std::vector<OWLGroup> resident;
+    for (OWLGroup group : stream.groups) {
+        if (group) resident.push_back(group);
+    }
+    if (resident.empty()) return false;
+
+    OWLGroup previous = stream.world;
+    stream.world = owlInstanceGroupCreate(owl.ctx, resident.size(), resident.data());
+    owlGroupBuildAccel(stream.world);
+    if (previous) {
+        owlGroupRelease(previous);
+    }
+    return true;
+}
+
 TraceHost::EnvMapDevice TraceHost::build_env_map() {
     // Load environment map
     ImageLoader::Config image_loader_config;
     image_loader_config.cache = true;
 
     ImageLoader image_loader(image_loader_config);
-    OWLTexture env_map = image_loader.load_image_owl(config.env_map.value(), owl.ctx);
-    if (env_map == 0) {
+    std::optional<ImageLoader::DeviceTexture> env_map = image_loader.load_image_cuda(config.env_map.value(), config.env_format);
+    if (!env_map) {
         throw std::runtime_error("Failed to load environment map");
     }
 
@@ -435,6 +1014,11 @@ TraceHost::EnvMapDevice TraceHost::build_env_map() {
     if (!alias.has_value()) {
         throw std::runtime_error("Failed to build alias table");
     }
+    const ImageCache::Stats cache = ImageCache::instance().stats();
+    spdlog::info("ImageCache: {} hits, {} misses, {} evictions, {} images in {}/{} MB", cache.hits, cache.misses,
+                 cache.evictions, cache.entries, cache.used_bytes >> 20, cache.budget_bytes >> 20);
+    // Texture and alias table are built, the float image would otherwise stay in host memory for the whole run
+    ImageCache::instance().release(config.env_map.value());
 
     void *dev_alias_pdf_ptr, *dev_alias_i_ptr, *dev_pdf_ptr;
     spdlog::info("Mapping alias table to device of size {}", alias->size.first * alias->size.second);
@@ -443,7 +1027,7 @@ TraceHost::EnvMapDevice TraceHost::build_env_map() {
     mapBufferToDevice(alias->alias_i.get(), alias->size.first * alias->size.second, &dev_alias_i_ptr);
 
     EnvMapDevice dev_ptrs = {
-        env_map,
+        *env_map,
         dev_alias_pdf_ptr,
         dev_alias_i_ptr,
         dev_pdf_ptr,
@@ -453,6 +1037,188 @@ TraceHost::EnvMapDevice TraceHost::build_env_map() {
     return dev_ptrs;
 }
 
+/**
+ * Allocate the radiance sample buffer and an initial uniform guide.
+ * NOTE: Training runs for config.guiding_iterations iterations, iteration k renders 2^k frames.
+ */
+void TraceHost::init_guiding() {
+    if (!config.path_guiding) return;
+    spdlog::info("Initializing path guiding...");
+
+    LaunchParams::Guide& dev = state.launch_params.guide;
+    dev.max_samples = 1u << 21;
+    cudaMalloc(reinterpret_cast<void**>(&dev.samples), dev.max_samples * sizeof(Guiding::Sample));
+    cudaMalloc(reinterpret_cast<void**>(&dev.sample_count), sizeof(unsigned int));
+    cudaMemset(dev.sample_count, 0, sizeof(unsigned int));
+
+    guide.tree = std::make_unique<SDTree>(SDTree::Config(), state.scene_bounds);
+    upload_guide();
+    dev.training = true;
+    dev.active = false;
+}
+
+void TraceHost::upload_guide() {
+    LaunchParams::Guide& dev = state.launch_params.guide;
+    const auto& spatial = guide.tree->spatial_nodes();
+    const auto& directional = guide.tree->dir_nodes();
+
+    cudaFree(dev.spatial);
+    cudaFree(dev.directional);
+    dev.spatial = nullptr;
+    dev.directional = nullptr;
+    mapBufferToDevice(spatial.data(), spatial.size(), reinterpret_cast<void**>(&dev.spatial));
+    mapBufferToDevice(directional.data(), directional.size(), reinterpret_cast<void**>(&dev.directional));
+}
+
+/**
+ * Pull this frame's radiance samples back to the host and splat them into the guide.
+ * At the end of an iteration the guide is refined, re-uploaded and the image is reset so that the
+ * accumulated result only contains samples drawn with the latest guide.
+ */
+void TraceHost::train_guide() {
+    auto start = std::chrono::high_resolution_clock::now();
+    LaunchParams::Guide& dev = state.launch_params.guide;
+
+    unsigned int count = 0;
+    cudaMemcpy(&count, dev.sample_count, sizeof(unsigned int), cudaMemcpyDeviceToHost);
+    count = std::min(count, dev.max_samples);
+    guide.host_samples.resize(count);
+    cudaMemcpy(guide.host_samples.data(), dev.samples, count * sizeof(Guiding::Sample), cudaMemcpyDeviceToHost);
+    cudaMemset(dev.sample_count, 0, sizeof(unsigned int));
+
+    guide.tree->record(guide.host_samples);
+
+    if (++guide.frames_in_iteration >= (1 << guide.iteration)) {
+        guide.tree->refine(guide.iteration);
+        upload_guide();
+        guide.iteration++;
+        guide.frames_in_iteration = 0;
+        dev.active = true;
+        state.launch_params.dirty = true;
+
+        if (guide.iteration >= config.guiding_iterations) {
+            dev.training = false;
+            cudaFree(dev.samples);
+            dev.samples = nullptr;
+            guide.host_samples = {};
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    guide.training_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    if (!dev.training) {
+        spdlog::info("Path guiding: Training finished after {} iterations, host overhead {:.1f} ms",
+                     guide.iteration, guide.training_ms);
+    }
+}
+
+/**
+ * Allocate the radiance cache table.
+ * NOTE: The table is never resized, stale cells are reclaimed on insertion instead.
+ */
+void TraceHost::init_radiance_cache() {
+    if (!config.radiance_cache) return;
+
+    RadianceCache::Params& cache = state.launch_params.cache;
+    cache.capacity = 1u << config.cache_capacity_log2;
+    cache.cell_size = config.cache_cell_size;
+    const size_t bytes = cache.capacity * sizeof(RadianceCache::Cell);
+    spdlog::info("Initializing radiance cache with {} cells ({} MB)...", cache.capacity, bytes >> 20);
+
+    if (cudaMalloc(reinterpret_cast<void**>(&cache.cells), bytes) != cudaSuccess) {
+        throw std::runtime_error("Failed to allocate radiance cache");
+    }
+    cudaMemset(cache.cells, 0, bytes);
+    cache.enabled = true;
+}
+
+/**
+ * Allocate the per-pixel history, sample and primary hit buffers used to reproject accumulated
+ * radiance through camera motion.
+ */
+void TraceHost::init_reprojection() {
+    if (!config.reprojection) return;
+    spdlog::info("Initializing history reprojection...");
+
+    LaunchParams::Reprojection& reproject = state.launch_params.reproject;
+    const size_t bytes = config.width * config.height * sizeof(vec4f);
+    for (vec4f** buffer : { &reproject.history, &reproject.samples, &reproject.positions, &reproject.prev_positions }) {
+        if (cudaMalloc(reinterpret_cast<void**>(buffer), bytes) != cudaSuccess) {
+            throw std::runtime_error("Failed to allocate reprojection buffers");
+        }
+        cudaMemset(*buffer, 0, bytes);
+    }
+    reproject.enabled = true;
+}
+
+/**
+ * Allocate the primary hit cache (one entry per jitter stratum per pixel) and the ray counter.
+ */
+void TraceHost::init_gbuffer() {
+    cudaMalloc(reinterpret_cast<void**>(&state.launch_params.ray_count), sizeof(unsigned long long));
+    cudaMemset(state.launch_params.ray_count, 0, sizeof(unsigned long long));
+
+    if (!config.gbuffer_cache) return;
+    spdlog::info("Initializing primary hit cache...");
+
+    LaunchParams::GBuffer& gbuffer = state.launch_params.gbuffer;
+    const size_t strata = gbuffer.resolution * gbuffer.resolution;
+    const size_t bytes = config.width * config.height * strata * sizeof(PrimaryHit);
+    if (cudaMalloc(reinterpret_cast<void**>(&gbuffer.hits), bytes) != cudaSuccess) {
+        throw std::runtime_error("Failed to allocate primary hit cache");
+    }
+    gbuffer.enabled = true;
+}
+
+/**
+ * Allocate the half buffer used to estimate the remaining error.
+ * NOTE: Time and spp targets need no device state.
+ */
+void TraceHost::init_termination() {
+    if (config.target_error <= 0.f) return;
+    spdlog::info("Initializing error estimation with target {}...", config.target_error);
+
+    const size_t bytes = config.width * config.height * sizeof(vec4f);
+    if (cudaMalloc(reinterpret_cast<void**>(&state.launch_params.half_buffer), bytes) != cudaSuccess) {
+        throw std::runtime_error("Failed to allocate half buffer");
+    }
+    cudaMemset(state.launch_params.half_buffer, 0, bytes);
+}
+
+/**
+ * Allocate the first-hit albedo and normal buffers the denoiser is guided by.
+ */
+void TraceHost::init_denoiser() {
+    if (!config.denoise) return;
+    spdlog::info("Initializing denoiser...");
+
+    LaunchParams::AOV& aov = state.launch_params.aov;
+    const size_t bytes = config.width * config.height * sizeof(vec4f);
+    for (vec4f** buffer : { &aov.albedo, &aov.normal }) {
+        if (cudaMalloc(reinterpret_cast<void**>(buffer), bytes) != cudaSuccess) {
+            throw std::runtime_error("Failed to allocate AOV buffers");
+        }
+        cudaMemset(*buffer, 0, bytes);
+    }
+    denoise.denoiser = std::make_unique<Denoiser>(Denoiser::Config());
+    denoise.enabled = true;
+}
+
+/**
+ * Allocate the per-pixel cost counters.
+ * NOTE: Only present in builds configured with ENABLE_COST_COUNTERS.
+ */
+void TraceHost::init_cost_counters() {
+#ifdef COST_COUNTERS
+    spdlog::info("Initializing cost counters...");
+    const size_t bytes = config.width * config.height * sizeof(vec4ui);
+    if (cudaMalloc(reinterpret_cast<void**>(&state.launch_params.cost), bytes) != cudaSuccess) {
+        throw std::runtime_error("Failed to allocate cost counters");
+    }
+    cudaMemset(state.launch_params.cost, 0, bytes);
+#endif
+}
+
 /*
  * Currently this is a mega function that initializes the scene, OpenGL, and OptiX.
  * TODO: I want to break this function up into smaller functions that are easier to understand.
@@ -462,6 +1228,7 @@ void TraceHost::init() {
     prev_time = std::chrono::high_resolution_clock::now();
 
     void* dev_pbo_ptr = init_gl();
+    state.pbo_ptr = static_cast<vec4f*>(dev_pbo_ptr);
 
     /********** Initialize OWL **********/
     spdlog::info("Initializing OWL...");
@@ -475,11 +1242,20 @@ void TraceHost::init() {
 
     // Build scene + load into buffers
     OWLGroup world = build_scene();
-    EnvMapDevice env_device  = build_env_map();
+    env_device = build_env_map();
+    init_guiding();
+    init_radiance_cache();
+    init_reprojection();
+    init_gbuffer();
+    init_termination();
+    init_denoiser();
+    init_cost_counters();
 
     // Create miss program
     OWLVarDecl miss_prog_vars[] = {
-        {"env_map", OWL_TEXTURE, OWL_OFFSETOF(MissProgData, env_map)},
+        {"env_map", OWL_USER_TYPE(cudaTextureObject_t), OWL_OFFSETOF(MissProgData, env_map)},
+        {"env_format", OWL_INT, OWL_OFFSETOF(MissProgData, env_format)},
+        {"env_uv_scale", OWL_FLOAT2, OWL_OFFSETOF(MissProgData, env_uv_scale)},
         { nullptr }
     };
 
@@ -492,7 +1268,10 @@ void TraceHost::init() {
         -1
     );
 
-    owlMissProgSetTexture(owl.miss_prog, "env_map", env_device.env_map);
+    // The texture is created outside OWL, formats other than RGBA8 and RGBA32F have no OWL texture
+    owlMissProgSetRaw(owl.miss_prog, "env_map", &env_device.env_map.texture);
+    owlMissProgSet1i(owl.miss_prog, "env_format", static_cast<int>(env_device.env_map.format));
+    owlMissProgSet2f(owl.miss_prog, "env_uv_scale", env_device.env_map.uv_scale.x, env_device.env_map.uv_scale.y);
 
     // Create ray generation program
     OWLVarDecl ray_gen_vars[] = {
@@ -519,14 +1298,26 @@ void TraceHost::init() {
         -1
         );
 
-    owlRayGenSetPointer(owl.ray_gen, "pbo_ptr", dev_pbo_ptr);
-    owlRayGenSet2i(owl.ray_gen, "pbo_size", config.width, config.height);
-    owlRayGenSetGroup(owl.ray_gen, "world", world);
-    owlRayGenSetPointer(owl.ray_gen, "env.pdf", env_device.dev_pdf_ptr);
-    owlRayGenSetPointer(owl.ray_gen, "env.alias_pdf", env_device.dev_alias_pdf_ptr);
-    owlRayGenSetPointer(owl.ray_gen, "env.alias_i", env_device.dev_alias_i_ptr);
-    owlRayGenSet2ui(owl.ray_gen, "env.size", env_device.size.first, env_device.size.second);
-    owlRayGenSetBuffer(owl.ray_gen, "launch", state.launch_params_buffer);
+    // Resolve shares the ray generation data, it only runs on reprojected frames
+    owl.resolve = owlRayGenCreate(
+        owl.ctx,
+        owl.module,
+        "Resolve",
+        sizeof(RayGenData),
+        ray_gen_vars,
+        -1
+        );
+
+    for (OWLRayGen ray_gen : { owl.ray_gen, owl.resolve }) {
+        owlRayGenSetPointer(ray_gen, "pbo_ptr", dev_pbo_ptr);
+        owlRayGenSet2i(ray_gen, "pbo_size", config.width, config.height);
+        owlRayGenSetGroup(ray_gen, "world", world);
+        owlRayGenSetPointer(ray_gen, "env.pdf", env_device.dev_pdf_ptr);
+        owlRayGenSetPointer(ray_gen, "env.alias_pdf", env_device.dev_alias_pdf_ptr);
+        owlRayGenSetPointer(ray_gen, "env.alias_i", env_device.dev_alias_i_ptr);
+        owlRayGenSet2ui(ray_gen, "env.size", env_device.size.first, env_device.size.second);
+        owlRayGenSetBuffer(ray_gen, "launch", state.launch_params_buffer);
+    }
 
     spdlog::info("Building programs, pipeline, and SBT");
     owlBuildPrograms(owl.ctx);
@@ -538,6 +1329,12 @@ void TraceHost::init() {
     /********** Setup Render State **********/
 
     state.aspect = 1.0f * config.width / config.height;
+    state.launch_params.frame.size = vec2i(config.width, config.height);
+    state.launch_params.frame.prev_size = state.launch_params.frame.size;
+    progressive.enabled = config.progressive;
+    dynamic_res.enabled = config.target_frame_ms > 0.f;
+    dynamic_res.target_ms = config.target_frame_ms;
+    termination.start = prev_time;
     state.camera.look_from = { 5.f, 5.f, 5.f };
     state.camera.look_at = { 0.f, 0.f, 0.f };
     state.camera.up = { 0.f, 1.f, 0.f };
@@ -604,19 +1401,89 @@ void TraceHost::increment_camera(CameraActions action, float speed) {
 
 void TraceHost::resize_window(int width, int height) {
     state.aspect = 1.0f * width / height;
+    state.launch_params.dirty = true;
 }
 
-void TraceHost::update_launch_params() {
-    // Update spp
+void TraceHost::draw_ui() {
     // ImGui::Text("Frames accumulated: %d", state.launch_params.frame.id);
     ImGui::BeginChild("Launch Params");
     ImGui::Text("Frames accumulated : %d", state.launch_params.frame.accum_frames);
+    if (termination.converged) {
+        ImGui::Text("Converged");
+    }
+    if (termination.error >= 0.f) {
+        ImGui::Text("Estimated error: %.4f", termination.error);
+    }
     ImGui::Text("Camera Position: (%.2f, %.2f, %.2f)", state.camera.look_from.x, state.camera.look_from.y, state.camera.look_from.z);
     ImGui::Text("Camera Target: (%.2f, %.2f, %.2f)", state.camera.look_at.x, state.camera.look_at.y, state.camera.look_at.z);
     ImGui::Text("Camera Up: (%.2f, %.2f, %.2f)", state.camera.up.x, state.camera.up.y, state.camera.up.z);
     ImGui::Text("Aspect Ratio: %.2f", state.aspect);
+    if (guide.tree) {
+        ImGui::Text("Guiding: iteration %d/%d, %zu leaves", guide.iteration, config.guiding_iterations, guide.tree->num_leaves());
+        ImGui::Text("Guiding overhead: %.1f ms", guide.training_ms);
+        if (ImGui::SliderFloat("BSDF fraction", &state.launch_params.guide.bsdf_fraction, 0.f, 1.f)) {
+            state.launch_params.dirty = true;
+        }
+    }
+    if (lod.world) {
+        ImGui::Text("LOD: %zu of %zu triangles traced", lod.traced_triangles, lod.full_triangles);
+        ImGui::Text("LOD memory: %zu MB over %zu MB full resolution", lod.lod_bytes >> 20, lod.full_bytes >> 20);
+        ImGui::SliderFloat("LOD pixel error", &lod.pixel_error, 0.f, 8.f);
+    }
+    if (stream.cache) {
+        ImGui::Text("Streaming: %zu/%zu clusters resident, %zu visible", stream.cache->resident_count(), stream.groups.size(), stream.visible);
+        ImGui::Text("Stream memory: %zu/%zu MB", stream.cache->used_bytes() >> 20, config.stream_budget_mb);
+    }
+    const ImageCache::Stats image_cache = ImageCache::instance().stats();
+    ImGui::Text("Image cache: %zu/%zu MB, %llu hits, %llu misses, %llu evictions", image_cache.used_bytes >> 20,
+                image_cache.budget_bytes >> 20, static_cast<unsigned long long>(image_cache.hits),
+                static_cast<unsigned long long>(image_cache.misses), static_cast<unsigned long long>(image_cache.evictions));
+    if (state.launch_params.reproject.history) {
+        LaunchParams::Reprojection& reproject = state.launch_params.reproject;
+        ImGui::Checkbox("Reprojection", &reproject.enabled);
+        ImGui::SliderInt("Max history", &reproject.max_history, 1, 256);
+    }
+    if (state.launch_params.gbuffer.hits) {
+        if (ImGui::Checkbox("Primary hit cache", &state.launch_params.gbuffer.enabled)) {
+            state.launch_params.dirty = true;
+        }
+    }
+    const float d_seconds = std::chrono::duration_cast<std::chrono::duration<float>>(approx_delta).count();
+    ImGui::Text("Rays per frame: %.2f M", rays_per_frame * 1e-6);
+    ImGui::Text("Ray throughput: %.1f Mrays/s", d_seconds > 0.f ? rays_per_frame * 1e-6 / d_seconds : 0.0);
+    ImGui::Checkbox("Dynamic resolution", &dynamic_res.enabled);
+    ImGui::SliderFloat("Target frame time (ms)", &dynamic_res.target_ms, 4.f, 100.f);
+    ImGui::Text("Render scale: %.2f (%dx%d)", dynamic_res.scale, state.launch_params.frame.size.x, state.launch_params.frame.size.y);
+    if (ImGui::Checkbox("Progressive preview", &progressive.enabled)) {
+        state.launch_params.dirty = true;
+    }
+    ImGui::Text("Time to first preview: %.1f ms", progressive.first_preview_ms);
+    ImGui::Checkbox("Show sample count", &show_sample_count);
+#ifdef COST_COUNTERS
+    ImGui::Combo("Cost view", &cost_view.channel, "Image\0Rays\0Bounces\0Primitive tests\0Shadow rays\0");
+    if (cost_view.channel > 0) {
+        ImGui::Text("Max per pixel: %.0f", cost_view.max_value);
+    }
+#endif
+    if (denoise.denoiser) {
+        ImGui::Checkbox("Denoise", &denoise.enabled);
+        ImGui::SliderInt("Denoise iterations", &denoise.denoiser->config.iterations, 1, 8);
+        ImGui::Text("Denoise time: %.1f ms", denoise.ms);
+    }
+    if (state.launch_params.cache.cells) {
+        RadianceCache::Params& cache = state.launch_params.cache;
+        ImGui::Text("Radiance cache: %u cells, %.2f cell size", cache.capacity, cache.cell_size);
+        bool changed = ImGui::Checkbox("Radiance cache", &cache.enabled);
+        changed |= ImGui::SliderInt("Cache depth", &cache.terminate_depth, 1, 2);
+        changed |= ImGui::SliderInt("Cache update stride", &cache.update_stride, 1, 64);
+        if (changed) {
+            state.launch_params.dirty = true;
+        }
+    }
     ImGui::EndChild();
+}
 
+void TraceHost::update_launch_params() {
     // Reflect host camera state
     vec3f camera_pos = state.camera.look_from;
     vec3f camera_d00 = normalize(state.camera.look_at - camera_pos);
@@ -632,24 +1499,120 @@ void TraceHost::update_launch_params() {
         camera_ddv
     };
     state.launch_params.set_camera(camera);
+    update_render_scale();
 
     // Increment frame count
     if (state.launch_params.dirty) {
         state.launch_params.frame.accum_frames= 1;
+        termination.start = prev_time;
+        termination.error = -1.f;
+        termination.converged = false;
     }
     else {
         state.launch_params.frame.accum_frames++;
     }
     state.launch_params.frame.id++;
 
+    // Camera changes keep the history that survives reprojection
+    LaunchParams::Reprojection& reproject = state.launch_params.reproject;
+    if (reproject.enabled) {
+        std::swap(reproject.positions, reproject.prev_positions);
+    }
+    reproject.active = reproject.enabled && state.launch_params.dirty && state.launch_params.frame.id > 1;
+
+    // Resets without surviving history restart the interleaved preview passes
+    LaunchParams::Frame::Interleave& interleave = state.launch_params.frame.interleave;
+    if (progressive.enabled && !reproject.enabled && state.launch_params.dirty) {
+        interleave.pass = 1;
+        progressive.start = prev_time;
+    }
+    else if (interleave.pass > 0) {
+        interleave.pass = (interleave.pass + 1) % 8;
+    }
+    if (interleave.pass > 0) {
+        // Every pixel is rendered once over the seven passes
+        const Adam7Pass& pass = ADAM7_PASSES[interleave.pass - 1];
+        interleave.origin = vec2i(pass.origin_x, pass.origin_y);
+        interleave.step = vec2i(pass.step_x, pass.step_y);
+        state.launch_params.frame.accum_frames = 1;
+    }
+    else {
+        interleave.origin = vec2i(0);
+        interleave.step = vec2i(1);
+    }
+
     // Upload launch params
     owlBufferUpload(state.launch_params_buffer, &state.launch_params, 0);
     state.launch_params.dirty = false;
 }
 
+/**
+ * Pick the internal resolution from the measured frame time.
+ * While the camera moves the scale tracks the target frame time, pixel cost is assumed to be constant
+ * so time scales with scale^2. As soon as the camera stops the scale snaps back to native and
+ * accumulation restarts there.
+ */
+void TraceHost::update_render_scale() {
+    LaunchParams::Frame& frame = state.launch_params.frame;
+    frame.prev_size = frame.size;
+
+    float scale = 1.f;
+    if (dynamic_res.enabled && state.launch_params.dirty) {
+        const float frame_ms = std::chrono::duration<float, std::milli>(approx_delta).count();
+        const float ideal = dynamic_res.scale * std::sqrt(dynamic_res.target_ms / std::max(frame_ms, 0.1f));
+        // Damp the response and snap to 1/16 steps so the resolution does not flicker
+        scale = 0.5f * (dynamic_res.scale + ideal);
+        scale = std::round(scale * 16.f) / 16.f;
+        scale = std::clamp(scale, dynamic_res.min_scale, 1.f);
+    }
+    dynamic_res.scale = scale;
+
+    frame.size = vec2i(
+        std::max(1, static_cast<int>(config.width * scale)),
+        std::max(1, static_cast<int>(config.height * scale))
+    );
+    if (frame.size != frame.prev_size) {
+        state.launch_params.dirty = true;
+    }
+}
+
 void TraceHost::launch() {
-    owlRayGenLaunch2D(owl.ray_gen, config.width, config.height);
+    const LaunchParams::Reprojection& reproject = state.launch_params.reproject;
+    const vec2i size = state.launch_params.frame.size;
+    if (reproject.active) {
+        // Resolve writes the PBO, so history is read from a copy
+        cudaMemcpy(reproject.history, state.pbo_ptr, config.width * config.height * sizeof(vec4f), cudaMemcpyDeviceToDevice);
+    }
+
+    const LaunchParams::Frame::Interleave& interleave = state.launch_params.frame.interleave;
+    if (interleave.pass == 1) {
+        // Passes accumulate, so pixels not rendered yet must read as empty
+        cudaMemset(state.pbo_ptr, 0, config.width * config.height * sizeof(vec4f));
+    }
+    if (state.launch_params.aov.albedo && interleave.pass == 1) {
+        cudaMemset(state.launch_params.aov.albedo, 0, config.width * config.height * sizeof(vec4f));
+        cudaMemset(state.launch_params.aov.normal, 0, config.width * config.height * sizeof(vec4f));
+    }
+    if (state.launch_params.half_buffer && (interleave.pass == 1 || reproject.active)) {
+        // Reprojected history has no matching half, the estimate restarts from fresh frames
+        cudaMemset(state.launch_params.half_buffer, 0, config.width * config.height * sizeof(vec4f));
+    }
+
+    const vec2i launch_size = (size - interleave.origin + interleave.step - vec2i(1)) / interleave.step;
+    owlRayGenLaunch2D(owl.ray_gen, launch_size.x, launch_size.y);
+    if (reproject.active) {
+        owlRayGenLaunch2D(owl.resolve, size.x, size.y);
+    }
     cudaDeviceSynchronize();
+
+    unsigned long long num_rays = 0;
+    cudaMemcpy(&num_rays, state.launch_params.ray_count, sizeof(unsigned long long), cudaMemcpyDeviceToHost);
+    cudaMemset(state.launch_params.ray_count, 0, sizeof(unsigned long long));
+    rays_per_frame = static_cast<double>(num_rays);
+
+    if (state.launch_params.guide.training) {
+        train_guide();
+    }
 }
 
 void TraceHost::gl_draw() {
@@ -659,25 +1622,76 @@ void TraceHost::gl_draw() {
     approx_delta = delta;
     prev_time = current_time;
 
-    update_launch_params();
+    draw_ui();
 
+    // Converged images are only redrawn until something resets accumulation
     gl.shader->use();
-    launch();
+    bool launched = false;
+    update_streaming();
+    update_lods();
+    if (!termination.converged || state.launch_params.dirty) {
+        update_launch_params();
+        launch();
+        check_termination();
+        launched = true;
+    }
     gl.shader->set_float("num_samples", static_cast<float>(state.launch_params.frame.accum_frames));
+    gl.shader->set_float("max_samples", static_cast<float>(std::max(state.launch_params.frame.accum_frames, state.launch_params.reproject.max_history + 1)));
+    gl.shader->set_int("display_mode", show_sample_count ? 1 : 0);
+
+    const vec2i size = state.launch_params.frame.size;
+    gl.shader->set_vec2("uv_scale", static_cast<float>(size.x) / config.width, static_cast<float>(size.y) / config.height);
+    gl.shader->set_vec2("uv_max", (size.x - 0.5f) / config.width, (size.y - 0.5f) / config.height);
+
+    // Denoised frames and cost views come from host memory, everything else straight from the PBO.
+    // Interleaved preview passes skip the denoiser, it would keep their holes black and cost a readback each.
+    const vec4f* host_pixels = nullptr;
+    const bool show_denoised = denoise.enabled && !show_sample_count && state.launch_params.frame.interleave.pass == 0;
+    if (show_denoised) {
+        if (launched || denoise.result.size() != static_cast<size_t>(size.x) * size.y) {
+            denoise_frame();
+        }
+        host_pixels = denoise.result.data();
+    }
+#ifdef COST_COUNTERS
+    if (cost_view.channel > 0) {
+        // Counters go in w so the sample count heat ramp displays them
+        read_cost(cost_view.channel);
+        host_pixels = cost_view.pixels.data();
+        gl.shader->set_float("max_samples", cost_view.max_value);
+        gl.shader->set_int("display_mode", 1);
+    }
+#endif
 
     // 1. Bind the texture
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, gl.disp_tex);
-    // 2. Bind the PBO
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl.pbo);
-    // 3. Update the texture with PBO
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,  config.width, config.height, GL_RGBA, GL_FLOAT, nullptr);
+    if (host_pixels) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,  size.x, size.y, GL_RGBA, GL_FLOAT, host_pixels);
+    }
+    else {
+        // 2. Bind the PBO
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl.pbo);
+        // 3. Update the texture with PBO
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,  size.x, size.y, GL_RGBA, GL_FLOAT, nullptr);
+    }
 
     // 4. Draw the screen quad
     glBindVertexArray(gl.vao);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.ebo);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+    if (state.launch_params.frame.interleave.pass == 1) {
+        glFinish();
+        auto preview_time = std::chrono::high_resolution_clock::now();
+        progressive.first_preview_ms = std::chrono::duration<double, std::milli>(preview_time - progressive.start).count();
+        if (!progressive.reported) {
+            spdlog::info("Progressive: first preview of {} after {:.1f} ms",
+                         config.model.value_or("default scene"), progressive.first_preview_ms);
+            progressive.reported = true;
+        }
+    }
+
     // 5. Cleanup
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
@@ -687,3 +1701,187 @@ void TraceHost::gl_draw() {
     ImGui::End();
 
 }
+
+/**
+ * Stop accumulating once the first configured render target is reached.
+ * The error target is only evaluated every check_interval frames, and never during interleaved passes
+ * where most pixels hold a single frame.
+ */
+void TraceHost::check_termination() {
+    if (config.max_time_s <= 0.f && config.max_spp <= 0 && config.target_error <= 0.f) return;
+
+    const LaunchParams::Frame& frame = state.launch_params.frame;
+    const int spp = frame.accum_frames * SAMPLES_PER_PIXEL;
+    const float elapsed = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - termination.start).count();
+
+    std::string reason;
+    if (config.max_spp > 0 && spp >= config.max_spp) {
+        reason = fmt::format("{} spp", spp);
+    }
+    else if (config.max_time_s > 0.f && elapsed >= config.max_time_s) {
+        reason = fmt::format("{:.1f} s", elapsed);
+    }
+    else if (state.launch_params.half_buffer && frame.interleave.pass == 0 && frame.accum_frames % termination.check_interval == 0) {
+        termination.error = estimate_error();
+        if (termination.error <= config.target_error) {
+            reason = fmt::format("error {:.4f}", termination.error);
+        }
+    }
+    if (reason.empty()) return;
+
+    termination.converged = true;
+    spdlog::info("Termination: Converged after {} ({} spp, {:.1f} s)", reason, spp, elapsed);
+    if (config.output) {
+        write_output();
+        termination.finished = true;
+    }
+}
+
+/**
+ * Mean relative difference between the half buffer and the frames that did not go into it.
+ * Both halves are independent estimates of the same pixel, so their difference relative to their sum
+ * tracks the relative error of the full accumulation.
+ */
+float TraceHost::estimate_error() {
+    const vec2i size = state.launch_params.frame.size;
+    const size_t num_pixels = static_cast<size_t>(size.x) * size.y;
+    termination.full.resize(num_pixels);
+    termination.half.resize(num_pixels);
+    cudaMemcpy(termination.full.data(), state.pbo_ptr, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+    cudaMemcpy(termination.half.data(), state.launch_params.half_buffer, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+
+    auto luminance = [](const vec4f& c) {
+        return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    };
+    using Sum = std::pair<double, size_t>;
+    const Sum sum = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, num_pixels), Sum(0.0, 0),
+        [&](const tbb::blocked_range<size_t>& r, Sum acc) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                const vec4f& full = termination.full[i];
+                const vec4f& half = termination.half[i];
+                const float rest_frames = full.w - half.w;
+                if (half.w <= 0.f || rest_frames <= 0.f) continue;
+
+                const float a = luminance(half) / half.w;
+                const float b = luminance(full - half) / rest_frames;
+                acc.first += std::abs(a - b) / (a + b + 1e-3f);
+                acc.second++;
+            }
+            return acc;
+        },
+        [](const Sum& a, const Sum& b) {
+            return Sum(a.first + b.first, a.second + b.second);
+        }
+    );
+    return sum.second > 0 ? static_cast<float>(sum.first / sum.second) : 1.f;
+}
+
+/**
+ * Write the accumulated image, and next to it the denoised one when the denoiser is enabled.
+ * The noisy image keeps the requested name with a _noisy suffix so both can be compared.
+ */
+void TraceHost::write_output() {
+    const vec2i size = state.launch_params.frame.size;
+    const size_t num_pixels = static_cast<size_t>(size.x) * size.y;
+    termination.full.resize(num_pixels);
+    cudaMemcpy(termination.full.data(), state.pbo_ptr, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+
+    std::vector<vec3f> pixels(num_pixels);
+    for (size_t i = 0; i < num_pixels; i++) {
+        const vec4f& c = termination.full[i];
+        pixels[i] = vec3f(c.x, c.y, c.z) / std::max(c.w, 1.f);
+    }
+
+    const std::string& path = config.output.value();
+    const size_t dot = std::min(path.find_last_of('.'), path.size());
+#ifdef COST_COUNTERS
+    write_cost_images(path.substr(0, dot));
+#endif
+    if (!denoise.enabled) {
+        ImageWriter::write(path, pixels, size.x, size.y);
+        return;
+    }
+
+    ImageWriter::write(path.substr(0, dot) + "_noisy" + path.substr(dot), pixels, size.x, size.y);
+
+    denoise_frame();
+    spdlog::info("Denoiser: Filtered {}x{} at {} spp in {:.1f} ms", size.x, size.y,
+                 state.launch_params.frame.accum_frames * SAMPLES_PER_PIXEL, denoise.ms);
+    for (size_t i = 0; i < num_pixels; i++) {
+        pixels[i] = vec3f(denoise.result[i].x, denoise.result[i].y, denoise.result[i].z);
+    }
+    ImageWriter::write(path, pixels, size.x, size.y);
+}
+
+/**
+ * Read back the frame and its AOVs and run the denoiser on the host.
+ * NOTE: The reported time includes the readback.
+ */
+void TraceHost::denoise_frame() {
+    const vec2i size = state.launch_params.frame.size;
+    const size_t num_pixels = static_cast<size_t>(size.x) * size.y;
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    for (std::vector<vec4f>* buffer : { &denoise.color, &denoise.albedo, &denoise.normal, &denoise.result }) {
+        buffer->resize(num_pixels);
+    }
+    cudaMemcpy(denoise.color.data(), state.pbo_ptr, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+    cudaMemcpy(denoise.albedo.data(), state.launch_params.aov.albedo, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+    cudaMemcpy(denoise.normal.data(), state.launch_params.aov.normal, num_pixels * sizeof(vec4f), cudaMemcpyDeviceToHost);
+    denoise.denoiser->denoise(denoise.color, denoise.albedo, denoise.normal, size, denoise.result);
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    denoise.ms = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+#ifdef COST_COUNTERS
+namespace {
+    // Same ramp as the display shader
+    vec3f heat(float t) {
+        t = std::clamp(t, 0.f, 1.f);
+        return vec3f(
+            std::clamp(1.5f - std::abs(4.f * t - 3.f), 0.f, 1.f),
+            std::clamp(1.5f - std::abs(4.f * t - 2.f), 0.f, 1.f),
+            std::clamp(1.5f - std::abs(4.f * t - 1.f), 0.f, 1.f)
+        );
+    }
+}
+
+/**
+ * Read back the cost counters of the last frame and unpack one of them into cost_view.pixels.
+ */
+void TraceHost::read_cost(int channel) {
+    const vec2i size = state.launch_params.frame.size;
+    const size_t num_pixels = static_cast<size_t>(size.x) * size.y;
+    cost_view.counters.resize(num_pixels);
+    cost_view.pixels.resize(num_pixels);
+    cudaMemcpy(cost_view.counters.data(), state.launch_params.cost, num_pixels * sizeof(vec4ui), cudaMemcpyDeviceToHost);
+
+    unsigned int max_value = 1;
+    for (size_t i = 0; i < num_pixels; i++) {
+        const unsigned int value = cost_view.counters[i][channel - 1];
+        cost_view.pixels[i] = vec4f(0.f, 0.f, 0.f, static_cast<float>(value));
+        max_value = std::max(max_value, value);
+    }
+    cost_view.max_value = static_cast<float>(max_value);
+}
+
+/**
+ * Write one false-color image per counter, scaled like the viewer's cost view.
+ */
+void TraceHost::write_cost_images(const std::string& stem) {
+    const vec2i size = state.launch_params.frame.size;
+    const char* names[] = { "rays", "bounces", "prim_tests", "shadow_rays" };
+    std::vector<vec3f> pixels(static_cast<size_t>(size.x) * size.y);
+    for (int channel = 1; channel <= 4; channel++) {
+        read_cost(channel);
+        const float scale = 1.f / std::log2(1.f + cost_view.max_value);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            pixels[i] = heat(std::log2(1.f + cost_view.pixels[i].w) * scale);
+        }
+        spdlog::info("Cost: max {} per pixel {:.0f}", names[channel - 1], cost_view.max_value);
+        ImageWriter::write(fmt::format("{}_cost_{}.png", stem, names[channel - 1]), pixels, size.x, size.y);
+    }
+}
+#endif
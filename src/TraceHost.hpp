@@ -8,6 +8,7 @@
 #define TRACEHOST_HPP
 
 #include <chrono>
+#include <memory>
 #include <owl/owl.h>
 #include <optional>
 #include <random>
@@ -15,6 +16,15 @@
 
 #include "shaders/Trace.cuh"
 #include "Shader.hpp"
+#include "guiding/SDTree.hpp"
+#include "mesh/ClusterBvh.hpp"
+#include "mesh/ClusterCache.hpp"
+#include "mesh/ClusterFile.hpp"
+#include "mesh/HostMesh.hpp"
+#include "loaders/ImageLoader.hpp"
+#include "loaders/TexturePool.hpp"
+#include "materials/MeshMaterial.hpp"
+#include "post/Denoiser.hpp"
 
 std::optional<std::vector<char>> load_ptx_shader(const char* file_path);
 
@@ -31,19 +41,60 @@ inline vec3f rnd3f() {
 class TraceHost {
 private:
     struct EnvMapDevice {
-        OWLTexture env_map;
+        ImageLoader::DeviceTexture env_map;
         void* dev_alias_pdf_ptr;
         void* dev_alias_i_ptr;
         void* dev_pdf_ptr;
         std::pair<uint32_t, uint32_t> size;
     };
 public:
+    struct Model {
+        std::string path;
+        // Placement of the whole model in the scene
+        affine3f transform;
+    };
+
     struct Config {
         const char* ptx_source;
         std::optional<std::string> model;
+        // Loaded concurrently next to model
+        std::vector<Model> models;
+        // Shape indices or names to load from OBJ models, all when empty
+        std::vector<std::string> shapes;
+        // Used when the model has no normals, 180 smooths across every edge
+        float crease_angle = 180.f;
+        bool optimize_mesh = false;
+        // Compact shading buffers, the BVH is still built from full precision input
+        bool compress_mesh = false;
+        // Simplified levels per mesh, instances pick the coarsest one within lod_pixel_error
+        bool lod = false;
+        float lod_pixel_error = 1.f;
+        // Device memory for resident clusters when the model is a .clusters file
+        size_t stream_budget_mb = 1024;
         std::optional<std::string> env_map;
+        // Storage of the environment map on the device, RGBA32F keeps the decoded floats
+        Trace::TexelFormat env_format = Trace::TexelFormat::RGBA32F;
         const int width;
         const int height;
+        bool path_guiding = false;
+        // Training iteration k renders 2^k frames before the guide is refined
+        int guiding_iterations = 6;
+        bool radiance_cache = false;
+        float cache_cell_size = 0.25f;
+        // Cache holds 2^cache_capacity_log2 cells
+        int cache_capacity_log2 = 20;
+        bool reprojection = false;
+        bool gbuffer_cache = false;
+        // Frame time the internal resolution is scaled to hold during camera motion, 0 disables
+        float target_frame_ms = 0.f;
+        bool progressive = false;
+        // Render targets, the first one reached ends accumulation. 0 disables a target
+        float max_time_s = 0.f;
+        int max_spp = 0;
+        float target_error = 0.f;
+        // Written once a target is reached, the renderer then exits
+        std::optional<std::string> output;
+        bool denoise = false;
     };
 
     enum CameraActions {
@@ -67,7 +118,17 @@ public:
     void init();
 
     OWLGroup build_scene();
+    OWLGroup build_mesh_group(std::vector<HostMesh>& meshes);
+    OWLGroup build_models_world(const std::vector<Model>& models);
+    OWLGroup init_streaming();
     EnvMapDevice build_env_map();
+    void init_guiding();
+    void init_radiance_cache();
+    void init_reprojection();
+    void init_gbuffer();
+    void init_termination();
+    void init_denoiser();
+    void init_cost_counters();
 
     void resize_window(int width, int height);
     void increment_camera(CameraActions action, float delta);
@@ -75,7 +136,47 @@ public:
     std::pair<int, int> get_size();
     void gl_draw();
     void launch();
+    bool finished() const { return termination.finished; }
 private:
+    /* Host side geometry of one model file */
+    struct HostModel {
+        struct Instance {
+            uint32_t mesh;
+            affine3f transform;
+        };
+        struct Mesh {
+            // Primitives of every level, full resolution first
+            std::vector<std::vector<HostMesh>> levels;
+            // Object space error of every level
+            std::vector<float> errors;
+            box3f bounds;
+        };
+        // One BLAS per mesh, empty ones are skipped
+        std::vector<Mesh> meshes;
+        std::vector<Instance> instances;
+        // Indexed by the material ids of the meshes, texture indices are into the shared pool
+        std::vector<Material::MeshMaterial> materials;
+    };
+
+    HostModel load_model(const std::string& path, TexturePool& textures) const;
+    void build_lod_levels(HostModel& model, const std::string& path) const;
+    void update_lods();
+    void draw_ui();
+    void upload_guide();
+    void train_guide();
+    void update_render_scale();
+    void update_streaming();
+    void apply_stream_update(const ClusterCache::Update& update);
+    bool build_stream_world();
+    void check_termination();
+    float estimate_error();
+    void write_output();
+    void denoise_frame();
+#ifdef COST_COUNTERS
+    void read_cost(int channel);
+    void write_cost_images(const std::string& stem);
+#endif
+
     bool initialized = false;
     /* Initial configuration */
     Config config;
@@ -99,12 +200,16 @@ private:
         OWLContext ctx;
         OWLModule module;
         OWLRayGen ray_gen;
+        OWLRayGen resolve;
         OWLMissProg miss_prog;
         OWLLaunchParams launch_params;
         struct {
             OWLGeomType lambertian_sphere;
             OWLGeomType tri_mesh;
         } geom_type;
+        // Scene wide tables every triangle mesh indexes into
+        OWLBuffer materials;
+        OWLBuffer textures;
     } owl;
     /* State of the pathtracer */
     struct RenderState {
@@ -116,12 +221,104 @@ private:
             float cos_fov_y;
         } camera;
         float aspect;
+        box3f scene_bounds;
 
         /* Device definitions */
         OWLBuffer launch_params_buffer;
         LaunchParams launch_params;
         cudaGraphicsResource* cuda_pbo;
+        vec4f* pbo_ptr;
     } state;
+    /* Path guiding training state */
+    struct GuideState {
+        std::unique_ptr<SDTree> tree;
+        std::vector<Guiding::Sample> host_samples;
+        int iteration = 0;
+        int frames_in_iteration = 0;
+        double training_ms = 0.0;
+    } guide;
+    /* Internal resolution controller */
+    struct DynamicResolution {
+        bool enabled = false;
+        float target_ms = 33.3f;
+        float min_scale = 0.25f;
+        float scale = 1.f;
+    } dynamic_res;
+    /* Progressive interleaved preview */
+    struct Progressive {
+        bool enabled = false;
+        bool reported = false;
+        std::chrono::high_resolution_clock::time_point start;
+        double first_preview_ms = 0.0;
+    } progressive;
+    /* Render targets */
+    struct Termination {
+        // Frames between error estimates, each one reads back two full buffers
+        int check_interval = 16;
+        std::chrono::high_resolution_clock::time_point start;
+        float error = -1.f;
+        bool converged = false;
+        bool finished = false;
+        std::vector<vec4f> full;
+        std::vector<vec4f> half;
+    } termination;
+    /* Denoiser and its host copies of the frame */
+    struct DenoiseState {
+        std::unique_ptr<Denoiser> denoiser;
+        bool enabled = false;
+        std::vector<vec4f> color;
+        std::vector<vec4f> albedo;
+        std::vector<vec4f> normal;
+        std::vector<vec4f> result;
+        double ms = 0.0;
+    } denoise;
+    /* Levels of detail, every instance of the world picks one from its distance to the camera */
+    struct LodState {
+        struct Mesh {
+            // Group of every level, full resolution first
+            std::vector<OWLGroup> groups;
+            std::vector<float> errors;
+            std::vector<size_t> triangles;
+        };
+        struct Instance {
+            uint32_t mesh;
+            box3f bounds;
+            // Largest axis scale of the instance transform
+            float scale;
+            uint32_t level = 0;
+        };
+        std::vector<Mesh> meshes;
+        std::vector<Instance> instances;
+        OWLGroup world = nullptr;
+        float pixel_error = 1.f;
+        size_t full_triangles = 0;
+        size_t traced_triangles = 0;
+        size_t full_bytes = 0;
+        size_t lod_bytes = 0;
+    } lod;
+    /* Clusters paged in from a .clusters model, the instance group only holds the resident ones */
+    struct StreamState {
+        ClusterFile file;
+        ClusterBvh bvh;
+        std::unique_ptr<ClusterCache> cache;
+        // Triangle group of every resident cluster, null otherwise
+        std::vector<OWLGroup> groups;
+        OWLGroup world = nullptr;
+        size_t visible = 0;
+    } stream;
+#ifdef COST_COUNTERS
+    /* Per-pixel cost diagnostics, channel 0 shows the image and 1-4 pick a counter */
+    struct CostView {
+        int channel = 0;
+        std::vector<vec4ui> counters;
+        std::vector<vec4f> pixels;
+        float max_value = 1.f;
+    } cost_view;
+#endif
+    /* Environment texture and alias table, released on destruction */
+    EnvMapDevice env_device = {};
+    bool show_sample_count = false;
+    double rays_per_frame = 0.0;
     std::chrono::high_resolution_clock::time_point prev_time;
     std::chrono::duration<long, std::ratio<1, 1000000000>> approx_delta;
 };
@@ -0,0 +1,193 @@
+/**
+* @file SDTree.cpp
+* @brief Implementation of the spatial-directional guiding tree.
+*/
+
+#include "SDTree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+namespace {
+    Guiding::DirNode empty_dir_node() {
+        return { { 0.f, 0.f, 0.f, 0.f }, { -1, -1, -1, -1 } };
+    }
+}
+
+SDTree::SDTree(const Config& config, const box3f& bounds)
+    : config(config) {
+    // Pad the bounds slightly so that samples on the boundary stay inside
+    box3f padded = bounds;
+    const vec3f pad = 1e-3f * (bounds.upper - bounds.lower) + vec3f(1e-4f);
+    padded.lower -= pad;
+    padded.upper += pad;
+
+    Node root;
+    root.bounds = padded;
+    root.dtree = 0;
+    nodes.push_back(root);
+
+    DTree dtree;
+    dtree.sampling.push_back(empty_dir_node());
+    dtree.building.push_back(empty_dir_node());
+    dtrees.push_back(std::move(dtree));
+
+    flatten();
+}
+
+int SDTree::leaf_of(const vec3f& P) const {
+    int node = 0;
+    while (nodes[node].axis >= 0) {
+        const Node& n = nodes[node];
+        const float split = 0.5f * (n.bounds.lower[n.axis] + n.bounds.upper[n.axis]);
+        node = n.children[P[n.axis] >= split ? 1 : 0];
+    }
+    return node;
+}
+
+void SDTree::record(std::span<const Guiding::Sample> samples) {
+    if (samples.empty()) return;
+
+    // Bucket samples by quadtree so that every quadtree is written by a single task
+    std::vector<std::pair<uint32_t, uint32_t>> keys(samples.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, samples.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            keys[i] = { static_cast<uint32_t>(nodes[leaf_of(samples[i].position)].dtree), static_cast<uint32_t>(i) };
+        }
+    });
+    tbb::parallel_sort(keys.begin(), keys.end());
+
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (i == 0 || keys[i].first != keys[i - 1].first) {
+            starts.push_back(i);
+        }
+    }
+    starts.push_back(keys.size());
+
+    tbb::parallel_for(size_t(0), starts.size() - 1, [&](size_t range) {
+        DTree& dtree = dtrees[keys[starts[range]].first];
+        for (size_t k = starts[range]; k < starts[range + 1]; k++) {
+            const Guiding::Sample& sample = samples[keys[k].second];
+            vec2f p = Guiding::dir_to_square(sample.direction);
+            int node = 0;
+            while (node >= 0) {
+                const int q = Guiding::quadrant(p);
+                dtree.building[node].sum[q] += sample.radiance;
+                node = dtree.building[node].children[q];
+            }
+        }
+        dtree.num_samples += starts[range + 1] - starts[range];
+    });
+}
+
+void SDTree::refine_dir(const std::vector<Guiding::DirNode>& src, int src_idx, const float sums[4],
+                        float total, int depth, std::vector<Guiding::DirNode>& dst, int dst_idx) const {
+    for (int q = 0; q < 4; q++) {
+        if (total <= 0.f || sums[q] / total <= config.energy_threshold || depth >= config.max_dir_depth) {
+            continue;
+        }
+
+        // Existing children keep their distribution, new children start out uniform
+        const int src_child = src_idx >= 0 ? src[src_idx].children[q] : -1;
+        float child_sums[4];
+        for (int c = 0; c < 4; c++) {
+            child_sums[c] = src_child >= 0 ? src[src_child].sum[c] : 0.25f * sums[q];
+        }
+
+        const int child = static_cast<int>(dst.size());
+        dst.push_back(empty_dir_node());
+        dst[dst_idx].children[q] = child;
+        refine_dir(src, src_child, child_sums, total, depth + 1, dst, child);
+    }
+}
+
+void SDTree::refine(int iteration) {
+    // Split spatial leaves that saw enough samples, children inherit the parent's estimates
+    const uint64_t threshold = static_cast<uint64_t>(config.spatial_threshold * std::sqrt(std::pow(2.f, iteration)));
+    const size_t num_nodes = nodes.size();
+    for (size_t i = 0; i < num_nodes; i++) {
+        if (nodes[i].axis >= 0 || nodes[i].depth >= config.max_spatial_depth) continue;
+        if (dtrees[nodes[i].dtree].num_samples <= threshold) continue;
+
+        const int axis = nodes[i].depth % 3;
+        const float split = 0.5f * (nodes[i].bounds.lower[axis] + nodes[i].bounds.upper[axis]);
+        for (int c = 0; c < 2; c++) {
+            Node child;
+            child.bounds = nodes[i].bounds;
+            if (c == 0) child.bounds.upper[axis] = split;
+            else child.bounds.lower[axis] = split;
+            child.depth = nodes[i].depth + 1;
+
+            DTree& parent = dtrees[nodes[i].dtree];
+            if (c == 0) {
+                child.dtree = nodes[i].dtree;
+                parent.num_samples /= 2;
+            }
+            else {
+                child.dtree = static_cast<int>(dtrees.size());
+                DTree copy = parent;
+                dtrees.push_back(std::move(copy));
+            }
+            nodes[i].children[c] = static_cast<int>(nodes.size());
+            nodes.push_back(child);
+        }
+        nodes[i].axis = axis;
+        nodes[i].dtree = -1;
+    }
+
+    // Promote estimates to the sampling distribution and refine the next building trees
+    tbb::parallel_for(size_t(0), dtrees.size(), [&](size_t i) {
+        DTree& dtree = dtrees[i];
+        const Guiding::DirNode& root = dtree.building[0];
+        const float total = root.sum[0] + root.sum[1] + root.sum[2] + root.sum[3];
+
+        std::vector<Guiding::DirNode> refined;
+        refined.push_back(empty_dir_node());
+        refine_dir(dtree.building, 0, root.sum, total, 1, refined, 0);
+
+        dtree.sampling = std::move(dtree.building);
+        dtree.building = std::move(refined);
+        dtree.num_samples = 0;
+    });
+
+    flatten();
+    spdlog::info("SDTree: Iteration {} refined into {} spatial leaves, {} directional nodes",
+                 iteration, dtrees.size(), flat_dir.size());
+}
+
+void SDTree::flatten() {
+    std::vector<int> dir_offsets(dtrees.size());
+    size_t num_dir = 0;
+    for (size_t i = 0; i < dtrees.size(); i++) {
+        dir_offsets[i] = static_cast<int>(num_dir);
+        num_dir += dtrees[i].sampling.size();
+    }
+
+    flat_dir.resize(num_dir);
+    tbb::parallel_for(size_t(0), dtrees.size(), [&](size_t i) {
+        const int offset = dir_offsets[i];
+        for (size_t n = 0; n < dtrees[i].sampling.size(); n++) {
+            Guiding::DirNode node = dtrees[i].sampling[n];
+            for (int& child : node.children) {
+                if (child >= 0) child += offset;
+            }
+            flat_dir[offset + n] = node;
+        }
+    });
+
+    flat_spatial.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node& n = nodes[i];
+        if (n.axis >= 0) {
+            const float split = 0.5f * (n.bounds.lower[n.axis] + n.bounds.upper[n.axis]);
+            flat_spatial[i] = { n.axis, split, { n.children[0], n.children[1] } };
+        }
+        else {
+            flat_spatial[i] = { -1, 0.f, { dir_offsets[n.dtree], -1 } };
+        }
+    }
+}
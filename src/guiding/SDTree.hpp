@@ -0,0 +1,73 @@
+/**
+* @file SDTree.hpp
+* @brief Host-side spatial-directional tree trained from device radiance samples.
+*/
+
+#pragma once
+
+#ifndef SDTREE_HPP
+#define SDTREE_HPP
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "trace/Guiding.hpp"
+
+class SDTree {
+public:
+    struct Config {
+        // Spatial leaves split once they collect more than c * sqrt(2^iteration) samples
+        uint32_t spatial_threshold = 12000;
+        // Quadrants holding more than this fraction of a quadtree's energy are subdivided
+        float energy_threshold = 0.01f;
+        int max_dir_depth = 20;
+        int max_spatial_depth = 48;
+    };
+
+    SDTree(const Config& config, const box3f& bounds);
+
+    /**
+     * @brief Splats samples into the building quadtrees of their spatial leaves.
+     */
+    void record(std::span<const Guiding::Sample> samples);
+
+    /**
+     * @brief Ends a training iteration.
+     * The estimates gathered so far become the sampling distribution, the spatial tree is split
+     * where enough samples landed, and the building quadtrees are refined by energy and cleared.
+     */
+    void refine(int iteration);
+
+    const std::vector<Guiding::SpatialNode>& spatial_nodes() const { return flat_spatial; }
+    const std::vector<Guiding::DirNode>& dir_nodes() const { return flat_dir; }
+    size_t num_leaves() const { return dtrees.size(); }
+private:
+    struct Node {
+        box3f bounds;
+        int axis = -1;
+        int children[2] = { -1, -1 };
+        int dtree = -1;
+        int depth = 0;
+    };
+
+    struct DTree {
+        std::vector<Guiding::DirNode> sampling;
+        std::vector<Guiding::DirNode> building;
+        uint64_t num_samples = 0;
+    };
+
+    Config config;
+    std::vector<Node> nodes;
+    std::vector<DTree> dtrees;
+
+    std::vector<Guiding::SpatialNode> flat_spatial;
+    std::vector<Guiding::DirNode> flat_dir;
+
+    int leaf_of(const vec3f& P) const;
+    void refine_dir(const std::vector<Guiding::DirNode>& src, int src_idx, const float sums[4],
+                    float total, int depth, std::vector<Guiding::DirNode>& dst, int dst_idx) const;
+    void flatten();
+};
+
+#endif //SDTREE_HPP
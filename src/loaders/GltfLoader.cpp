@@ -0,0 +1,285 @@
+/**
+* @file GltfLoader.cpp
+* @brief Implementation of the GltfLoader class for loading binary glTF files.
+*/
+
+#define CGLTF_IMPLEMENTATION
+#include "cgltf.h"
+
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "GltfLoader.hpp"
+#include "mesh/NormalGenerator.hpp"
+
+namespace {
+    const std::byte* accessor_data(const cgltf_accessor* accessor) {
+        if (!accessor->buffer_view || !accessor->buffer_view->buffer->data) return nullptr;
+        return static_cast<const std::byte*>(accessor->buffer_view->buffer->data)
+            + accessor->buffer_view->offset + accessor->offset;
+    }
+
+    // In place view when the accessor is tightly packed T, empty otherwise
+    template<typename T>
+    std::span<const T> view_accessor(const cgltf_accessor* accessor, cgltf_component_type component, cgltf_type type,
+                                     size_t elements_per_value = 1) {
+        const std::byte* data = accessor_data(accessor);
+        if (!data || accessor->is_sparse || accessor->normalized || accessor->component_type != component
+            || accessor->type != type || accessor->count % elements_per_value != 0
+            || accessor->stride * elements_per_value != sizeof(T)
+            || reinterpret_cast<uintptr_t>(data) % alignof(T) != 0) {
+            return {};
+        }
+        return { reinterpret_cast<const T*>(data), accessor->count / elements_per_value };
+    }
+
+    template<typename T>
+    std::span<const T> read_floats(const cgltf_accessor* accessor, cgltf_type type, std::vector<T>& storage) {
+        std::span<const T> view = view_accessor<T>(accessor, cgltf_component_type_r_32f, type);
+        if (!view.empty() || accessor->count == 0) return view;
+
+        storage.resize(accessor->count);
+        cgltf_accessor_unpack_floats(accessor, reinterpret_cast<float*>(storage.data()), storage.size() * sizeof(T) / sizeof(float));
+        return storage;
+    }
+
+    const cgltf_accessor* find_attribute(const cgltf_primitive& primitive, cgltf_attribute_type type) {
+        for (size_t i = 0; i < primitive.attributes_count; i++) {
+            const cgltf_attribute& attribute = primitive.attributes[i];
+            if (attribute.type == type && attribute.index == 0) return attribute.data;
+        }
+        return nullptr;
+    }
+
+    template<typename T>
+    int32_t index_of(const T* item, const T* first) {
+        return item ? static_cast<int32_t>(item - first) : -1;
+    }
+}
+
+GltfLoader::GltfLoader(const Config& config)
+    : config(config) {}
+
+GltfLoader::~GltfLoader() {
+    clear();
+}
+
+bool GltfLoader::handles(const std::string& file_path) {
+    const std::string ext = file_path.substr(file_path.find_last_of('.') + 1);
+    return ext == "glb" || ext == "gltf";
+}
+
+bool GltfLoader::load(const std::string& filename) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    clear();
+    spdlog::info("GltfLoader: Loading glTF file: {}", filename);
+
+    if (!file.open(filename)) {
+        spdlog::error("GltfLoader: Failed to map {}", filename);
+        return false;
+    }
+
+    // Buffer 0 of a .glb points into the mapping, external buffers are read into memory
+    const std::span<const std::byte> bytes = file.bytes();
+    cgltf_options options = {};
+    cgltf_result result = cgltf_parse(&options, bytes.data(), bytes.size(), &gltf);
+    if (result == cgltf_result_success) {
+        result = cgltf_load_buffers(&options, gltf, filename.c_str());
+    }
+    if (result == cgltf_result_success) {
+        result = cgltf_validate(gltf);
+    }
+    if (result != cgltf_result_success) {
+        spdlog::error("GltfLoader: Failed to load {} (error {})", filename, static_cast<int>(result));
+        clear();
+        return false;
+    }
+
+    read_materials();
+    read_meshes();
+    read_instances();
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("GltfLoader: Loaded {} meshes, {} instances, {} materials, {} textures in {:.2f} ms", meshes.size(),
+                 instances.size(), materials.size(), textures.size(),
+                 std::chrono::duration<double, std::milli>(end - start).count());
+    return true;
+}
+
+void GltfLoader::read_meshes() {
+    struct Job {
+        const cgltf_primitive* primitive;
+        Primitive* out;
+    };
+
+    // Storage is sized up front so views into it stay valid
+    std::vector<Job> jobs;
+    meshes.resize(gltf->meshes_count);
+    for (size_t m = 0; m < gltf->meshes_count; m++) {
+        const cgltf_mesh& mesh = gltf->meshes[m];
+        meshes[m].name = mesh.name ? mesh.name : "";
+        meshes[m].primitives.resize(mesh.primitives_count);
+        for (size_t p = 0; p < mesh.primitives_count; p++) {
+            jobs.push_back({ &mesh.primitives[p], &meshes[m].primitives[p] });
+        }
+    }
+    storage.resize(jobs.size());
+
+    std::atomic<size_t> skipped = 0;
+    std::atomic<size_t> in_place = 0;
+    tbb::parallel_for(size_t(0), jobs.size(), [&](size_t j) {
+        const cgltf_primitive& primitive = *jobs[j].primitive;
+        Primitive& out = *jobs[j].out;
+        Storage& store = storage[j];
+        const cgltf_accessor* positions = find_attribute(primitive, cgltf_attribute_type_position);
+        if (primitive.type != cgltf_primitive_type_triangles || !positions) {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        MeshCache::Views& views = out.views;
+        views.vertices = read_floats(positions, cgltf_type_vec3, store.positions);
+        if (const cgltf_accessor* normals = find_attribute(primitive, cgltf_attribute_type_normal)) {
+            views.normals = read_floats(normals, cgltf_type_vec3, store.normals);
+        }
+        if (const cgltf_accessor* texcoords = find_attribute(primitive, cgltf_attribute_type_texcoord)) {
+            views.texcoords = read_floats(texcoords, cgltf_type_vec2, store.texcoords);
+        }
+
+        if (primitive.indices) {
+            views.indices = view_accessor<vec3ui>(primitive.indices, cgltf_component_type_r_32u, cgltf_type_scalar, 3);
+            if (views.indices.empty()) {
+                const cgltf_accessor* indices = primitive.indices;
+                store.indices.resize(indices->count / 3);
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, store.indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+                    for (size_t t = r.begin(); t < r.end(); t++) {
+                        store.indices[t] = vec3ui(
+                            static_cast<uint32_t>(cgltf_accessor_read_index(indices, 3 * t + 0)),
+                            static_cast<uint32_t>(cgltf_accessor_read_index(indices, 3 * t + 1)),
+                            static_cast<uint32_t>(cgltf_accessor_read_index(indices, 3 * t + 2)));
+                    }
+                });
+                views.indices = store.indices;
+            }
+        }
+        else {
+            store.indices.resize(views.vertices.size() / 3);
+            for (size_t t = 0; t < store.indices.size(); t++) {
+                const uint32_t c = static_cast<uint32_t>(3 * t);
+                store.indices[t] = vec3ui(c, c + 1, c + 2);
+            }
+            views.indices = store.indices;
+        }
+        if (store.positions.empty() && store.indices.empty()) {
+            in_place.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (views.normals.empty() && config.generate_normals && !views.vertices.empty()) {
+            NormalGenerator::Result generated = NormalGenerator::generate(views.vertices, views.indices, config.crease_angle);
+            store.normals = std::move(generated.normals);
+            store.normal_indices = std::move(generated.normal_indices);
+            views.normals = store.normals;
+            views.normal_indices = store.normal_indices;
+        }
+        else {
+            views.normal_indices = views.normals.empty() ? std::span<const vec3ui>() : views.indices;
+        }
+        views.texcoord_indices = views.texcoords.empty() ? std::span<const vec3ui>() : views.indices;
+        out.material = primitive.material ? static_cast<uint32_t>(primitive.material - gltf->materials) : UINT32_MAX;
+    });
+
+    if (skipped > 0) {
+        spdlog::warn("GltfLoader: Skipped {} primitives that are not indexed triangles with positions", skipped.load());
+    }
+    spdlog::info("GltfLoader: {} of {} primitives viewed in place", in_place.load(), jobs.size());
+}
+
+void GltfLoader::read_instances() {
+    auto visit = [&](auto& self, const cgltf_node* node, const affine3f& parent) -> void {
+        float m[16];
+        cgltf_node_transform_local(node, m);
+        // Column major, the last row is always (0, 0, 0, 1)
+        const affine3f local(linear3f(vec3f(m[0], m[1], m[2]), vec3f(m[4], m[5], m[6]), vec3f(m[8], m[9], m[10])),
+                             vec3f(m[12], m[13], m[14]));
+        const affine3f transform = parent * local;
+        if (node->mesh) {
+            instances.push_back({ static_cast<uint32_t>(node->mesh - gltf->meshes), transform });
+        }
+        for (size_t c = 0; c < node->children_count; c++) {
+            self(self, node->children[c], transform);
+        }
+    };
+
+    // The default scene, or every root node when the file has none
+    const cgltf_scene* scene = gltf->scene ? gltf->scene : (gltf->scenes_count > 0 ? &gltf->scenes[0] : nullptr);
+    if (scene) {
+        for (size_t n = 0; n < scene->nodes_count; n++) {
+            visit(visit, scene->nodes[n], affine3f(one));
+        }
+    }
+    else {
+        for (size_t n = 0; n < gltf->nodes_count; n++) {
+            if (!gltf->nodes[n].parent) visit(visit, &gltf->nodes[n], affine3f(one));
+        }
+    }
+
+    // Files without nodes still show every mesh once
+    if (instances.empty()) {
+        for (size_t m = 0; m < meshes.size(); m++) {
+            instances.push_back({ static_cast<uint32_t>(m), affine3f(one) });
+        }
+    }
+}
+
+void GltfLoader::read_materials() {
+    textures.resize(gltf->textures_count);
+    for (size_t t = 0; t < gltf->textures_count; t++) {
+        const cgltf_image* image = gltf->textures[t].image;
+        if (!image) continue;
+        Texture& texture = textures[t];
+        texture.uri = image->uri ? image->uri : "";
+        texture.mime_type = image->mime_type ? image->mime_type : "";
+        if (image->buffer_view && image->buffer_view->buffer->data) {
+            texture.data = {
+                static_cast<const std::byte*>(image->buffer_view->buffer->data) + image->buffer_view->offset,
+                image->buffer_view->size
+            };
+        }
+    }
+
+    materials.resize(gltf->materials_count);
+    for (size_t i = 0; i < gltf->materials_count; i++) {
+        const cgltf_material& src = gltf->materials[i];
+        Material& material = materials[i];
+        material.name = src.name ? src.name : "";
+        if (src.has_pbr_metallic_roughness) {
+            const cgltf_pbr_metallic_roughness& pbr = src.pbr_metallic_roughness;
+            material.base_color = vec4f(pbr.base_color_factor[0], pbr.base_color_factor[1], pbr.base_color_factor[2], pbr.base_color_factor[3]);
+            material.metallic = pbr.metallic_factor;
+            material.roughness = pbr.roughness_factor;
+            material.base_color_texture = index_of(pbr.base_color_texture.texture, gltf->textures);
+            material.metallic_roughness_texture = index_of(pbr.metallic_roughness_texture.texture, gltf->textures);
+        }
+        material.emissive = vec3f(src.emissive_factor[0], src.emissive_factor[1], src.emissive_factor[2]);
+        material.normal_texture = index_of(src.normal_texture.texture, gltf->textures);
+        material.emissive_texture = index_of(src.emissive_texture.texture, gltf->textures);
+    }
+}
+
+void GltfLoader::clear() {
+    meshes.clear();
+    instances.clear();
+    materials.clear();
+    textures.clear();
+    storage.clear();
+    // Views and texture data point into the parse result and the mapping, both go last
+    if (gltf) {
+        cgltf_free(gltf);
+        gltf = nullptr;
+    }
+    file.close();
+}
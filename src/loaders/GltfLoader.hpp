@@ -0,0 +1,118 @@
+/**
+* @file GltfLoader.hpp
+* @brief Binary glTF 2.0 loader that views accessors in the mapped file.
+* @details The .glb is memory mapped and its binary chunk is used as buffer 0 without a copy. Accessors
+* that are tightly packed floats (positions, normals, texcoords) or 32 bit indices are viewed in place,
+* everything else is converted into owned storage. Primitives are single indexed, so the normal and
+* texcoord indices of their views alias the position indices.
+*/
+
+#pragma once
+
+#ifndef GLTFLOADER_HPP
+#define GLTFLOADER_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <owl/common/math/AffineSpace.h>
+
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+
+struct cgltf_data;
+
+using namespace owl;
+
+class GltfLoader {
+public:
+    struct Config {
+        // Smooth normals for primitives without any, faces further apart than the crease angle stay sharp
+        bool generate_normals = true;
+        float crease_angle = 180.f;
+    };
+
+    struct Primitive {
+        MeshCache::Views views;
+        // Index into materials, UINT32_MAX when the primitive has none
+        uint32_t material = UINT32_MAX;
+    };
+
+    struct Mesh {
+        std::string name;
+        std::vector<Primitive> primitives;
+    };
+
+    // A node that references a mesh, with the transform accumulated down the hierarchy
+    struct Instance {
+        uint32_t mesh;
+        affine3f transform;
+    };
+
+    struct Material {
+        std::string name;
+        vec4f base_color = vec4f(1.f);
+        float metallic = 1.f;
+        float roughness = 1.f;
+        vec3f emissive = vec3f(0.f);
+        // Indices into textures, -1 when unset
+        int32_t base_color_texture = -1;
+        int32_t metallic_roughness_texture = -1;
+        int32_t normal_texture = -1;
+        int32_t emissive_texture = -1;
+    };
+
+    struct Texture {
+        // Relative to the model for external images
+        std::string uri;
+        std::string mime_type;
+        // Encoded image inside the binary chunk, empty for external images
+        std::span<const std::byte> data;
+    };
+
+    GltfLoader(const Config& config);
+    ~GltfLoader();
+
+    /**
+     * @brief Whether a model path is glTF (.glb, or .gltf with its buffers read into memory).
+     */
+    static bool handles(const std::string& file_path);
+
+    GltfLoader(const GltfLoader&) = delete;
+    GltfLoader& operator=(const GltfLoader&) = delete;
+
+    bool load(const std::string& filename);
+    void clear();
+
+    const std::vector<Mesh>& get_meshes() const { return meshes; }
+    const std::vector<Instance>& get_instances() const { return instances; }
+    const std::vector<Material>& get_materials() const { return materials; }
+    const std::vector<Texture>& get_textures() const { return textures; }
+private:
+    Config config;
+    MappedFile file;
+    cgltf_data* gltf = nullptr;
+
+    // Converted attributes for accessors that can not be viewed in place, one per primitive
+    struct Storage {
+        std::vector<vec3f> positions;
+        std::vector<vec3f> normals;
+        std::vector<vec2f> texcoords;
+        std::vector<vec3ui> indices;
+        std::vector<vec3ui> normal_indices;
+    };
+    std::vector<Storage> storage;
+
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    std::vector<Material> materials;
+    std::vector<Texture> textures;
+
+    void read_meshes();
+    void read_instances();
+    void read_materials();
+};
+
+#endif //GLTFLOADER_HPP
@@ -0,0 +1,201 @@
+/**
+* @file HdrLoader.cpp
+* @brief Implementation of the HdrLoader class.
+*/
+
+#include "HdrLoader.hpp"
+#include "MappedFile.hpp"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <string_view>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <vector>
+
+namespace {
+    struct Header {
+        int width = 0;
+        int height = 0;
+        size_t data_offset = 0;
+    };
+
+    // Reads the header lines and the resolution string that ends them
+    bool parse_header(std::string_view text, Header& header, std::string& error) {
+        size_t pos = 0;
+        auto next_line = [&](std::string_view& line) {
+            const size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos) return false;
+            line = text.substr(pos, end - pos);
+            pos = end + 1;
+            return true;
+        };
+
+        std::string_view line;
+        if (!next_line(line) || !(line.starts_with("#?RADIANCE") || line.starts_with("#?RGBE"))) {
+            error = "not a Radiance file";
+            return false;
+        }
+        while (true) {
+            if (!next_line(line)) {
+                error = "truncated header";
+                return false;
+            }
+            if (line.empty()) break;
+            if (line.starts_with("FORMAT=") && line != "FORMAT=32-bit_rle_rgbe") {
+                error = "unsupported " + std::string(line);
+                return false;
+            }
+        }
+
+        if (!next_line(line) || !line.starts_with("-Y ")) {
+            error = "unsupported orientation";
+            return false;
+        }
+        const char* first = line.data() + 3;
+        const char* last = line.data() + line.size();
+        auto [after_height, height_ec] = std::from_chars(first, last, header.height);
+        const std::string_view rest(after_height, last - after_height);
+        if (height_ec != std::errc() || !rest.starts_with(" +X ")
+            || std::from_chars(after_height + 4, last, header.width).ec != std::errc()) {
+            error = "unsupported orientation";
+            return false;
+        }
+        if (header.width <= 0 || header.height <= 0 || header.width > (1 << 24) || header.height > (1 << 24)) {
+            error = "bad resolution";
+            return false;
+        }
+        header.data_offset = pos;
+        return true;
+    }
+
+    // Matches stb_image, so both readers return the same floats
+    inline void rgbe_to_float(const uint8_t* rgbe, float* out) {
+        if (rgbe[3] != 0) {
+            const float f = std::ldexp(1.f, rgbe[3] - (128 + 8));
+            out[0] = rgbe[0] * f;
+            out[1] = rgbe[1] * f;
+            out[2] = rgbe[2] * f;
+        }
+        else {
+            out[0] = out[1] = out[2] = 0.f;
+        }
+        out[3] = 1.f;
+    }
+
+    // Scanlines start with 2, 2 and their width, anything else makes stb read the whole file flat
+    bool is_rle(std::span<const uint8_t> data, int width) {
+        return width >= 8 && width < 32768 && data.size() >= 4
+            && data[0] == 2 && data[1] == 2 && !(data[2] & 0x80);
+    }
+
+    /**
+     * @brief Walks the runs of every scanline without decoding them to find where each one starts.
+     */
+    bool find_scanlines(std::span<const uint8_t> data, const Header& header, std::vector<size_t>& offsets) {
+        offsets.resize(header.height);
+        size_t p = 0;
+        for (int y = 0; y < header.height; y++) {
+            offsets[y] = p;
+            if (p + 4 > data.size() || data[p] != 2 || data[p + 1] != 2
+                || ((data[p + 2] << 8) | data[p + 3]) != header.width) {
+                return false;
+            }
+            p += 4;
+            for (int channel = 0; channel < 4; channel++) {
+                for (int x = 0; x < header.width; ) {
+                    if (p >= data.size()) return false;
+                    int count = data[p++];
+                    if (count > 128) {
+                        count -= 128;
+                        p++;
+                    }
+                    else {
+                        p += count;
+                    }
+                    if (count == 0 || x + count > header.width) return false;
+                    x += count;
+                }
+            }
+        }
+        return p <= data.size();
+    }
+
+    // Offsets were validated by find_scanlines, so runs stay within the scanline and the file
+    void decode_scanline(const uint8_t* p, int width, uint8_t* rgbe) {
+        p += 4;
+        for (int channel = 0; channel < 4; channel++) {
+            for (int x = 0; x < width; ) {
+                int count = *p++;
+                if (count > 128) {
+                    count -= 128;
+                    const uint8_t value = *p++;
+                    for (int i = 0; i < count; i++) rgbe[4 * (x + i) + channel] = value;
+                }
+                else {
+                    for (int i = 0; i < count; i++) rgbe[4 * (x + i) + channel] = *p++;
+                }
+                x += count;
+            }
+        }
+    }
+}
+
+bool HdrLoader::handles(const std::string& file_path) {
+    return file_path.substr(file_path.find_last_of('.') + 1) == "hdr";
+}
+
+std::unique_ptr<float[]> HdrLoader::load(const std::string& file_path, int& width, int& height) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    MappedFile file;
+    if (!file.open(file_path)) {
+        spdlog::error("HdrLoader: Failed to map {}", file_path);
+        return nullptr;
+    }
+    const std::span<const std::byte> bytes = file.bytes();
+    Header header;
+    std::string error;
+    if (!parse_header(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()), header, error)) {
+        spdlog::warn("HdrLoader: {}: {}", file_path, error);
+        return nullptr;
+    }
+    const std::span<const uint8_t> data(reinterpret_cast<const uint8_t*>(bytes.data()) + header.data_offset,
+                                        bytes.size() - header.data_offset);
+    const size_t num_pixels = static_cast<size_t>(header.width) * header.height;
+
+    std::vector<size_t> offsets;
+    const bool rle = is_rle(data, header.width);
+    if (rle ? !find_scanlines(data, header, offsets) : data.size() < 4 * num_pixels) {
+        spdlog::warn("HdrLoader: {}: corrupt or truncated scanlines", file_path);
+        return nullptr;
+    }
+    const auto scanned = std::chrono::high_resolution_clock::now();
+
+    std::unique_ptr<float[]> pixels = std::make_unique_for_overwrite<float[]>(4 * num_pixels);
+    tbb::parallel_for(tbb::blocked_range<int>(0, header.height), [&](const tbb::blocked_range<int>& r) {
+        std::vector<uint8_t> rgbe(rle ? 4 * header.width : 0);
+        for (int y = r.begin(); y < r.end(); y++) {
+            const size_t row = static_cast<size_t>(y) * header.width;
+            const uint8_t* scanline = data.data() + 4 * row;
+            if (rle) {
+                decode_scanline(data.data() + offsets[y], header.width, rgbe.data());
+                scanline = rgbe.data();
+            }
+            for (int x = 0; x < header.width; x++) {
+                rgbe_to_float(scanline + 4 * x, &pixels[4 * (row + x)]);
+            }
+        }
+    });
+
+    width = header.width;
+    height = header.height;
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("HdrLoader: Decoded {}x{} {} in {:.1f} ms ({:.1f} ms finding scanlines)", width, height, file_path,
+                 std::chrono::duration<double, std::milli>(end - start).count(),
+                 std::chrono::duration<double, std::milli>(scanned - start).count());
+    return pixels;
+}
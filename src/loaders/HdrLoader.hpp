@@ -0,0 +1,30 @@
+/**
+* @file HdrLoader.hpp
+* @brief Radiance .hdr reader that decodes scanlines in parallel.
+* @details Run length encoded scanlines only reveal their size by being walked, so one sequential pass
+* skips over the runs of every scanline to record where it starts. The scanlines are then decoded and
+* converted to float RGBA in parallel straight from the memory mapped file. Flat files, which start with
+* a scanline that is not run length encoded, are converted in parallel without the pass. Only the
+* 32-bit_rle_rgbe format with -Y H +X W orientation is read, like stb_image does.
+*/
+
+#pragma once
+
+#ifndef HDRLOADER_HPP
+#define HDRLOADER_HPP
+
+#include <memory>
+#include <string>
+
+class HdrLoader {
+public:
+    static bool handles(const std::string& file_path);
+
+    /**
+     * @brief Decodes to RGBA floats with alpha 1, the same layout stbi_loadf returns for 4 components.
+     * Returns nullptr when the file is missing, corrupt or in a format this reader does not handle.
+     */
+    static std::unique_ptr<float[]> load(const std::string& file_path, int& width, int& height);
+};
+
+#endif //HDRLOADER_HPP
@@ -0,0 +1,122 @@
+/**
+* @file ImageCache.cpp
+* @brief Implementation of the ImageCache class.
+*/
+
+#include "ImageCache.hpp"
+
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+ImageCache& ImageCache::instance() {
+    static ImageCache cache;
+    return cache;
+}
+
+void ImageCache::set_budget(size_t bytes) {
+    std::lock_guard lock(mutex);
+    budget = bytes;
+    evict();
+}
+
+std::shared_ptr<const ImageCache::Image> ImageCache::get(const std::string& file_path, const Decode& decode) {
+    const std::string key = key_for(file_path);
+    std::error_code ec;
+    const auto write_time = std::filesystem::last_write_time(key, ec);
+    const int64_t mtime = ec ? 0 : static_cast<int64_t>(write_time.time_since_epoch().count());
+
+    std::unique_lock lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end() && it->second.mtime != mtime) {
+        spdlog::info("ImageCache: {} changed on disk, decoding it again", key);
+        erase(it);
+        it = entries.end();
+    }
+    if (it != entries.end()) {
+        hits++;
+        Entry& entry = it->second;
+        if (entry.ready) {
+            lru.splice(lru.begin(), lru, entry.position);
+        }
+        const std::shared_future<std::shared_ptr<const Image>> image = entry.image;
+        lock.unlock();
+        return image.get();
+    }
+
+    misses++;
+    const uint64_t id = next_id++;
+    std::promise<std::shared_ptr<const Image>> promise;
+    entries.emplace(key, Entry { mtime, id, promise.get_future().share() });
+    lock.unlock();
+
+    std::shared_ptr<const Image> image;
+    try {
+        image = decode(file_path);
+    }
+    catch (...) {
+        promise.set_exception(std::current_exception());
+        lock.lock();
+        it = entries.find(key);
+        if (it != entries.end() && it->second.id == id) erase(it);
+        throw;
+    }
+    promise.set_value(image);
+
+    lock.lock();
+    it = entries.find(key);
+    if (it == entries.end() || it->second.id != id) return image;
+    if (!image || image->bytes() > budget) {
+        erase(it);
+        return image;
+    }
+    Entry& entry = it->second;
+    entry.ready = true;
+    entry.bytes = image->bytes();
+    entry.position = lru.insert(lru.begin(), key);
+    used += entry.bytes;
+    evict();
+    return image;
+}
+
+void ImageCache::release(const std::string& file_path) {
+    const std::string key = key_for(file_path);
+    std::lock_guard lock(mutex);
+    // A decode in flight finds its entry gone and returns its image without caching it
+    const auto it = entries.find(key);
+    if (it != entries.end()) erase(it);
+}
+
+ImageCache::Stats ImageCache::stats() const {
+    std::lock_guard lock(mutex);
+    return { hits, misses, evictions, entries.size(), used, budget };
+}
+
+void ImageCache::clear() {
+    std::lock_guard lock(mutex);
+    // Decodes in flight find their entry gone and return their image without caching it
+    entries.clear();
+    lru.clear();
+    used = 0;
+}
+
+std::string ImageCache::key_for(const std::string& file_path) {
+    std::error_code ec;
+    const std::filesystem::path canonical = std::filesystem::weakly_canonical(file_path, ec);
+    return ec ? file_path : canonical.string();
+}
+
+void ImageCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+    if (it->second.ready) {
+        used -= it->second.bytes;
+        lru.erase(it->second.position);
+    }
+    entries.erase(it);
+}
+
+void ImageCache::evict() {
+    while (used > budget && !lru.empty()) {
+        const std::string key = lru.back();
+        erase(entries.find(key));
+        evictions++;
+    }
+}
@@ -0,0 +1,92 @@
+/**
+* @file ImageCache.hpp
+* @brief Process wide cache of decoded float images with a byte budget and LRU eviction.
+* @details Images are keyed by canonical path and stamped with the file's modification time, a newer
+* file replaces the cached image. The first request for a file decodes it, concurrent requests for the
+* same file wait for that decode instead of starting their own. Callers hold images by shared_ptr, so
+* evicting an image only frees it once nobody uses it anymore. Failed decodes are not cached.
+*/
+
+#pragma once
+
+#ifndef IMAGECACHE_HPP
+#define IMAGECACHE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+class ImageCache {
+public:
+    struct Image {
+        int width = 0;
+        int height = 0;
+        // RGBA floats, freed by whichever decoder produced them
+        std::unique_ptr<float[], void(*)(float*)> pixels{ nullptr, nullptr };
+
+        size_t bytes() const { return static_cast<size_t>(width) * height * 4 * sizeof(float); }
+    };
+
+    // Returns nullptr when the file cannot be decoded
+    using Decode = std::function<std::shared_ptr<Image>(const std::string& file_path)>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t used_bytes = 0;
+        size_t budget_bytes = 0;
+    };
+
+    static ImageCache& instance();
+
+    /**
+     * @brief Evicts least recently used images until the cache fits. Images larger than the budget are never kept.
+     */
+    void set_budget(size_t bytes);
+
+    std::shared_ptr<const Image> get(const std::string& file_path, const Decode& decode);
+    /**
+     * @brief Drops the image of a file whose last user is done with it, holders keep their copy alive.
+     */
+    void release(const std::string& file_path);
+    Stats stats() const;
+    void clear();
+private:
+    struct Entry {
+        int64_t mtime;
+        // Tells a finished decode whether its entry was replaced meanwhile
+        uint64_t id;
+        std::shared_future<std::shared_ptr<const Image>> image;
+        // Only decoded images are in the LRU list and count against the budget
+        bool ready = false;
+        size_t bytes = 0;
+        std::list<std::string>::iterator position;
+    };
+
+    ImageCache() = default;
+
+    static std::string key_for(const std::string& file_path);
+
+    void erase(std::unordered_map<std::string, Entry>::iterator it);
+    void evict();
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    // Most recently used first
+    std::list<std::string> lru;
+    size_t budget = size_t(2) << 30;
+    size_t used = 0;
+    uint64_t next_id = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+#endif //IMAGECACHE_HPP
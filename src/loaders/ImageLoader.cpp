@@ -3,6 +3,10 @@
 //
 
 #include "ImageLoader.hpp"
+#include "HdrLoader.hpp"
+#include "TexelCodec.hpp"
+
+#include <chrono>
 
 #include <spdlog/spdlog.h>
 
@@ -15,35 +19,40 @@ ImageLoader::ImageLoader(const Config& config)
 }
 
 ImageLoader::~ImageLoader() {
-    if (config.cache && image_data) {
-        stbi_image_free(const_cast<float*>(image_data));
-    }
 }
 
-const float* ImageLoader::get_image_data(const std::string& file_path, int& width, int& height) {
-    if (config.cache && image_data && file_path == this->file_path) {
-        width = image_width;
-        height = image_height;
-        return image_data;
-    }
+std::shared_ptr<ImageCache::Image> ImageLoader::decode(const std::string& file_path) {
     bool is_hdr = stbi_is_hdr(file_path.c_str()); // Check if the file is HDR
     const std::string type = is_hdr ? "HDR" : "LDR";
 
     spdlog::info("ImageLoader: Loading {} texture: {}", type, file_path);
-    int channels;
-    float* data = stbi_loadf(file_path.c_str(), &width, &height, &channels, 4);
-    if (!data) {
-        spdlog::error("ImageLoader: Failed to load {} texture: {}", type, file_path);
-        return nullptr; // Return an invalid texture
+    auto image = std::make_shared<ImageCache::Image>();
+    // Radiance files decode their scanlines in parallel, stb reads anything the reader rejects
+    if (is_hdr && HdrLoader::handles(file_path)) {
+        std::unique_ptr<float[]> pixels = HdrLoader::load(file_path, image->width, image->height);
+        if (pixels) {
+            image->pixels = { pixels.release(), [](float* p) { delete[] p; } };
+        }
     }
-
-    if (config.cache) {
-        image_data = data;
-        image_width = width;
-        image_height = height;
+    if (!image->pixels) {
+        int channels;
+        float* data = stbi_loadf(file_path.c_str(), &image->width, &image->height, &channels, 4);
+        if (!data) {
+            spdlog::error("ImageLoader: Failed to load {} texture: {}", type, file_path);
+            return nullptr; // Return an invalid texture
+        }
+        image->pixels = { data, [](float* p) { stbi_image_free(p); } };
     }
-    this->file_path = file_path;
-    return data;
+    return image;
+}
+
+const float* ImageLoader::get_image_data(const std::string& file_path, int& width, int& height) {
+    // The shared cache lets every loader reuse an image, without it each request decodes again
+    image = config.cache ? ImageCache::instance().get(file_path, decode) : decode(file_path);
+    if (!image) return nullptr;
+    width = image->width;
+    height = image->height;
+    return image->pixels.get();
 }
 
 
@@ -65,9 +74,70 @@ OWLTexture ImageLoader::load_image_owl(const std::string& file_path, OWLContext
             OWL_TEXTURE_CLAMP
         );
 
-    if (!config.cache) {
-        stbi_image_free(const_cast<float*>(image_data));
+    image.reset();
+    return texture;
+}
+
+std::optional<ImageLoader::DeviceTexture> ImageLoader::load_image_cuda(const std::string& file_path, Trace::TexelFormat format) {
+    using Trace::TexelFormat;
+    int width, height;
+    const float* data = get_image_data(file_path, width, height);
+    if (!data) return std::nullopt;
+
+    // RGBA32F is uploaded straight from the decoded image
+    const auto start = std::chrono::high_resolution_clock::now();
+    TexelCodec::Image encoded;
+    if (format != TexelFormat::RGBA32F) {
+        encoded = TexelCodec::encode(data, width, height, format);
+    }
+    else {
+        encoded = { format, width, height, width, height };
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    const void* texels = format == TexelFormat::RGBA32F ? static_cast<const void*>(data) : encoded.data.data();
+
+    cudaChannelFormatDesc channels;
+    switch (format) {
+        case TexelFormat::RGBA32F: channels = cudaCreateChannelDesc<float4>(); break;
+        case TexelFormat::RGBA16F: channels = cudaCreateChannelDescHalf4(); break;
+        case TexelFormat::RGB9E5: channels = cudaCreateChannelDesc<unsigned int>(); break;
+        case TexelFormat::BC6H: channels = cudaCreateChannelDesc<cudaChannelFormatKindUnsignedBlockCompressed6H>(); break;
     }
+
+    DeviceTexture texture;
+    texture.format = format;
+    texture.bytes = encoded.row_pitch() * encoded.rows();
+    texture.uv_scale = owl::vec2f(static_cast<float>(width) / encoded.stored_width,
+                                  static_cast<float>(height) / encoded.stored_height);
+    cudaError_t err = cudaMallocArray(&texture.array, &channels, encoded.stored_width, encoded.stored_height);
+    if (err == cudaSuccess) {
+        // Block compressed arrays are copied in rows of blocks
+        err = cudaMemcpy2DToArray(texture.array, 0, 0, texels, encoded.row_pitch(), encoded.row_pitch(),
+                                  encoded.rows(), cudaMemcpyHostToDevice);
+    }
+    if (err == cudaSuccess) {
+        cudaResourceDesc resource = {};
+        resource.resType = cudaResourceTypeArray;
+        resource.res.array.array = texture.array;
+        cudaTextureDesc sampling = {};
+        sampling.addressMode[0] = cudaAddressModeClamp;
+        sampling.addressMode[1] = cudaAddressModeClamp;
+        sampling.filterMode = cudaFilterModePoint;
+        sampling.readMode = cudaReadModeElementType;
+        sampling.normalizedCoords = 1;
+        err = cudaCreateTextureObject(&texture.texture, &resource, &sampling, nullptr);
+    }
+    if (err != cudaSuccess) {
+        spdlog::error("ImageLoader: Failed to create {} texture: {}", TexelCodec::name(format), cudaGetErrorString(err));
+        if (texture.array) cudaFreeArray(texture.array);
+        return std::nullopt;
+    }
+
+    spdlog::info("ImageLoader: {}x{} texture as {}, {} MB on the device ({} MB as RGBA32F), encoded in {:.1f} ms",
+                 width, height, TexelCodec::name(format), texture.bytes >> 20,
+                 (static_cast<size_t>(width) * height * sizeof(owl::vec4f)) >> 20,
+                 std::chrono::duration<double, std::milli>(end - start).count());
+    image.reset();
     return texture;
 }
 
@@ -170,9 +240,7 @@ ImageLoader::AliasResult ImageLoader::build_alias(const std::string& file_path,
     }
     spdlog::info("ImageLoader: Alias table checksum: {}", checksum);
 
-    if (!config.cache) {
-        stbi_image_free(const_cast<float*>(image_data));
-    }
+    image.reset();
     return Alias {
         std::move(pdf),
         std::move(alias_pdf),
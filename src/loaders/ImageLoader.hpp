@@ -9,7 +9,12 @@
 #include <optional>
 #include <string>
 
+#include <cuda_runtime.h>
+
 #include "owl/owl.h"
+#include "owl/common/math/vec.h"
+#include "trace/TexelFormat.hpp"
+#include "ImageCache.hpp"
 
 class ImageLoader {
 public:
@@ -22,6 +27,19 @@ public:
 
     OWLTexture load_image_owl(const std::string &file_path, OWLContext ctx);
 
+    struct DeviceTexture {
+        cudaTextureObject_t texture = 0;
+        cudaArray_t array = nullptr;
+        Trace::TexelFormat format = Trace::TexelFormat::RGBA32F;
+        // Extent of the image in normalized coordinates, BC6H pads it to whole blocks
+        owl::vec2f uv_scale = owl::vec2f(1.f);
+        size_t bytes = 0;
+    };
+    /**
+     * @brief Point sampled, clamped texture in any texel format, encoded on the host.
+     */
+    std::optional<DeviceTexture> load_image_cuda(const std::string &file_path, Trace::TexelFormat format);
+
     struct Alias {
         std::unique_ptr<float[]> pdf;
         std::unique_ptr<float[]> alias_pdf;
@@ -31,12 +49,11 @@ public:
     using AliasResult = std::optional<Alias>;
     AliasResult build_alias(const std::string &file_path, OWLContext ctx);
 private:
+    static std::shared_ptr<ImageCache::Image> decode(const std::string& file_path);
     const float* get_image_data(const std::string& file_path, int &width, int &height);
 
-    std::string file_path;
-    const float* image_data = nullptr;
-    int image_width = 0;
-    int image_height = 0;
+    // Keeps the last image alive while it is in use, even if the shared cache evicts it
+    std::shared_ptr<const ImageCache::Image> image;
 };
 
 #endif //IMAGELOADER_HPP
@@ -0,0 +1,59 @@
+/**
+* @file ImageWriter.cpp
+* @brief Implementation of the ImageWriter class.
+*/
+
+#include "ImageWriter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+namespace {
+    uint8_t to_srgb8(float c) {
+        c = std::clamp(c, 0.f, 1.f);
+        c = c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(c * 255.f + 0.5f);
+    }
+}
+
+bool ImageWriter::write(const std::string& file_path, std::span<const owl::vec3f> pixels, int width, int height) {
+    const std::string ext = file_path.substr(file_path.find_last_of('.') + 1);
+    int ok = 0;
+
+    // Buffers are stored bottom-up like the GL texture they are displayed from
+    stbi_flip_vertically_on_write(1);
+    if (ext == "hdr") {
+        ok = stbi_write_hdr(file_path.c_str(), width, height, 3, reinterpret_cast<const float*>(pixels.data()));
+    }
+    else {
+        std::vector<uint8_t> ldr(pixels.size() * 3);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            ldr[3 * i + 0] = to_srgb8(pixels[i].x);
+            ldr[3 * i + 1] = to_srgb8(pixels[i].y);
+            ldr[3 * i + 2] = to_srgb8(pixels[i].z);
+        }
+        if (ext == "png") {
+            ok = stbi_write_png(file_path.c_str(), width, height, 3, ldr.data(), width * 3);
+        }
+        else if (ext == "jpg" || ext == "jpeg") {
+            ok = stbi_write_jpg(file_path.c_str(), width, height, 3, ldr.data(), 95);
+        }
+        else {
+            spdlog::error("ImageWriter: Unsupported image format: {}", file_path);
+            return false;
+        }
+    }
+
+    if (!ok) {
+        spdlog::error("ImageWriter: Failed to write image: {}", file_path);
+        return false;
+    }
+    spdlog::info("ImageWriter: Wrote {}x{} image: {}", width, height, file_path);
+    return true;
+}
@@ -0,0 +1,26 @@
+/**
+* @file ImageWriter.hpp
+* @brief Writes linear float images to disk.
+*/
+
+#pragma once
+
+#ifndef IMAGEWRITER_HPP
+#define IMAGEWRITER_HPP
+
+#include <span>
+#include <string>
+
+#include "owl/common/math/vec.h"
+
+class ImageWriter {
+public:
+    /**
+     * @brief Writes a bottom-up linear RGB image, the row order of the pixel buffer.
+     * The format follows the extension: .hdr keeps linear floats, .png and .jpg are clamped and
+     * sRGB encoded the same way the viewer displays them.
+     */
+    static bool write(const std::string& file_path, std::span<const owl::vec3f> pixels, int width, int height);
+};
+
+#endif //IMAGEWRITER_HPP
@@ -0,0 +1,39 @@
+/**
+* @file MappedFile.hpp
+* @brief Read-only memory mapping of a whole file.
+*/
+
+#pragma once
+
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /**
+     * @brief Maps the file, replacing any previous mapping.
+     * Pages are only read when first touched.
+     */
+    bool open(const std::string& file_path);
+    void close();
+
+    bool is_open() const { return data != nullptr; }
+    std::span<const std::byte> bytes() const { return { data, size }; }
+private:
+    const std::byte* data = nullptr;
+    size_t size = 0;
+};
+
+#endif //MAPPEDFILE_HPP
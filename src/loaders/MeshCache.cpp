@@ -0,0 +1,280 @@
+/**
+* @file MeshCache.cpp
+* @brief Implementation of the MeshCache class.
+*/
+
+#include "MeshCache.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+    constexpr char MAGIC[8] = { 'O', 'W', 'L', 'M', 'E', 'S', 'H', '\0' };
+    constexpr uint32_t VERSION = 5;
+
+    enum Section {
+        Vertices,
+        Normals,
+        TexCoords,
+        Indices,
+        NormalIndices,
+        TexCoordIndices,
+        MaterialIds,
+        Materials,
+        // One "size mtime path" line per dependency of the source
+        Dependencies,
+        NumSections,
+    };
+
+    struct SectionEntry {
+        uint64_t offset;
+        uint64_t count;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t load_flags;
+        float crease_angle;
+        uint64_t source_size;
+        int64_t source_mtime;
+        SectionEntry sections[NumSections];
+        uint64_t payload_checksum;
+        // Covers every field above
+        uint64_t header_checksum;
+    };
+
+    /**
+     * @brief 64-bit FNV-1a variant that consumes a word at a time.
+     */
+    uint64_t checksum(std::span<const std::byte> bytes, uint64_t h = 0xcbf29ce484222325ull) {
+        constexpr uint64_t PRIME = 0x100000001b3ull;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t)) {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            h = (h ^ word) * PRIME;
+            h ^= h >> 29;
+        }
+        for (; i < bytes.size(); i++) {
+            h = (h ^ static_cast<uint64_t>(bytes[i])) * PRIME;
+        }
+        return h;
+    }
+
+    uint64_t header_checksum(const Header& header) {
+        return checksum(std::as_bytes(std::span(&header, 1)).first(offsetof(Header, header_checksum)));
+    }
+
+    size_t align_up(size_t offset) {
+        return (offset + MeshCache::SECTION_ALIGNMENT - 1) / MeshCache::SECTION_ALIGNMENT * MeshCache::SECTION_ALIGNMENT;
+    }
+
+    template<class T>
+    bool section_view(std::span<const std::byte> bytes, const SectionEntry& entry, std::span<const T>& view) {
+        if (entry.offset % alignof(T) != 0 || entry.offset > bytes.size()
+            || entry.count > (bytes.size() - entry.offset) / sizeof(T)) {
+            return false;
+        }
+        view = std::span<const T>(reinterpret_cast<const T*>(bytes.data() + entry.offset), entry.count);
+        return true;
+    }
+}
+
+std::string MeshCache::path_for(const std::string& model_path) {
+    return model_path + ".meshcache";
+}
+
+std::string MeshCache::temp_path_for(const std::string& file_path) {
+    const size_t thread = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return file_path + "." + std::to_string(getpid()) + "." + std::to_string(thread) + ".tmp";
+}
+
+std::optional<MeshCache::Source> MeshCache::stat_source(const std::string& model_path, uint32_t load_flags, float crease_angle) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(model_path, ec);
+    if (ec) return std::nullopt;
+    const auto mtime = std::filesystem::last_write_time(model_path, ec);
+    if (ec) return std::nullopt;
+
+    return Source {
+        .size = static_cast<uint64_t>(size),
+        .mtime = static_cast<int64_t>(mtime.time_since_epoch().count()),
+        .load_flags = load_flags,
+        .crease_angle = crease_angle,
+    };
+}
+
+MeshCache::Dependency MeshCache::stat_dependency(const std::string& path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) return { path };
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return { path };
+    return { path, static_cast<uint64_t>(size), static_cast<int64_t>(mtime.time_since_epoch().count()) };
+}
+
+bool MeshCache::write(const std::string& file_path, const Source& source, const Views& views) {
+    std::string dependencies;
+    for (const Dependency& dependency : source.dependencies) {
+        dependencies += std::to_string(dependency.size) + " " + std::to_string(dependency.mtime) + " " + dependency.path + "\n";
+    }
+    const std::array<std::span<const std::byte>, NumSections> payload = {
+        std::as_bytes(views.vertices),
+        std::as_bytes(views.normals),
+        std::as_bytes(views.texcoords),
+        std::as_bytes(views.indices),
+        std::as_bytes(views.normal_indices),
+        std::as_bytes(views.texcoord_indices),
+        std::as_bytes(views.material_ids),
+        std::as_bytes(views.materials),
+        std::as_bytes(std::span(dependencies)),
+    };
+    const std::array<size_t, NumSections> counts = {
+        views.vertices.size(),
+        views.normals.size(),
+        views.texcoords.size(),
+        views.indices.size(),
+        views.normal_indices.size(),
+        views.texcoord_indices.size(),
+        views.material_ids.size(),
+        views.materials.size(),
+        dependencies.size(),
+    };
+
+    Header header {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.load_flags = source.load_flags;
+    header.crease_angle = source.crease_angle;
+    header.source_size = source.size;
+    header.source_mtime = source.mtime;
+    header.payload_checksum = 0xcbf29ce484222325ull;
+    size_t offset = align_up(sizeof(Header));
+    for (int i = 0; i < NumSections; i++) {
+        header.sections[i] = { offset, counts[i] };
+        header.payload_checksum = checksum(payload[i], header.payload_checksum);
+        offset = align_up(offset + payload[i].size());
+    }
+    header.header_checksum = header_checksum(header);
+
+    // Written under a temporary name so an interrupted write never leaves a valid looking cache
+    const std::string tmp_path = temp_path_for(file_path);
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::warn("MeshCache: Cannot write cache file: {}", file_path);
+            return false;
+        }
+        const char padding[SECTION_ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding, align_up(sizeof(Header)) - sizeof(Header));
+        for (int i = 0; i < NumSections; i++) {
+            out.write(reinterpret_cast<const char*>(payload[i].data()), payload[i].size());
+            out.write(padding, align_up(payload[i].size()) - payload[i].size());
+        }
+        if (!out) {
+            spdlog::warn("MeshCache: Failed writing cache file: {}", file_path);
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        spdlog::warn("MeshCache: Failed to move cache file into place: {}", ec.message());
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    spdlog::info("MeshCache: Wrote {} MB cache: {}", offset >> 20, file_path);
+    return true;
+}
+
+bool MeshCache::open(const std::string& file_path, const Source& source, bool verify_payload) {
+    close();
+    if (!file.open(file_path)) return false;
+
+    const std::span<const std::byte> bytes = file.bytes();
+    Header header;
+    if (bytes.size() < sizeof(Header)) {
+        spdlog::warn("MeshCache: Truncated cache file: {}", file_path);
+        close();
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || header.header_checksum != header_checksum(header)) {
+        spdlog::warn("MeshCache: Ignoring invalid cache file: {}", file_path);
+        close();
+        return false;
+    }
+    if (header.source_size != source.size || header.source_mtime != source.mtime
+        || header.load_flags != source.load_flags || header.crease_angle != source.crease_angle) {
+        spdlog::info("MeshCache: Cache is out of date: {}", file_path);
+        close();
+        return false;
+    }
+
+    std::span<const char> dependencies;
+    const bool ok = section_view(bytes, header.sections[Vertices], mesh.vertices)
+        && section_view(bytes, header.sections[Normals], mesh.normals)
+        && section_view(bytes, header.sections[TexCoords], mesh.texcoords)
+        && section_view(bytes, header.sections[Indices], mesh.indices)
+        && section_view(bytes, header.sections[NormalIndices], mesh.normal_indices)
+        && section_view(bytes, header.sections[TexCoordIndices], mesh.texcoord_indices)
+        && section_view(bytes, header.sections[MaterialIds], mesh.material_ids)
+        && section_view(bytes, header.sections[Materials], mesh.materials)
+        && section_view(bytes, header.sections[Dependencies], dependencies);
+    if (!ok) {
+        spdlog::warn("MeshCache: Truncated cache file: {}", file_path);
+        close();
+        return false;
+    }
+
+    // An edited or removed material library makes the cached materials stale
+    std::istringstream lines{std::string(dependencies.begin(), dependencies.end())};
+    Dependency recorded;
+    while (lines >> recorded.size >> recorded.mtime && std::getline(lines >> std::ws, recorded.path)) {
+        const Dependency current = stat_dependency(recorded.path);
+        if (current.size != recorded.size || current.mtime != recorded.mtime) {
+            spdlog::info("MeshCache: {} changed, cache is out of date: {}", recorded.path, file_path);
+            close();
+            return false;
+        }
+    }
+
+    if (verify_payload) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        h = checksum(std::as_bytes(mesh.vertices), h);
+        h = checksum(std::as_bytes(mesh.normals), h);
+        h = checksum(std::as_bytes(mesh.texcoords), h);
+        h = checksum(std::as_bytes(mesh.indices), h);
+        h = checksum(std::as_bytes(mesh.normal_indices), h);
+        h = checksum(std::as_bytes(mesh.texcoord_indices), h);
+        h = checksum(std::as_bytes(mesh.material_ids), h);
+        h = checksum(std::as_bytes(mesh.materials), h);
+        h = checksum(std::as_bytes(dependencies), h);
+        if (h != header.payload_checksum) {
+            spdlog::warn("MeshCache: Payload checksum mismatch: {}", file_path);
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeshCache::close() {
+    mesh = {};
+    file.close();
+}
@@ -0,0 +1,93 @@
+/**
+* @file MeshCache.hpp
+* @brief Binary mesh files that are memory mapped instead of parsed.
+* @details A cache file is a fixed header followed by one section per attribute. Sections start on
+* SECTION_ALIGNMENT byte boundaries, so spans into the mapping are suitably aligned for every attribute
+* type. The header records the size and modification time of the source model and is checksummed. The
+* payload checksum is only verified on request because it touches every page.
+*/
+
+#pragma once
+
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <owl/common/math/vec.h>
+
+#include "MappedFile.hpp"
+
+using namespace owl;
+
+class MeshCache {
+public:
+    static constexpr size_t SECTION_ALIGNMENT = 64;
+
+    /**
+     * @brief A file the model references, zero size and time when it is missing.
+     */
+    struct Dependency {
+        std::string path;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+    };
+
+    /**
+     * @brief Identifies the model a cache was built from, a mismatch in any field rebuilds the cache.
+     */
+    struct Source {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint32_t load_flags = 0;
+        // Generated normals depend on it
+        float crease_angle = 180.f;
+        // Recorded on write, open stats them again and rebuilds the cache when any of them changed
+        std::vector<Dependency> dependencies;
+    };
+
+    struct Views {
+        std::span<const vec3f> vertices;
+        std::span<const vec3f> normals;
+        std::span<const vec2f> texcoords;
+        std::span<const vec3ui> indices;
+        std::span<const vec3ui> normal_indices;
+        std::span<const vec3ui> texcoord_indices;
+        // Per triangle, UINT32_MAX where the model assigns no material
+        std::span<const uint32_t> material_ids;
+        // Material library as MTL text, so cached meshes keep their materials without the .mtl file
+        std::span<const char> materials;
+    };
+
+    /**
+     * @brief Path of the cache file that belongs to a model.
+     */
+    static std::string path_for(const std::string& model_path);
+    /**
+     * @brief Unique name next to file_path that a writer fills before renaming it into place.
+     * Concurrent writers of the same file, in this or another process, never share a partial file.
+     */
+    static std::string temp_path_for(const std::string& file_path);
+    static std::optional<Source> stat_source(const std::string& model_path, uint32_t load_flags, float crease_angle);
+    static Dependency stat_dependency(const std::string& path);
+
+    static bool write(const std::string& file_path, const Source& source, const Views& views);
+
+    /**
+     * @brief Maps a cache file and points the views into it.
+     * Fails if the file is missing, truncated, corrupt, or was built from a different source.
+     */
+    bool open(const std::string& file_path, const Source& source, bool verify_payload = false);
+    void close();
+
+    const Views& views() const { return mesh; }
+private:
+    MappedFile file;
+    Views mesh;
+};
+
+#endif //MESHCACHE_HPP
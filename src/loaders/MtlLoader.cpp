@@ -0,0 +1,100 @@
+/**
+* @file MtlLoader.cpp
+* @brief Implementation of the MtlLoader class.
+*/
+
+#include "MtlLoader.hpp"
+
+#include <charconv>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace {
+    std::string_view trim(std::string_view s) {
+        const size_t begin = s.find_first_not_of(" \t\r");
+        if (begin == std::string_view::npos) return {};
+        return s.substr(begin, s.find_last_not_of(" \t\r") - begin + 1);
+    }
+
+    // Splits off the first whitespace separated token
+    std::string_view next_token(std::string_view& s) {
+        s = trim(s);
+        const size_t end = s.find_first_of(" \t");
+        const std::string_view token = s.substr(0, end);
+        s = end == std::string_view::npos ? std::string_view() : s.substr(end);
+        return token;
+    }
+
+    bool parse_color(std::string_view s, vec3f& color) {
+        for (int c = 0; c < 3; c++) {
+            const std::string_view token = next_token(s);
+            if (token.empty()) {
+                // A single value is used for all channels
+                if (c == 1) {
+                    color = vec3f(color.x);
+                    return true;
+                }
+                return false;
+            }
+            if (std::from_chars(token.data(), token.data() + token.size(), color[c]).ec != std::errc()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string parse_map(std::string_view s) {
+        s = trim(s);
+        // Options go before the file name, which is then the last token
+        if (!s.empty() && s.front() == '-') {
+            s = s.substr(s.find_last_of(" \t") + 1);
+        }
+        return std::string(s);
+    }
+}
+
+std::vector<MtlLoader::Material> MtlLoader::parse(std::string_view text) {
+    std::vector<Material> materials;
+    size_t line_number = 0;
+    while (!text.empty()) {
+        const size_t end = text.find('\n');
+        std::string_view line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        line_number++;
+
+        const std::string_view keyword = next_token(line);
+        if (keyword.empty() || keyword.front() == '#') continue;
+        if (keyword == "newmtl") {
+            materials.push_back({ .name = std::string(trim(line)) });
+            continue;
+        }
+        if (materials.empty()) continue;
+
+        Material& material = materials.back();
+        if (keyword == "Kd" && !parse_color(line, material.diffuse)) {
+            spdlog::warn("MtlLoader: Bad Kd on line {}", line_number);
+        }
+        else if (keyword == "Ke" && !parse_color(line, material.emission)) {
+            spdlog::warn("MtlLoader: Bad Ke on line {}", line_number);
+        }
+        else if (keyword == "map_Kd") {
+            material.diffuse_map = parse_map(line);
+        }
+        else if (keyword == "map_Ke") {
+            material.emission_map = parse_map(line);
+        }
+    }
+    return materials;
+}
+
+std::string MtlLoader::serialize(const std::vector<Material>& materials) {
+    std::string text;
+    for (const Material& material : materials) {
+        text += fmt::format("newmtl {}\n", material.name);
+        text += fmt::format("Kd {} {} {}\n", material.diffuse.x, material.diffuse.y, material.diffuse.z);
+        text += fmt::format("Ke {} {} {}\n", material.emission.x, material.emission.y, material.emission.z);
+        if (!material.diffuse_map.empty()) text += fmt::format("map_Kd {}\n", material.diffuse_map);
+        if (!material.emission_map.empty()) text += fmt::format("map_Ke {}\n", material.emission_map);
+    }
+    return text;
+}
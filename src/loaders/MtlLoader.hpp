@@ -0,0 +1,36 @@
+/**
+* @file MtlLoader.hpp
+* @brief Wavefront MTL material libraries, reduced to what the mesh materials use.
+* @details Only newmtl, Kd, Ke, map_Kd and map_Ke are read, every other statement is skipped. Texture
+* paths are kept as written, relative to the library. Options in front of a map name are skipped, so a
+* map name that contains spaces is only supported without options.
+*/
+
+#pragma once
+
+#ifndef MTLLOADER_HPP
+#define MTLLOADER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <owl/common/math/vec.h>
+
+using namespace owl;
+
+class MtlLoader {
+public:
+    struct Material {
+        std::string name;
+        vec3f diffuse = vec3f(0.8f);
+        vec3f emission = vec3f(0.f);
+        std::string diffuse_map;
+        std::string emission_map;
+    };
+
+    static std::vector<Material> parse(std::string_view text);
+    static std::string serialize(const std::vector<Material>& materials);
+};
+
+#endif //MTLLOADER_HPP
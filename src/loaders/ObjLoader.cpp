@@ -3,9 +3,19 @@
 * @brief Implementation of the ObjLoader class for loading OBJ files.
 */
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <numeric>
+#include <sstream>
+#include <string_view>
 #include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 #include "ObjLoader.hpp"
+#include "mesh/NormalGenerator.hpp"
 
 
 ObjLoader::ObjLoader(const Config& config)
@@ -15,8 +25,69 @@ ObjLoader::~ObjLoader() {
 }
 
 bool ObjLoader::load(const std::string& filename) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    const bool partial = !config.meshes.empty() || !config.mesh_names.empty();
+    std::optional<MeshCache::Source> source = config.cache && !partial
+        ? MeshCache::stat_source(filename, static_cast<uint32_t>(config.loadFlags), config.crease_angle)
+        : std::nullopt;
+    const std::string cache_path = MeshCache::path_for(filename);
+
+    if (source && cache.open(cache_path, *source, config.verify_cache)) {
+        views = cache.views();
+        materials = MtlLoader::parse(std::string_view(views.materials.data(), views.materials.size()));
+        const auto end = std::chrono::high_resolution_clock::now();
+        spdlog::info("ObjLoader: Mapped cached mesh {} in {:.2f} ms", cache_path,
+                     std::chrono::duration<double, std::milli>(end - start).count());
+        return true;
+    }
+
+    if (!parse(filename)) {
+        return false;
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("ObjLoader: Parsed {} in {:.2f} ms", filename, std::chrono::duration<double, std::milli>(end - start).count());
+
+    if (source) {
+        for (const std::string& library : material_libraries(filename)) {
+            source->dependencies.push_back(MeshCache::stat_dependency(library));
+        }
+        MeshCache::write(cache_path, *source, views);
+    }
+    return true;
+}
+
+std::vector<std::string> ObjLoader::material_libraries(const std::string& filename) {
+    std::vector<std::string> libraries;
+    MappedFile file;
+    if (!file.open(filename)) return libraries;
+
+    // Only reached after a full parse, scanning the mapping for mtllib lines is cheap in comparison
+    static constexpr std::string_view KEYWORD = "mtllib";
+    const std::span<const std::byte> bytes = file.bytes();
+    const std::string_view text(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    const std::filesystem::path directory = std::filesystem::path(filename).parent_path();
+    for (size_t at = text.find(KEYWORD); at != std::string_view::npos; at = text.find(KEYWORD, at + KEYWORD.size())) {
+        const bool line_start = at == 0 || text[at - 1] == '\n';
+        const size_t end = std::min(text.find('\n', at), text.size());
+        if (!line_start || at + KEYWORD.size() >= end || !std::isspace(static_cast<unsigned char>(text[at + KEYWORD.size()]))) {
+            continue;
+        }
+        std::istringstream names{std::string(text.substr(at + KEYWORD.size(), end - at - KEYWORD.size()))};
+        std::string name;
+        while (names >> name) {
+            const std::string path = (directory / name).string();
+            if (std::find(libraries.begin(), libraries.end(), path) == libraries.end()) {
+                libraries.push_back(path);
+            }
+        }
+    }
+    return libraries;
+}
+
+bool ObjLoader::parse(const std::string& filename) {
     spdlog::info("ObjLoader: Loading OBJ file: {}", filename);
-    obj::Result res = obj::ParseFile(filename);
+    result = obj::ParseFile(filename);
+    obj::Result& res = result;
     if (res.error) {
         spdlog::error("ObjLoader: Failed to load OBJ file: {}", res.error.code.message());
         return false;
@@ -28,78 +99,131 @@ bool ObjLoader::load(const std::string& filename) {
         return false;
     }
 
-    size_t num_indices = 0;
-    for (const auto& shape : res.shapes) {
-        num_indices += shape.mesh.indices.size();
-    }
-
-    // Fill indices
-    data.indices.resize(num_indices);
-    data.normal_indices.resize(num_indices);
-    data.texcoord_indices.resize(num_indices);
-    size_t offset = 0;
-    for (const auto& shape : res.shapes) {
-        for (size_t i = 0; i < shape.mesh.indices.size(); i += 3) {
-            data.normal_indices[offset] = vec3ui(
-                shape.mesh.indices[i].normal_index,
-                shape.mesh.indices[i + 1].normal_index,
-                shape.mesh.indices[i + 2].normal_index
-            );
-            data.texcoord_indices[offset] = vec3ui(
-                shape.mesh.indices[i].texcoord_index,
-                shape.mesh.indices[i + 1].texcoord_index,
-                shape.mesh.indices[i + 2].texcoord_index
-            );
-            data.indices[offset++] = vec3ui(
-                shape.mesh.indices[i].position_index,
-                shape.mesh.indices[i + 1].position_index,
-                shape.mesh.indices[i + 2].position_index
-            );
-        }
+    // Output offset of every selected shape
+    const std::vector<size_t> shapes = select_shapes(res.shapes);
+    std::vector<size_t> offsets(shapes.size() + 1, 0);
+    for (size_t s = 0; s < shapes.size(); s++) {
+        offsets[s + 1] = offsets[s] + res.shapes[shapes[s]].mesh.indices.size() / 3;
     }
+    const size_t num_triangles = offsets.back();
+    if (shapes.size() < res.shapes.size()) {
+        spdlog::info("ObjLoader: Loading {} of {} shapes, {} triangles", shapes.size(), res.shapes.size(), num_triangles);
+    }
+
+    // Fill indices, shapes and the triangles within them are converted in parallel
+    data.indices.resize(num_triangles);
+    data.normal_indices.resize(num_triangles);
+    data.texcoord_indices.resize(num_triangles);
+    data.material_ids.resize(num_triangles);
+    tbb::parallel_for(size_t(0), shapes.size(), [&](size_t s) {
+        const auto& indices = res.shapes[shapes[s]].mesh.indices;
+        const auto& material_ids = res.shapes[shapes[s]].mesh.material_ids;
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, indices.size() / 3), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                const size_t i = 3 * t;
+                const size_t out = offsets[s] + t;
+                data.indices[out] = vec3ui(
+                    indices[i].position_index,
+                    indices[i + 1].position_index,
+                    indices[i + 2].position_index
+                );
+                data.normal_indices[out] = vec3ui(
+                    indices[i].normal_index,
+                    indices[i + 1].normal_index,
+                    indices[i + 2].normal_index
+                );
+                data.texcoord_indices[out] = vec3ui(
+                    indices[i].texcoord_index,
+                    indices[i + 1].texcoord_index,
+                    indices[i + 2].texcoord_index
+                );
+                // rapidobj marks faces without a material with -1
+                data.material_ids[out] = t < material_ids.size() && material_ids[t] >= 0
+                    ? static_cast<uint32_t>(material_ids[t])
+                    : UINT32_MAX;
+            }
+        });
+    });
 
-    // Fill vertices, normals, and texcoords
+    // Vertices, normals, and texcoords are tightly packed floats, so they are viewed in place
+    static_assert(sizeof(vec3f) == 3 * sizeof(float) && sizeof(vec2f) == 2 * sizeof(float));
+    views = {
+        .indices = data.indices,
+        .normal_indices = data.normal_indices,
+        .texcoord_indices = data.texcoord_indices,
+        .material_ids = data.material_ids,
+    };
+
+    // The cache keeps the materials as MTL text, it records the .mtl files so that editing them invalidates it
+    materials.clear();
+    for (const obj::Material& m : res.materials) {
+        materials.push_back({
+            .name = m.name,
+            .diffuse = vec3f(m.diffuse[0], m.diffuse[1], m.diffuse[2]),
+            .emission = vec3f(m.emission[0], m.emission[1], m.emission[2]),
+            .diffuse_map = m.diffuse_texname,
+            .emission_map = m.emissive_texname,
+        });
+    }
+    data.material_library = MtlLoader::serialize(materials);
+    views.materials = data.material_library;
     if ((config.loadFlags & LoadFlags::Vertices) == LoadFlags::Vertices) {
-        size_t n = res.attributes.positions.size();
-        data.vertices.resize(n / 3);
-        for (size_t i = 0; i < n; i += 3) {
-            data.vertices[i / 3] = vec3f(
-                res.attributes.positions[i],
-                res.attributes.positions[i + 1],
-                res.attributes.positions[i + 2]
-            );
-        }
+        views.vertices = std::span(reinterpret_cast<const vec3f*>(res.attributes.positions.data()), res.attributes.positions.size() / 3);
     }
-
     if ((config.loadFlags & LoadFlags::Normals) == LoadFlags::Normals) {
-        size_t n = res.attributes.normals.size();
-        data.normals.resize(n / 3);
-        for (size_t i = 0; i < n; i += 3) {
-            data.normals[i / 3] = vec3f(
-                res.attributes.normals[i],
-                res.attributes.normals[i + 1],
-                res.attributes.normals[i + 2]
-            );
-        }
+        views.normals = std::span(reinterpret_cast<const vec3f*>(res.attributes.normals.data()), res.attributes.normals.size() / 3);
     }
-
-    // Fill vertices, normals, and texcoords
     if ((config.loadFlags & LoadFlags::TexCoords) == LoadFlags::TexCoords) {
-        size_t n = res.attributes.texcoords.size();
-        data.texcoords.resize(n / 2);
-        for (size_t i = 0; i < n; i += 2) {
-            data.texcoords[i / 2] = vec2f(
-                res.attributes.texcoords[i],
-                res.attributes.texcoords[i + 1]
-            );
-        }
+        views.texcoords = std::span(reinterpret_cast<const vec2f*>(res.attributes.texcoords.data()), res.attributes.texcoords.size() / 2);
+    }
+
+    // Without any vn entries every normal index is invalid
+    const bool wants_normals = (config.loadFlags & LoadFlags::Normals) == LoadFlags::Normals;
+    if (wants_normals && views.normals.empty() && config.generate_normals && !views.vertices.empty()) {
+        spdlog::info("ObjLoader: {} has no normals, generating them", filename);
+        NormalGenerator::Result generated = NormalGenerator::generate(views.vertices, data.indices, config.crease_angle);
+        data.generated_normals = std::move(generated.normals);
+        data.normal_indices = std::move(generated.normal_indices);
+        views.normals = data.generated_normals;
+        views.normal_indices = data.normal_indices;
     }
 
     return true;
 }
 
+std::vector<size_t> ObjLoader::select_shapes(const obj::Shapes& shapes) const {
+    std::vector<size_t> selected;
+    if (config.meshes.empty() && config.mesh_names.empty()) {
+        selected.resize(shapes.size());
+        std::iota(selected.begin(), selected.end(), 0);
+        return selected;
+    }
+
+    for (size_t s = 0; s < shapes.size(); s++) {
+        const bool by_index = std::find(config.meshes.begin(), config.meshes.end(), s) != config.meshes.end();
+        const bool by_name = std::find(config.mesh_names.begin(), config.mesh_names.end(), shapes[s].name) != config.mesh_names.end();
+        if (by_index || by_name) {
+            selected.push_back(s);
+        }
+    }
+    for (uint32_t index : config.meshes) {
+        if (index >= shapes.size()) {
+            spdlog::warn("ObjLoader: Shape index {} out of range, the model has {} shapes", index, shapes.size());
+        }
+    }
+    for (const std::string& name : config.mesh_names) {
+        if (std::none_of(shapes.begin(), shapes.end(), [&](const obj::Shape& shape) { return shape.name == name; })) {
+            spdlog::warn("ObjLoader: No shape named {}", name);
+        }
+    }
+    return selected;
+}
+
 void ObjLoader::clear() {
     // Clear any loaded data
-    data.vertices.clear();
-    data.indices.clear();
+    views = {};
+    cache.close();
+    data = {};
+    result = {};
+    materials.clear();
 }
\ No newline at end of file
@@ -9,6 +9,9 @@
 #include <owl/common/math/vec.h>
 #include <rapidobj/rapidobj.hpp>
 
+#include "MeshCache.hpp"
+#include "MtlLoader.hpp"
+
 using namespace owl;
 namespace obj = rapidobj;
 
@@ -27,11 +30,21 @@ public:
         Indices,
         NormalIndices,
         TexCoordIndices,
+        MaterialIds,
     };
 
     struct Config {
+        // Shapes to load by index or name, everything when both are empty
         std::vector<uint32_t> meshes = {};
+        std::vector<std::string> mesh_names = {};
         LoadFlags loadFlags;
+        // Reuse or write a binary cache next to the model, partial loads are never cached
+        bool cache = true;
+        // Checksum the whole cache payload on open, touches every page of the mapping
+        bool verify_cache = false;
+        // Smooth normals for models without any, faces further apart than the crease angle stay sharp
+        bool generate_normals = true;
+        float crease_angle = 180.f;
     };
 
     ObjLoader(const Config& config);
@@ -43,50 +56,73 @@ public:
         switch(attribute) {
             case Attribute::Vertices:
                 if constexpr(std::is_same_v<T, vec3f>) {
-                    return std::span<const T>(data.vertices);
+                    return views.vertices;
                 }
                 break;
             case Attribute::Normals:
                 if constexpr(std::is_same_v<T, vec3f>) {
-                    return std::span<const T>(data.normals);
+                    return views.normals;
                 }
                 break;
             case Attribute::TexCoords:
                 if constexpr(std::is_same_v<T, vec2f>) {
-                    return std::span<const T>(data.texcoords);
+                    return views.texcoords;
                 }
                 break;
             case Attribute::Indices:
                 if constexpr(std::is_same_v<T, vec3ui>) {
-                    return std::span<const T>(data.indices);
+                    return views.indices;
                 }
                 break;
             case Attribute::NormalIndices:
                 if constexpr(std::is_same_v<T, vec3ui>) {
-                    return std::span<const T>(data.normal_indices);
+                    return views.normal_indices;
                 }
                 break;
             case Attribute::TexCoordIndices:
                 if constexpr(std::is_same_v<T, vec3ui>) {
-                    return std::span<const T>(data.texcoord_indices);
+                    return views.texcoord_indices;
+                }
+                break;
+            case Attribute::MaterialIds:
+                if constexpr(std::is_same_v<T, uint32_t>) {
+                    return views.material_ids;
                 }
                 break;
         }
         throw std::runtime_error("Invalid attribute type");
     }
 
+    const MeshCache::Views& get_views() const { return views; }
+    /**
+     * @brief Materials indexed by the material ids, texture paths are relative to the model.
+     */
+    const std::vector<MtlLoader::Material>& get_materials() const { return materials; }
+
     void clear();
 private:
     Config config;
 
+    // Flattened index streams, attributes are viewed directly in the parse result
     struct Data {
-        std::vector<vec3f> vertices;
         std::vector<vec3ui> indices;
-        std::vector<vec3f> normals;
         std::vector<vec3ui> normal_indices;
-        std::vector<vec2f> texcoords;
         std::vector<vec3ui> texcoord_indices;
+        std::vector<uint32_t> material_ids;
+        std::vector<vec3f> generated_normals;
+        std::string material_library;
     } data;
+    obj::Result result;
+    std::vector<MtlLoader::Material> materials;
+
+    // Point either into data and result or into the mapped cache
+    MeshCache cache;
+    MeshCache::Views views;
+
+    bool parse(const std::string& filename);
+    // Paths of the material libraries named by mtllib statements, relative to the working directory
+    static std::vector<std::string> material_libraries(const std::string& filename);
+    std::vector<size_t> select_shapes(const obj::Shapes& shapes) const;
 };
 
 inline ObjLoader::LoadFlags operator|(ObjLoader::LoadFlags lhs, ObjLoader::LoadFlags rhs) {
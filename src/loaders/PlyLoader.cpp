@@ -0,0 +1,487 @@
+/**
+* @file PlyLoader.cpp
+* @brief Implementation of the PlyLoader class for loading binary PLY files.
+*/
+
+#include "PlyLoader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string_view>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include "mesh/NormalGenerator.hpp"
+
+namespace {
+    enum class Type { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+    std::optional<Type> parse_type(const std::string& name) {
+        if (name == "char" || name == "int8") return Type::Int8;
+        if (name == "uchar" || name == "uint8") return Type::UInt8;
+        if (name == "short" || name == "int16") return Type::Int16;
+        if (name == "ushort" || name == "uint16") return Type::UInt16;
+        if (name == "int" || name == "int32") return Type::Int32;
+        if (name == "uint" || name == "uint32") return Type::UInt32;
+        if (name == "float" || name == "float32") return Type::Float32;
+        if (name == "double" || name == "float64") return Type::Float64;
+        return std::nullopt;
+    }
+
+    size_t type_size(Type type) {
+        switch (type) {
+            case Type::Int8: case Type::UInt8: return 1;
+            case Type::Int16: case Type::UInt16: return 2;
+            case Type::Int32: case Type::UInt32: case Type::Float32: return 4;
+            case Type::Float64: return 8;
+        }
+        return 0;
+    }
+
+    template<typename T>
+    T load(const std::byte* p, bool swap) {
+        std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, p, sizeof(T));
+        if (swap) std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    double read_double(const std::byte* p, Type type, bool swap) {
+        switch (type) {
+            case Type::Int8: return load<int8_t>(p, swap);
+            case Type::UInt8: return load<uint8_t>(p, swap);
+            case Type::Int16: return load<int16_t>(p, swap);
+            case Type::UInt16: return load<uint16_t>(p, swap);
+            case Type::Int32: return load<int32_t>(p, swap);
+            case Type::UInt32: return load<uint32_t>(p, swap);
+            case Type::Float32: return load<float>(p, swap);
+            case Type::Float64: return load<double>(p, swap);
+        }
+        return 0.0;
+    }
+
+    uint32_t read_uint(const std::byte* p, Type type, bool swap) {
+        switch (type) {
+            case Type::Int8: return static_cast<uint32_t>(load<int8_t>(p, swap));
+            case Type::UInt8: return load<uint8_t>(p, swap);
+            case Type::Int16: return static_cast<uint32_t>(load<int16_t>(p, swap));
+            case Type::UInt16: return load<uint16_t>(p, swap);
+            case Type::Int32: return static_cast<uint32_t>(load<int32_t>(p, swap));
+            case Type::UInt32: return load<uint32_t>(p, swap);
+            default: return static_cast<uint32_t>(read_double(p, type, swap));
+        }
+    }
+
+    struct Property {
+        std::string name;
+        Type type;
+        bool list = false;
+        Type count_type = Type::UInt8;
+    };
+
+    struct Element {
+        std::string name;
+        size_t count = 0;
+        std::vector<Property> properties;
+
+        // Zero when a list property makes records variable sized
+        size_t stride() const {
+            size_t size = 0;
+            for (const Property& p : properties) {
+                if (p.list) return 0;
+                size += type_size(p.type);
+            }
+            return size;
+        }
+
+        // Byte offset of a scalar property in a fixed size record
+        std::optional<size_t> offset_of(const std::string& property) const {
+            size_t offset = 0;
+            for (const Property& p : properties) {
+                if (p.name == property) return offset;
+                offset += type_size(p.type);
+            }
+            return std::nullopt;
+        }
+
+        std::optional<Type> type_of(const std::string& property) const {
+            for (const Property& p : properties) {
+                if (p.name == property) return p.type;
+            }
+            return std::nullopt;
+        }
+    };
+
+    // Whether count records of size bytes fit between p and end, without overflowing the product
+    bool fits(const std::byte* p, const std::byte* end, size_t count, size_t size) {
+        return p <= end && (size == 0 || count <= static_cast<size_t>(end - p) / size);
+    }
+
+    // Size of one variable record, and the vertex list inside it
+    struct Record {
+        size_t size;
+        const std::byte* list;
+        uint32_t list_count;
+    };
+
+    // Every read is checked against end, a truncated or corrupt record yields nullopt
+    std::optional<Record> walk_record(const std::byte* p, const std::byte* end, const Element& element, size_t list_property, bool swap) {
+        Record record = { 0, nullptr, 0 };
+        for (size_t i = 0; i < element.properties.size(); i++) {
+            const Property& prop = element.properties[i];
+            if (!prop.list) {
+                if (!fits(p + record.size, end, 1, type_size(prop.type))) return std::nullopt;
+                record.size += type_size(prop.type);
+                continue;
+            }
+            if (!fits(p + record.size, end, 1, type_size(prop.count_type))) return std::nullopt;
+            const uint32_t n = read_uint(p + record.size, prop.count_type, swap);
+            record.size += type_size(prop.count_type);
+            if (!fits(p + record.size, end, n, type_size(prop.type))) return std::nullopt;
+            if (i == list_property) {
+                record.list = p + record.size;
+                record.list_count = n;
+            }
+            record.size += n * type_size(prop.type);
+        }
+        return record;
+    }
+
+    uint32_t fan_triangles(uint32_t n) {
+        return n >= 3 ? n - 2 : 0;
+    }
+
+    struct Header {
+        bool swap = false;
+        size_t body = 0;
+        std::vector<Element> elements;
+    };
+
+    std::optional<Header> parse_header(std::span<const std::byte> bytes) {
+        static constexpr std::string_view END = "end_header";
+        const std::string_view text(reinterpret_cast<const char*>(bytes.data()), std::min<size_t>(bytes.size(), 1 << 20));
+        const size_t end = text.find(END);
+        if (!text.starts_with("ply") || end == std::string_view::npos) return std::nullopt;
+        const size_t newline = text.find('\n', end);
+        if (newline == std::string_view::npos) return std::nullopt;
+
+        Header header;
+        header.body = newline + 1;
+        std::istringstream lines{std::string(text.substr(0, end))};
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+            if (keyword == "format") {
+                std::string format;
+                words >> format;
+                if (format == "ascii") {
+                    spdlog::error("PlyLoader: ASCII PLY is not supported");
+                    return std::nullopt;
+                }
+                const bool big_endian = format == "binary_big_endian";
+                header.swap = big_endian != (std::endian::native == std::endian::big);
+            }
+            else if (keyword == "element") {
+                Element& element = header.elements.emplace_back();
+                words >> element.name >> element.count;
+            }
+            else if (keyword == "property" && !header.elements.empty()) {
+                Property prop;
+                std::string type;
+                words >> type;
+                if (type == "list") {
+                    std::string count_type;
+                    words >> count_type >> type;
+                    const std::optional<Type> count = parse_type(count_type);
+                    if (!count) return std::nullopt;
+                    prop.list = true;
+                    prop.count_type = *count;
+                }
+                const std::optional<Type> value = parse_type(type);
+                if (!value) return std::nullopt;
+                prop.type = *value;
+                words >> prop.name;
+                header.elements.back().properties.push_back(prop);
+            }
+        }
+        return header;
+    }
+}
+
+PlyLoader::PlyLoader(const Config& config)
+    : config(config) {}
+
+PlyLoader::~PlyLoader() {
+    clear();
+}
+
+bool PlyLoader::handles(const std::string& file_path) {
+    return file_path.substr(file_path.find_last_of('.') + 1) == "ply";
+}
+
+bool PlyLoader::load(const std::string& filename) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    clear();
+    spdlog::info("PlyLoader: Loading PLY file: {}", filename);
+    if (!file.open(filename)) {
+        spdlog::error("PlyLoader: Failed to map {}", filename);
+        return false;
+    }
+
+    const std::span<const std::byte> bytes = file.bytes();
+    const std::optional<Header> header = parse_header(bytes);
+    if (!header) {
+        spdlog::error("PlyLoader: Invalid or unsupported header in {}", filename);
+        clear();
+        return false;
+    }
+    const bool swap = header->swap;
+
+    // Elements other than vertex and face are skipped, they still have to be walked if records vary in size
+    const std::byte* p = bytes.data() + header->body;
+    const std::byte* const end = bytes.data() + bytes.size();
+    const Element* vertex = nullptr;
+    const Element* face = nullptr;
+    const std::byte* vertex_data = nullptr;
+    const std::byte* face_data = nullptr;
+    for (const Element& element : header->elements) {
+        if (element.name == "vertex") {
+            vertex = &element;
+            vertex_data = p;
+        }
+        else if (element.name == "face") {
+            face = &element;
+            face_data = p;
+            break;
+        }
+        const size_t stride = element.stride();
+        bool truncated = false;
+        if (stride > 0) {
+            truncated = !fits(p, end, element.count, stride);
+            if (!truncated) p += stride * element.count;
+        }
+        else {
+            for (size_t i = 0; i < element.count && !truncated; i++) {
+                const std::optional<Record> record = walk_record(p, end, element, SIZE_MAX, swap);
+                truncated = !record;
+                if (record) p += record->size;
+            }
+        }
+        if (truncated) {
+            // A vertex element that runs short is rejected below, later elements are unreachable
+            if (&element == vertex) vertex_data = nullptr;
+            break;
+        }
+    }
+    const size_t vertex_stride = vertex ? vertex->stride() : 0;
+    if (!vertex || !vertex_data || vertex_stride == 0 || !fits(vertex_data, end, vertex->count, vertex_stride)) {
+        spdlog::error("PlyLoader: {} has no readable vertex element", filename);
+        clear();
+        return false;
+    }
+
+    // Vertices
+    const std::optional<size_t> x = vertex->offset_of("x");
+    const std::optional<size_t> y = vertex->offset_of("y");
+    const std::optional<size_t> z = vertex->offset_of("z");
+    if (!x || !y || !z) {
+        spdlog::error("PlyLoader: {} has no vertex positions", filename);
+        clear();
+        return false;
+    }
+    const Type position_type = *vertex->type_of("x");
+    const bool in_place = !swap && vertex_stride == sizeof(vec3f) && *x == 0 && *y == 4 && *z == 8
+        && position_type == Type::Float32 && *vertex->type_of("y") == Type::Float32 && *vertex->type_of("z") == Type::Float32
+        && reinterpret_cast<uintptr_t>(vertex_data) % alignof(float) == 0;
+
+    auto read_vec3 = [&](const std::byte* v, size_t ox, size_t oy, size_t oz, Type tx, Type ty, Type tz) {
+        return vec3f(static_cast<float>(read_double(v + ox, tx, swap)), static_cast<float>(read_double(v + oy, ty, swap)),
+                     static_cast<float>(read_double(v + oz, tz, swap)));
+    };
+
+    if (in_place) {
+        views.vertices = std::span(reinterpret_cast<const vec3f*>(vertex_data), vertex->count);
+    }
+    else {
+        const Type ty = *vertex->type_of("y");
+        const Type tz = *vertex->type_of("z");
+        data.positions.resize(vertex->count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, vertex->count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                data.positions[i] = read_vec3(vertex_data + i * vertex_stride, *x, *y, *z, position_type, ty, tz);
+            }
+        });
+        views.vertices = data.positions;
+    }
+
+    const std::optional<size_t> nx = vertex->offset_of("nx");
+    const std::optional<size_t> ny = vertex->offset_of("ny");
+    const std::optional<size_t> nz = vertex->offset_of("nz");
+    if (nx && ny && nz) {
+        const Type tx = *vertex->type_of("nx");
+        const Type ty = *vertex->type_of("ny");
+        const Type tz = *vertex->type_of("nz");
+        data.normals.resize(vertex->count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, vertex->count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                data.normals[i] = read_vec3(vertex_data + i * vertex_stride, *nx, *ny, *nz, tx, ty, tz);
+            }
+        });
+        views.normals = data.normals;
+    }
+
+    // Texcoords go by several names
+    for (const auto& [u_name, v_name] : { std::pair{"u", "v"}, std::pair{"s", "t"}, std::pair{"texture_u", "texture_v"} }) {
+        const std::optional<size_t> u = vertex->offset_of(u_name);
+        const std::optional<size_t> v = vertex->offset_of(v_name);
+        if (!u || !v) continue;
+        const Type tu = *vertex->type_of(u_name);
+        const Type tv = *vertex->type_of(v_name);
+        data.texcoords.resize(vertex->count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, vertex->count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                const std::byte* record = vertex_data + i * vertex_stride;
+                data.texcoords[i] = vec2f(static_cast<float>(read_double(record + *u, tu, swap)),
+                                          static_cast<float>(read_double(record + *v, tv, swap)));
+            }
+        });
+        views.texcoords = data.texcoords;
+        break;
+    }
+
+    // Faces
+    size_t list_property = SIZE_MAX;
+    if (face) {
+        for (size_t i = 0; i < face->properties.size(); i++) {
+            const Property& prop = face->properties[i];
+            if (prop.list && (prop.name == "vertex_indices" || prop.name == "vertex_index")) list_property = i;
+        }
+    }
+    if (!face || list_property == SIZE_MAX) {
+        spdlog::error("PlyLoader: {} has no face vertex indices", filename);
+        clear();
+        return false;
+    }
+
+    const Property& list = face->properties[list_property];
+    const size_t index_size = type_size(list.type);
+    const size_t num_faces = face->count;
+
+    // A single list of triangles has a fixed record size, check every count in parallel
+    const size_t triangle_record = type_size(list.count_type) + 3 * index_size;
+    const bool only_list = face->properties.size() == 1;
+    const bool all_triangles = only_list && fits(face_data, end, num_faces, triangle_record)
+        && tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_faces), true,
+            [&](const tbb::blocked_range<size_t>& r, bool ok) {
+                for (size_t f = r.begin(); f < r.end() && ok; f++) {
+                    ok = read_uint(face_data + f * triangle_record, list.count_type, swap) == 3;
+                }
+                return ok;
+            },
+            [](bool a, bool b) { return a && b; });
+
+    if (all_triangles) {
+        const size_t count_size = type_size(list.count_type);
+        data.indices.resize(num_faces);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_faces), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t f = r.begin(); f < r.end(); f++) {
+                const std::byte* i = face_data + f * triangle_record + count_size;
+                data.indices[f] = vec3ui(read_uint(i, list.type, swap), read_uint(i + index_size, list.type, swap),
+                                         read_uint(i + 2 * index_size, list.type, swap));
+            }
+        });
+    }
+    else {
+        // Mixed face sizes, record where every chunk starts and how many triangles precede it
+        constexpr size_t CHUNK = 4096;
+        const size_t num_chunks = (num_faces + CHUNK - 1) / CHUNK;
+        std::vector<const std::byte*> chunk_data(num_chunks);
+        std::vector<size_t> chunk_triangles(num_chunks + 1, 0);
+        const std::byte* q = face_data;
+        for (size_t f = 0; f < num_faces; f++) {
+            if (f % CHUNK == 0) {
+                chunk_data[f / CHUNK] = q;
+                chunk_triangles[f / CHUNK + 1] = chunk_triangles[f / CHUNK];
+            }
+            const std::optional<Record> record = walk_record(q, end, *face, list_property, swap);
+            if (!record) {
+                spdlog::error("PlyLoader: {} is truncated", filename);
+                clear();
+                return false;
+            }
+            chunk_triangles[f / CHUNK + 1] += fan_triangles(record->list_count);
+            q += record->size;
+        }
+
+        data.indices.resize(chunk_triangles[num_chunks]);
+        tbb::parallel_for(size_t(0), num_chunks, [&](size_t c) {
+            const std::byte* record_data = chunk_data[c];
+            size_t t = chunk_triangles[c];
+            const size_t last = std::min(num_faces, (c + 1) * CHUNK);
+            for (size_t f = c * CHUNK; f < last; f++) {
+                // Every record was validated by the scan above
+                const Record record = *walk_record(record_data, end, *face, list_property, swap);
+                const uint32_t first = record.list_count > 0 ? read_uint(record.list, list.type, swap) : 0;
+                for (uint32_t k = 1; k + 1 < record.list_count; k++) {
+                    data.indices[t++] = vec3ui(first, read_uint(record.list + k * index_size, list.type, swap),
+                                               read_uint(record.list + (k + 1) * index_size, list.type, swap));
+                }
+                record_data += record.size;
+            }
+        });
+    }
+    views.indices = data.indices;
+
+    // Out of range indices would read past the vertex buffer on the device
+    const size_t num_vertices = views.vertices.size();
+    const bool valid = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, data.indices.size()), true,
+        [&](const tbb::blocked_range<size_t>& r, bool ok) {
+            for (size_t t = r.begin(); t < r.end() && ok; t++) {
+                const vec3ui& i = data.indices[t];
+                ok = i.x < num_vertices && i.y < num_vertices && i.z < num_vertices;
+            }
+            return ok;
+        },
+        [](bool a, bool b) { return a && b; });
+    if (!valid) {
+        spdlog::error("PlyLoader: {} has face indices out of range", filename);
+        clear();
+        return false;
+    }
+
+    if (views.normals.empty() && config.generate_normals) {
+        NormalGenerator::Result generated = NormalGenerator::generate(views.vertices, views.indices, config.crease_angle);
+        data.normals = std::move(generated.normals);
+        data.normal_indices = std::move(generated.normal_indices);
+        views.normals = data.normals;
+        views.normal_indices = data.normal_indices;
+    }
+    else {
+        views.normal_indices = views.normals.empty() ? std::span<const vec3ui>() : views.indices;
+    }
+    views.texcoord_indices = views.texcoords.empty() ? std::span<const vec3ui>() : views.indices;
+
+    const auto finish = std::chrono::high_resolution_clock::now();
+    spdlog::info("PlyLoader: Loaded {} vertices{}, {} faces as {} triangles in {:.2f} ms", num_vertices,
+                 in_place ? " in place" : "", num_faces, data.indices.size(),
+                 std::chrono::duration<double, std::milli>(finish - start).count());
+    return true;
+}
+
+void PlyLoader::clear() {
+    data = {};
+    views = {};
+    file.close();
+}
@@ -0,0 +1,61 @@
+/**
+* @file PlyLoader.hpp
+* @brief Memory mapped binary PLY loader for large scanned meshes.
+* @details The header is parsed as text and the body is read straight from the mapping. Vertex positions
+* that are little endian floats with nothing between them are viewed in place, any other vertex layout is
+* converted in parallel. Faces of any size are fan triangulated. When every face is a triangle with a
+* fixed record size they are converted in parallel directly; otherwise one sequential pass records the
+* byte offset and triangle count of every chunk and the chunks are converted in parallel.
+*/
+
+#pragma once
+
+#ifndef PLYLOADER_HPP
+#define PLYLOADER_HPP
+
+#include <string>
+#include <vector>
+
+#include <owl/common/math/vec.h>
+
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+
+using namespace owl;
+
+class PlyLoader {
+public:
+    struct Config {
+        // Smooth normals for scans without any, faces further apart than the crease angle stay sharp
+        bool generate_normals = true;
+        float crease_angle = 180.f;
+    };
+
+    PlyLoader(const Config& config);
+    ~PlyLoader();
+
+    static bool handles(const std::string& file_path);
+
+    bool load(const std::string& filename);
+    void clear();
+
+    /**
+     * @brief Single indexed views, normal and texcoord indices alias the position indices unless
+     * normals were generated with creases.
+     */
+    const MeshCache::Views& get_views() const { return views; }
+private:
+    Config config;
+    MappedFile file;
+
+    struct Data {
+        std::vector<vec3f> positions;
+        std::vector<vec3f> normals;
+        std::vector<vec2f> texcoords;
+        std::vector<vec3ui> indices;
+        std::vector<vec3ui> normal_indices;
+    } data;
+    MeshCache::Views views;
+};
+
+#endif //PLYLOADER_HPP
@@ -0,0 +1,421 @@
+/**
+* @file TexelCodec.cpp
+* @brief Implementation of the TexelCodec class.
+*/
+
+#include "TexelCodec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+using Trace::TexelFormat;
+
+namespace {
+    constexpr float HALF_MAX = 65504.f;
+
+    // Round to nearest even, values past HALF_MAX must be clamped by the caller
+    uint16_t float_to_half(float f) {
+        uint32_t x = std::bit_cast<uint32_t>(f);
+        const uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+        x &= 0x7fffffff;
+        if (x >= 0x7f800000) return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+        if (x < 0x38800000) {
+            // Half subnormals and zero
+            if (x < 0x33000000) return sign;
+            const uint32_t shift = 126 - (x >> 23);
+            const uint32_t m = (x & 0x7fffff) | 0x800000;
+            uint32_t h = m >> shift;
+            const uint32_t rest = m & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (h & 1))) h++;
+            return sign | static_cast<uint16_t>(h);
+        }
+        uint32_t h = (x - 0x38000000) >> 13;
+        const uint32_t rest = x & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+        return sign | static_cast<uint16_t>(std::min(h, 0x7c00u));
+    }
+
+    float half_to_float(uint16_t h) {
+        const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        const uint32_t exponent = (h >> 10) & 0x1f;
+        const uint32_t mantissa = h & 0x3ff;
+        if (exponent == 0) {
+            const float f = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign ? -f : f;
+        }
+        if (exponent == 31) return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    float clamp_channel(float f, float max) {
+        return f > 0.f ? std::min(f, max) : 0.f;
+    }
+
+    uint32_t encode_rgb9e5(const float* rgb) {
+        const float r = clamp_channel(rgb[0], Trace::RGB9E5_MAX);
+        const float g = clamp_channel(rgb[1], Trace::RGB9E5_MAX);
+        const float b = clamp_channel(rgb[2], Trace::RGB9E5_MAX);
+        const float max_channel = std::max({ r, g, b });
+        int exponent = std::max(-16, static_cast<int>(std::floor(std::log2(std::max(max_channel, 1e-30f))))) + 1 + 15;
+        if (std::floor(max_channel / std::ldexp(1.f, exponent - 15 - 9) + 0.5f) == 512.f) exponent++;
+        const float scale = std::ldexp(1.f, exponent - 15 - 9);
+        const auto mantissa = [&](float c) { return static_cast<uint32_t>(std::floor(c / scale + 0.5f)); };
+        return mantissa(r) | mantissa(g) << 9 | mantissa(b) << 18 | static_cast<uint32_t>(exponent) << 27;
+    }
+
+    /* BC6H mode 11: 5 mode bits, two 10-bit RGB endpoints and 16 indices of 4 bits, the first one 3 bits */
+    constexpr std::array<int, 16> BC6H_WEIGHTS = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    constexpr uint32_t BC6H_MODE_11 = 0x03;
+
+    int bc6h_unquantize(int q) {
+        if (q == 0) return 0;
+        if (q == 1023) return 0xffff;
+        return ((q << 16) + 0x8000) >> 10;
+    }
+
+    int bc6h_quantize(float x) {
+        const int q = std::clamp(static_cast<int>(x / 64.f), 0, 1022);
+        return std::abs(bc6h_unquantize(q + 1) - x) < std::abs(bc6h_unquantize(q) - x) ? q + 1 : q;
+    }
+
+    // Interpolation happens on unquantized endpoints, the result is scaled to half float bits
+    int bc6h_interpolate(int a, int b, int weight) {
+        return (a * (64 - weight) + b * weight + 32) >> 6;
+    }
+
+    struct BitWriter {
+        std::array<uint64_t, 2> words = {};
+        int position = 0;
+
+        void write(uint32_t value, int bits) {
+            for (int i = 0; i < bits; i++, position++) {
+                words[position >> 6] |= static_cast<uint64_t>((value >> i) & 1) << (position & 63);
+            }
+        }
+    };
+
+    struct BitReader {
+        std::array<uint64_t, 2> words;
+        int position = 0;
+
+        uint32_t read(int bits) {
+            uint32_t value = 0;
+            for (int i = 0; i < bits; i++, position++) {
+                value |= static_cast<uint32_t>((words[position >> 6] >> (position & 63)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    struct Bc6hFit {
+        std::array<vec3i, 2> endpoints;
+        std::array<int, 16> indices;
+        float error;
+    };
+
+    // Picks the closest palette entry of every texel for quantized endpoints
+    Bc6hFit bc6h_assign(const std::array<vec3f, 16>& texels, const vec3i& q0, const vec3i& q1) {
+        const vec3i u0(bc6h_unquantize(q0.x), bc6h_unquantize(q0.y), bc6h_unquantize(q0.z));
+        const vec3i u1(bc6h_unquantize(q1.x), bc6h_unquantize(q1.y), bc6h_unquantize(q1.z));
+        std::array<vec3f, 16> palette;
+        for (int i = 0; i < 16; i++) {
+            palette[i] = vec3f(
+                static_cast<float>(bc6h_interpolate(u0.x, u1.x, BC6H_WEIGHTS[i])),
+                static_cast<float>(bc6h_interpolate(u0.y, u1.y, BC6H_WEIGHTS[i])),
+                static_cast<float>(bc6h_interpolate(u0.z, u1.z, BC6H_WEIGHTS[i]))
+            );
+        }
+        Bc6hFit fit { { q0, q1 }, {}, 0.f };
+        for (int t = 0; t < 16; t++) {
+            float best = INFINITY;
+            for (int i = 0; i < 16; i++) {
+                const vec3f d = palette[i] - texels[t];
+                const float e = dot(d, d);
+                if (e < best) {
+                    best = e;
+                    fit.indices[t] = i;
+                }
+            }
+            fit.error += best;
+        }
+        return fit;
+    }
+
+    vec3i bc6h_quantize(const vec3f& endpoint) {
+        return vec3i(bc6h_quantize(endpoint.x), bc6h_quantize(endpoint.y), bc6h_quantize(endpoint.z));
+    }
+
+    /**
+     * @brief Fits the endpoints to the principal axis of the block, then refines them once by least squares.
+     * Texels are in the unquantized domain, half float bits scaled by 64 / 31.
+     */
+    std::array<uint64_t, 2> encode_bc6h_block(const std::array<vec3f, 16>& texels) {
+        vec3f mean(0.f);
+        for (const vec3f& t : texels) mean += t;
+        mean /= 16.f;
+
+        float cov[6] = {};
+        for (const vec3f& t : texels) {
+            const vec3f d = t - mean;
+            cov[0] += d.x * d.x; cov[1] += d.x * d.y; cov[2] += d.x * d.z;
+            cov[3] += d.y * d.y; cov[4] += d.y * d.z; cov[5] += d.z * d.z;
+        }
+        vec3f axis(1.f);
+        for (int i = 0; i < 8; i++) {
+            axis = vec3f(
+                cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+                cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+                cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z
+            );
+            const float len = length(axis);
+            if (!(len > 0.f)) {
+                axis = vec3f(1.f);
+                break;
+            }
+            axis /= len;
+        }
+
+        float t_min = INFINITY;
+        float t_max = -INFINITY;
+        for (const vec3f& t : texels) {
+            const float s = dot(t - mean, axis);
+            t_min = std::min(t_min, s);
+            t_max = std::max(t_max, s);
+        }
+        const auto clamp_endpoint = [](const vec3f& e) {
+            return vec3f(std::clamp(e.x, 0.f, 65535.f), std::clamp(e.y, 0.f, 65535.f), std::clamp(e.z, 0.f, 65535.f));
+        };
+        Bc6hFit fit = bc6h_assign(texels, bc6h_quantize(clamp_endpoint(mean + t_min * axis)),
+                                  bc6h_quantize(clamp_endpoint(mean + t_max * axis)));
+
+        // Least squares endpoints for the chosen weights
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        vec3f ax(0.f), bx(0.f);
+        for (int t = 0; t < 16; t++) {
+            const float w = BC6H_WEIGHTS[fit.indices[t]] / 64.f;
+            aa += (1.f - w) * (1.f - w);
+            ab += (1.f - w) * w;
+            bb += w * w;
+            ax += (1.f - w) * texels[t];
+            bx += w * texels[t];
+        }
+        const float det = aa * bb - ab * ab;
+        if (std::abs(det) > 1e-6f) {
+            const vec3f e0 = clamp_endpoint((bb * ax - ab * bx) / det);
+            const vec3f e1 = clamp_endpoint((aa * bx - ab * ax) / det);
+            const Bc6hFit refined = bc6h_assign(texels, bc6h_quantize(e0), bc6h_quantize(e1));
+            if (refined.error < fit.error) fit = refined;
+        }
+
+        // The first index drops its top bit, swapping the endpoints mirrors every index
+        if (fit.indices[0] >= 8) {
+            std::swap(fit.endpoints[0], fit.endpoints[1]);
+            for (int& index : fit.indices) index = 15 - index;
+        }
+        BitWriter writer;
+        writer.write(BC6H_MODE_11, 5);
+        for (const vec3i& e : fit.endpoints) {
+            writer.write(e.x, 10);
+            writer.write(e.y, 10);
+            writer.write(e.z, 10);
+        }
+        writer.write(fit.indices[0], 3);
+        for (int t = 1; t < 16; t++) writer.write(fit.indices[t], 4);
+        return writer.words;
+    }
+
+    std::array<vec3f, 16> decode_bc6h_block(const std::array<uint64_t, 2>& words) {
+        std::array<vec3f, 16> texels = {};
+        BitReader reader { words };
+        if (reader.read(5) != BC6H_MODE_11) return texels;
+        std::array<vec3i, 2> endpoints;
+        for (vec3i& e : endpoints) {
+            e.x = bc6h_unquantize(reader.read(10));
+            e.y = bc6h_unquantize(reader.read(10));
+            e.z = bc6h_unquantize(reader.read(10));
+        }
+        for (int t = 0; t < 16; t++) {
+            const int weight = BC6H_WEIGHTS[reader.read(t == 0 ? 3 : 4)];
+            const auto finish = [&](int a, int b) {
+                return half_to_float(static_cast<uint16_t>((bc6h_interpolate(a, b, weight) * 31) >> 6));
+            };
+            texels[t] = vec3f(
+                finish(endpoints[0].x, endpoints[1].x),
+                finish(endpoints[0].y, endpoints[1].y),
+                finish(endpoints[0].z, endpoints[1].z)
+            );
+        }
+        return texels;
+    }
+}
+
+size_t TexelCodec::Image::row_pitch() const {
+    return format == TexelFormat::BC6H ? (stored_width / 4) * 16 : stored_width * bytes_per_texel(format);
+}
+
+size_t TexelCodec::Image::rows() const {
+    return format == TexelFormat::BC6H ? stored_height / 4 : stored_height;
+}
+
+std::optional<TexelFormat> TexelCodec::parse(const std::string& name) {
+    for (const TexelFormat format : { TexelFormat::RGBA32F, TexelFormat::RGBA16F, TexelFormat::RGB9E5, TexelFormat::BC6H }) {
+        std::string lower = TexelCodec::name(format);
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (name == TexelCodec::name(format) || name == lower) return format;
+    }
+    return std::nullopt;
+}
+
+const char* TexelCodec::name(TexelFormat format) {
+    switch (format) {
+        case TexelFormat::RGBA32F: return "RGBA32F";
+        case TexelFormat::RGBA16F: return "RGBA16F";
+        case TexelFormat::RGB9E5: return "RGB9E5";
+        case TexelFormat::BC6H: return "BC6H";
+    }
+    return "unknown";
+}
+
+// BC6H is one byte per texel on average
+size_t TexelCodec::bytes_per_texel(TexelFormat format) {
+    switch (format) {
+        case TexelFormat::RGBA32F: return 16;
+        case TexelFormat::RGBA16F: return 8;
+        case TexelFormat::RGB9E5: return 4;
+        case TexelFormat::BC6H: return 1;
+    }
+    return 0;
+}
+
+TexelCodec::Image TexelCodec::encode(const float* rgba, int width, int height, TexelFormat format) {
+    Image image;
+    image.format = format;
+    image.width = width;
+    image.height = height;
+    image.stored_width = format == TexelFormat::BC6H ? (width + 3) & ~3 : width;
+    image.stored_height = format == TexelFormat::BC6H ? (height + 3) & ~3 : height;
+    image.data.resize(image.row_pitch() * image.rows());
+    std::byte* out = image.data.data();
+    const size_t row_pitch = image.row_pitch();
+
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, image.rows()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t row = r.begin(); row < r.end(); row++) {
+            std::byte* dst = out + row * row_pitch;
+            const float* src = rgba + 4 * row * width;
+            switch (format) {
+                case TexelFormat::RGBA32F:
+                    std::memcpy(dst, src, row_pitch);
+                    break;
+                case TexelFormat::RGBA16F:
+                    for (int i = 0; i < 4 * width; i++) {
+                        const uint16_t h = float_to_half(clamp_channel(src[i], HALF_MAX));
+                        std::memcpy(dst + 2 * i, &h, sizeof(h));
+                    }
+                    break;
+                case TexelFormat::RGB9E5:
+                    for (int x = 0; x < width; x++) {
+                        const uint32_t texel = encode_rgb9e5(src + 4 * x);
+                        std::memcpy(dst + 4 * x, &texel, sizeof(texel));
+                    }
+                    break;
+                case TexelFormat::BC6H:
+                    for (int bx = 0; bx < image.stored_width / 4; bx++) {
+                        std::array<vec3f, 16> texels;
+                        for (int t = 0; t < 16; t++) {
+                            const int x = std::min(4 * bx + t % 4, width - 1);
+                            const int y = std::min(static_cast<int>(4 * row) + t / 4, height - 1);
+                            const float* p = rgba + 4 * (static_cast<size_t>(y) * width + x);
+                            for (int c = 0; c < 3; c++) {
+                                texels[t][c] = float_to_half(clamp_channel(p[c], HALF_MAX)) * (64.f / 31.f);
+                            }
+                        }
+                        const std::array<uint64_t, 2> block = encode_bc6h_block(texels);
+                        std::memcpy(dst + 16 * bx, block.data(), 16);
+                    }
+                    break;
+            }
+        }
+    });
+    return image;
+}
+
+std::vector<vec4f> TexelCodec::decode(const Image& image) {
+    std::vector<vec4f> texels(static_cast<size_t>(image.width) * image.height);
+    const size_t row_pitch = image.row_pitch();
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, image.rows()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t row = r.begin(); row < r.end(); row++) {
+            const std::byte* src = image.data.data() + row * row_pitch;
+            vec4f* dst = texels.data() + row * image.width;
+            switch (image.format) {
+                case TexelFormat::RGBA32F:
+                    std::memcpy(dst, src, image.width * sizeof(vec4f));
+                    break;
+                case TexelFormat::RGBA16F:
+                    for (int x = 0; x < image.width; x++) {
+                        uint16_t h[4];
+                        std::memcpy(h, src + 8 * x, sizeof(h));
+                        dst[x] = vec4f(half_to_float(h[0]), half_to_float(h[1]), half_to_float(h[2]), half_to_float(h[3]));
+                    }
+                    break;
+                case TexelFormat::RGB9E5:
+                    for (int x = 0; x < image.width; x++) {
+                        uint32_t texel;
+                        std::memcpy(&texel, src + 4 * x, sizeof(texel));
+                        dst[x] = vec4f(Trace::decode_rgb9e5(texel), 1.f);
+                    }
+                    break;
+                case TexelFormat::BC6H:
+                    for (int bx = 0; bx < image.stored_width / 4; bx++) {
+                        std::array<uint64_t, 2> words;
+                        std::memcpy(words.data(), src + 16 * bx, 16);
+                        const std::array<vec3f, 16> block = decode_bc6h_block(words);
+                        for (int t = 0; t < 16; t++) {
+                            const int x = 4 * bx + t % 4;
+                            const size_t y = 4 * row + t / 4;
+                            if (x < image.width && y < static_cast<size_t>(image.height)) {
+                                texels[y * image.width + x] = vec4f(block[t], 1.f);
+                            }
+                        }
+                    }
+                    break;
+            }
+        }
+    });
+    return texels;
+}
+
+TexelCodec::Error TexelCodec::measure(const float* rgba, const Image& image) {
+    const std::vector<vec4f> decoded = decode(image);
+    struct Sums {
+        double squared = 0.0;
+        double relative = 0.0;
+    };
+    const Sums sums = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, decoded.size()), Sums(),
+        [&](const tbb::blocked_range<size_t>& r, Sums s) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                for (int c = 0; c < 3; c++) {
+                    const double source = rgba[4 * i + c];
+                    const double d = decoded[i][c] - source;
+                    s.squared += d * d;
+                    s.relative += std::abs(d) / std::max(std::abs(source), 1e-3);
+                }
+            }
+            return s;
+        },
+        [](Sums a, const Sums& b) {
+            a.squared += b.squared;
+            a.relative += b.relative;
+            return a;
+        });
+    const double count = 3.0 * std::max<size_t>(decoded.size(), 1);
+    return { std::sqrt(sums.squared / count), sums.relative / count };
+}
@@ -0,0 +1,60 @@
+/**
+* @file TexelCodec.hpp
+* @brief Host encoders and decoders for the compact float texture formats.
+* @details Encoding runs in parallel over rows, or rows of blocks for BC6H. Values beyond what a format
+* holds are clamped, negative values become zero. BC6H is encoded with one region and 10-bit endpoints
+* (mode 11) fitted along the principal axis of each block, and the decoder only reads that mode.
+* The decoders give the CPU the same texels the texture unit sees, minus filtering.
+*/
+
+#pragma once
+
+#ifndef TEXELCODEC_HPP
+#define TEXELCODEC_HPP
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <owl/common/math/vec.h>
+
+#include "trace/TexelFormat.hpp"
+
+using namespace owl;
+
+class TexelCodec {
+public:
+    struct Image {
+        Trace::TexelFormat format = Trace::TexelFormat::RGBA32F;
+        int width = 0;
+        int height = 0;
+        // BC6H rounds up to whole blocks, the padding repeats the edge texels
+        int stored_width = 0;
+        int stored_height = 0;
+        std::vector<std::byte> data;
+
+        // Bytes per row of texels, or per row of blocks for BC6H
+        size_t row_pitch() const;
+        size_t rows() const;
+    };
+
+    struct Error {
+        double rmse = 0.0;
+        // Per channel, relative to the source value or 1e-3 when it is smaller
+        double mean_relative = 0.0;
+    };
+
+    static std::optional<Trace::TexelFormat> parse(const std::string& name);
+    static const char* name(Trace::TexelFormat format);
+    static size_t bytes_per_texel(Trace::TexelFormat format);
+
+    /**
+     * @brief Encodes RGBA float texels, alpha is dropped by every format but RGBA32F and RGBA16F.
+     */
+    static Image encode(const float* rgba, int width, int height, Trace::TexelFormat format);
+    static std::vector<vec4f> decode(const Image& image);
+    static Error measure(const float* rgba, const Image& image);
+};
+
+#endif //TEXELCODEC_HPP
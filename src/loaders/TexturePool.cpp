@@ -0,0 +1,80 @@
+/**
+* @file TexturePool.cpp
+* @brief Implementation of the TexturePool class.
+*/
+
+#include "TexturePool.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include "stb_image.h"
+
+namespace {
+    void store(TexturePool::Image& image, stbi_uc* data, int width, int height) {
+        if (!data) {
+            spdlog::error("TexturePool: Failed to decode {}: {}", image.name, stbi_failure_reason());
+            return;
+        }
+        image.width = width;
+        image.height = height;
+        image.pixels.assign(data, data + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(data);
+    }
+}
+
+TexturePool::~TexturePool() {
+    tasks.wait();
+}
+
+template<typename Decode>
+uint32_t TexturePool::find_or_add(const std::string& key, Decode&& decode) {
+    std::lock_guard lock(mutex);
+    if (requests++ == 0) {
+        start = std::chrono::high_resolution_clock::now();
+    }
+    const auto [it, inserted] = indices.try_emplace(key, static_cast<uint32_t>(images.size()));
+    if (inserted) {
+        Image& image = images.emplace_back();
+        image.name = key;
+        tasks.run([this, &image, decode = std::forward<Decode>(decode)] {
+            decode(image);
+            std::lock_guard lock(mutex);
+            last_decoded = std::max(last_decoded, std::chrono::high_resolution_clock::now());
+        });
+    }
+    return it->second;
+}
+
+uint32_t TexturePool::request(const std::string& file_path) {
+    std::error_code ec;
+    const std::filesystem::path canonical = std::filesystem::weakly_canonical(file_path, ec);
+    return find_or_add(ec ? file_path : canonical.string(), [](Image& image) {
+        int width, height, channels;
+        stbi_uc* data = stbi_load(image.name.c_str(), &width, &height, &channels, 4);
+        store(image, data, width, height);
+    });
+}
+
+uint32_t TexturePool::request(const std::string& key, std::span<const std::byte> encoded) {
+    if (encoded.size() > INT_MAX) {
+        spdlog::error("TexturePool: Embedded image {} is too large", key);
+        encoded = {};
+    }
+    return find_or_add(key, [bytes = std::vector<std::byte>(encoded.begin(), encoded.end())](Image& image) {
+        int width, height, channels;
+        stbi_uc* data = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()),
+                                              static_cast<int>(bytes.size()), &width, &height, &channels, 4);
+        store(image, data, width, height);
+    });
+}
+
+const std::deque<TexturePool::Image>& TexturePool::wait() {
+    tasks.wait();
+    if (!images.empty()) {
+        elapsed_ms = std::chrono::duration<double, std::milli>(last_decoded - start).count();
+    }
+    return images;
+}
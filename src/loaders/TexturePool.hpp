@@ -0,0 +1,71 @@
+/**
+* @file TexturePool.hpp
+* @brief Decodes the textures of a scene on the task pool while the geometry is still loading.
+* @details Every file is decoded once however many materials reference it, requests are keyed by the
+* canonical path so different spellings of one file share the decode. Images embedded in a model are
+* keyed by the caller. Requests may come from any thread and return the texture index right away, the
+* pixels are ready after wait(). Images are decoded to 8-bit RGBA and stay sRGB encoded.
+*/
+
+#pragma once
+
+#ifndef TEXTUREPOOL_HPP
+#define TEXTUREPOOL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <tbb/task_group.h>
+
+class TexturePool {
+public:
+    struct Image {
+        std::string name;
+        int width = 0;
+        int height = 0;
+        // Empty when the image could not be decoded
+        std::vector<uint8_t> pixels;
+    };
+
+    TexturePool() = default;
+    ~TexturePool();
+
+    uint32_t request(const std::string& file_path);
+    /**
+     * @brief Encoded image bytes, copied so the caller may release them before the decode runs.
+     */
+    uint32_t request(const std::string& key, std::span<const std::byte> encoded);
+
+    /**
+     * @brief Blocks until every requested image is decoded.
+     */
+    const std::deque<Image>& wait();
+
+    size_t num_requests() const { return requests; }
+    size_t num_images() const { return images.size(); }
+    // From the first request to the end of the last decode
+    double decode_ms() const { return elapsed_ms; }
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, uint32_t> indices;
+    // Decodes hold references into it, a deque never moves its elements
+    std::deque<Image> images;
+    size_t requests = 0;
+    tbb::task_group tasks;
+    std::chrono::high_resolution_clock::time_point start;
+    std::chrono::high_resolution_clock::time_point last_decoded;
+    double elapsed_ms = 0.0;
+
+    // Index of the image for key, decode is only started when the key is new
+    template<typename Decode>
+    uint32_t find_or_add(const std::string& key, Decode&& decode);
+};
+
+#endif //TEXTUREPOOL_HPP
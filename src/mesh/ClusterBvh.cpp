@@ -0,0 +1,98 @@
+/**
+* @file ClusterBvh.cpp
+* @brief Implementation of the ClusterBvh class.
+*/
+
+#include "ClusterBvh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace {
+    constexpr uint32_t LEAF_SIZE = 4;
+
+    // The box corner furthest along the normal decides if the box is fully outside
+    bool outside(const box3f& box, const vec3f& eye, const vec3f& normal) {
+        const vec3f p(normal.x >= 0.f ? box.upper.x : box.lower.x,
+                      normal.y >= 0.f ? box.upper.y : box.lower.y,
+                      normal.z >= 0.f ? box.upper.z : box.lower.z);
+        return dot(normal, p - eye) < 0.f;
+    }
+}
+
+void ClusterBvh::build(std::span<const box3f> bounds) {
+    leaves.assign(bounds.begin(), bounds.end());
+    order.resize(bounds.size());
+    std::iota(order.begin(), order.end(), 0u);
+    nodes.clear();
+    if (bounds.empty()) return;
+    nodes.reserve(2 * bounds.size() / LEAF_SIZE + 1);
+    nodes.emplace_back();
+    build_node(0, 0, static_cast<uint32_t>(bounds.size()));
+}
+
+// Median split on the longest axis of the centroid bounds
+void ClusterBvh::build_node(uint32_t index, uint32_t begin, uint32_t end) {
+    box3f box;
+    box3f centroids;
+    for (uint32_t i = begin; i < end; i++) {
+        box.extend(leaves[order[i]]);
+        centroids.extend(leaves[order[i]].center());
+    }
+    nodes[index].bounds = box;
+    if (end - begin <= LEAF_SIZE) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return;
+    }
+
+    const vec3f span = centroids.span();
+    const int axis = span.x >= span.y && span.x >= span.z ? 0 : (span.y >= span.z ? 1 : 2);
+    const uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return leaves[a].center()[axis] < leaves[b].center()[axis];
+    });
+
+    const uint32_t left = static_cast<uint32_t>(nodes.size());
+    nodes[index].first = left;
+    nodes[index].count = 0;
+    nodes.emplace_back();
+    nodes.emplace_back();
+    build_node(left, begin, mid);
+    build_node(left + 1, mid, end);
+}
+
+std::vector<ClusterBvh::Visible> ClusterBvh::query(const Frustum& frustum) const {
+    std::vector<Visible> visible;
+    if (nodes.empty()) return visible;
+
+    auto culled = [&](const box3f& box) {
+        for (const vec3f& normal : frustum.normals) {
+            if (outside(box, frustum.eye, normal)) return true;
+        }
+        return false;
+    };
+
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        if (culled(node.bounds)) continue;
+        if (node.count == 0) {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            const box3f& box = leaves[order[i]];
+            if (culled(box)) continue;
+            const float radius = 0.5f * length(box.span());
+            const float distance = std::max({length(box.center() - frustum.eye), radius, 1e-20f});
+            visible.push_back({ order[i], (radius * radius) / (distance * distance) });
+        }
+    }
+    std::sort(visible.begin(), visible.end(), [](const Visible& a, const Visible& b) {
+        return a.priority != b.priority ? a.priority > b.priority : a.cluster < b.cluster;
+    });
+    return visible;
+}
@@ -0,0 +1,54 @@
+/**
+* @file ClusterBvh.hpp
+* @brief Host BVH over cluster bounds that decides which clusters are worth paging in.
+*/
+
+#pragma once
+
+#ifndef CLUSTERBVH_HPP
+#define CLUSTERBVH_HPP
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <owl/common/math/box.h>
+
+using namespace owl;
+
+class ClusterBvh {
+public:
+    // Inward facing side planes through the eye, the frustum has no near or far plane
+    struct Frustum {
+        vec3f eye;
+        std::array<vec3f, 4> normals;
+    };
+
+    struct Visible {
+        uint32_t cluster;
+        // Approximate solid angle of the cluster bounds seen from the eye
+        float priority;
+    };
+
+    void build(std::span<const box3f> bounds);
+
+    /**
+     * @brief Clusters that overlap the frustum, largest on screen first.
+     */
+    std::vector<Visible> query(const Frustum& frustum) const;
+private:
+    struct Node {
+        box3f bounds;
+        // Leaves hold count clusters starting at first, inner nodes have their children at first and first + 1
+        uint32_t first;
+        uint32_t count;
+    };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    std::vector<box3f> leaves;
+
+    void build_node(uint32_t index, uint32_t begin, uint32_t end);
+};
+
+#endif //CLUSTERBVH_HPP
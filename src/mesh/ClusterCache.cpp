@@ -0,0 +1,47 @@
+/**
+* @file ClusterCache.cpp
+* @brief Implementation of the ClusterCache class.
+*/
+
+#include "ClusterCache.hpp"
+
+ClusterCache::ClusterCache(const Config& config, std::vector<size_t> cluster_bytes)
+    : config(config),
+      bytes(std::move(cluster_bytes)),
+      is_resident(bytes.size(), false),
+      last_used(bytes.size(), 0),
+      position(bytes.size()) {}
+
+ClusterCache::Update ClusterCache::update(std::span<const uint32_t> wanted) {
+    frame++;
+    for (const uint32_t cluster : wanted) {
+        last_used[cluster] = frame;
+        if (is_resident[cluster]) {
+            lru.splice(lru.begin(), lru, position[cluster]);
+        }
+    }
+
+    Update update;
+    for (const uint32_t cluster : wanted) {
+        if (is_resident[cluster]) continue;
+        if (update.load.size() >= config.max_loads) break;
+        if (bytes[cluster] > config.budget_bytes) continue;
+
+        // Everything left in the cache is wanted at a higher priority once the tail is wanted too
+        while (used + bytes[cluster] > config.budget_bytes && !lru.empty() && last_used[lru.back()] != frame) {
+            const uint32_t victim = lru.back();
+            lru.pop_back();
+            is_resident[victim] = false;
+            used -= bytes[victim];
+            update.evict.push_back(victim);
+        }
+        if (used + bytes[cluster] > config.budget_bytes) break;
+
+        lru.push_front(cluster);
+        position[cluster] = lru.begin();
+        is_resident[cluster] = true;
+        used += bytes[cluster];
+        update.load.push_back(cluster);
+    }
+    return update;
+}
@@ -0,0 +1,55 @@
+/**
+* @file ClusterCache.hpp
+* @brief Least recently used residency of streamed clusters under a memory budget.
+*/
+
+#pragma once
+
+#ifndef CLUSTERCACHE_HPP
+#define CLUSTERCACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <span>
+#include <vector>
+
+class ClusterCache {
+public:
+    struct Config {
+        size_t budget_bytes = size_t(1) << 30;
+        // Loads per update, bounds the hitch when the camera turns
+        uint32_t max_loads = 32;
+    };
+
+    struct Update {
+        std::vector<uint32_t> load;
+        std::vector<uint32_t> evict;
+    };
+
+    ClusterCache(const Config& config, std::vector<size_t> cluster_bytes);
+
+    /**
+     * @brief Marks the wanted clusters as used and picks what to page in and out.
+     * Wanted clusters come in priority order. Missing ones are loaded in that order while the budget
+     * allows, evicting the least recently used clusters that are not wanted this update.
+     * Loads are reported as resident right away, the caller has to perform them.
+     */
+    Update update(std::span<const uint32_t> wanted);
+
+    bool resident(uint32_t cluster) const { return is_resident[cluster]; }
+    size_t used_bytes() const { return used; }
+    size_t resident_count() const { return lru.size(); }
+    const Config& get_config() const { return config; }
+private:
+    Config config;
+    std::vector<size_t> bytes;
+    std::vector<bool> is_resident;
+    std::vector<uint64_t> last_used;
+    std::vector<std::list<uint32_t>::iterator> position;
+    // Most recently used first
+    std::list<uint32_t> lru;
+    size_t used = 0;
+    uint64_t frame = 0;
+};
+
+#endif //CLUSTERCACHE_HPP
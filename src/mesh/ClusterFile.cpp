@@ -0,0 +1,243 @@
+/**
+* @file ClusterFile.cpp
+* @brief Implementation of the ClusterFile class.
+*/
+
+#include "ClusterFile.hpp"
+#include "Morton.hpp"
+#include "VertexUnifier.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+#include <tuple>
+#include <vector>
+
+namespace {
+    constexpr char MAGIC[8] = { 'O', 'W', 'L', 'C', 'L', 'S', 'T', '\0' };
+    constexpr uint32_t VERSION = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t num_clusters;
+        uint64_t table_offset;
+        box3f bounds;
+    };
+
+    struct TriangleKey {
+        uint32_t code;
+        uint32_t triangle;
+
+        bool operator<(const TriangleKey& other) const {
+            return std::tie(code, triangle) < std::tie(other.code, other.triangle);
+        }
+    };
+
+    size_t align_up(size_t offset) {
+        return (offset + ClusterFile::PAGE_SIZE - 1) & ~(ClusterFile::PAGE_SIZE - 1);
+    }
+
+    template<typename T>
+    void write_span(std::ofstream& out, std::span<const T> data) {
+        out.write(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+    }
+
+    // Gathers the triangles of one cluster and unifies their vertices locally
+    HostMesh build_cluster(const MeshCache::Views& views, std::span<const TriangleKey> keys) {
+        const bool has_normals = views.normal_indices.size() == views.indices.size();
+        const bool has_texcoords = views.texcoord_indices.size() == views.indices.size();
+        const bool has_materials = views.material_ids.size() == views.indices.size();
+
+        std::vector<vec3ui> indices(keys.size());
+        std::vector<vec3ui> normal_indices(has_normals ? keys.size() : 0);
+        std::vector<vec3ui> texcoord_indices(has_texcoords ? keys.size() : 0);
+        std::vector<uint32_t> material_ids(keys.size(), UINT32_MAX);
+        for (size_t k = 0; k < keys.size(); k++) {
+            const uint32_t t = keys[k].triangle;
+            indices[k] = views.indices[t];
+            if (has_normals) normal_indices[k] = views.normal_indices[t];
+            if (has_texcoords) texcoord_indices[k] = views.texcoord_indices[t];
+            if (has_materials) material_ids[k] = views.material_ids[t];
+        }
+
+        MeshCache::Views local = views;
+        local.indices = indices;
+        local.normal_indices = normal_indices;
+        local.texcoord_indices = texcoord_indices;
+        local.material_ids = material_ids;
+        return VertexUnifier::unify(local, false);
+    }
+}
+
+bool ClusterFile::handles(const std::string& file_path) {
+    return file_path.substr(file_path.find_last_of('.') + 1) == "clusters";
+}
+
+bool ClusterFile::write(const std::string& file_path, const MeshCache::Views& views, const Config& config) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    const size_t num_triangles = views.indices.size();
+    const uint32_t cluster_size = std::max(config.triangles_per_cluster, 1u);
+    const size_t num_clusters = (num_triangles + cluster_size - 1) / cluster_size;
+
+    const box3f bounds = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, views.vertices.size()), box3f(),
+        [&](const tbb::blocked_range<size_t>& r, box3f b) {
+            for (size_t v = r.begin(); v < r.end(); v++) b.extend(views.vertices[v]);
+            return b;
+        },
+        [](box3f a, const box3f& b) { return a.extend(b); });
+
+    std::vector<TriangleKey> keys(num_triangles);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_triangles), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t t = r.begin(); t < r.end(); t++) {
+            const vec3ui& i = views.indices[t];
+            const vec3f centroid = (views.vertices[i.x] + views.vertices[i.y] + views.vertices[i.z]) / 3.f;
+            keys[t] = { morton_code(centroid, bounds), static_cast<uint32_t>(t) };
+        }
+    });
+    tbb::parallel_sort(keys.begin(), keys.end());
+
+    // Written under a temporary name so an interrupted write never leaves a valid looking file
+    const std::string tmp_path = MeshCache::temp_path_for(file_path);
+    std::vector<Cluster> table(num_clusters);
+    size_t offset = align_up(sizeof(Header));
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::error("ClusterFile: Cannot write {}", file_path);
+            return false;
+        }
+        const std::vector<char> padding(PAGE_SIZE, 0);
+        out.write(padding.data(), offset);
+
+        const uint32_t batch_size = std::max(config.batch_size, 1u);
+        for (size_t first = 0; first < num_clusters; first += batch_size) {
+            const size_t count = std::min<size_t>(batch_size, num_clusters - first);
+            std::vector<HostMesh> batch(count);
+            tbb::parallel_for(size_t(0), count, [&](size_t b) {
+                const size_t begin = (first + b) * cluster_size;
+                const size_t end = std::min(begin + cluster_size, num_triangles);
+                batch[b] = build_cluster(views, std::span(keys).subspan(begin, end - begin));
+            });
+
+            for (size_t b = 0; b < count; b++) {
+                const HostMesh& mesh = batch[b];
+                Cluster& cluster = table[first + b];
+                cluster.bounds = mesh.bounds();
+                cluster.offset = offset;
+                cluster.num_vertices = static_cast<uint32_t>(mesh.vertices.size());
+                cluster.num_triangles = static_cast<uint32_t>(mesh.indices.size());
+
+                write_span(out, std::span(mesh.vertices));
+                write_span(out, std::span(mesh.indices));
+                write_span(out, std::span(mesh.material_ids));
+                const size_t size = cluster.bytes();
+                out.write(padding.data(), align_up(size) - size);
+                offset += align_up(size);
+            }
+        }
+
+        Header header {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.num_clusters = static_cast<uint32_t>(num_clusters);
+        header.table_offset = offset;
+        header.bounds = bounds;
+        write_span(out, std::span<const Cluster>(table));
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (!out) {
+            spdlog::error("ClusterFile: Failed writing {}", file_path);
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        spdlog::error("ClusterFile: Failed to move {} into place: {}", file_path, ec.message());
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("ClusterFile: Wrote {} triangles as {} clusters ({} MB) to {} in {:.1f} ms", num_triangles,
+                 num_clusters, offset >> 20, file_path, std::chrono::duration<double, std::milli>(end - start).count());
+    return true;
+}
+
+bool ClusterFile::open(const std::string& file_path) {
+    close();
+    if (!file.open(file_path)) {
+        spdlog::error("ClusterFile: Failed to map {}", file_path);
+        return false;
+    }
+
+    const std::span<const std::byte> bytes = file.bytes();
+    Header header;
+    if (bytes.size() < sizeof(Header)) {
+        spdlog::error("ClusterFile: Truncated file: {}", file_path);
+        close();
+        return false;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        spdlog::error("ClusterFile: Not a cluster file: {}", file_path);
+        close();
+        return false;
+    }
+    if (header.table_offset % PAGE_SIZE != 0
+        || header.table_offset + header.num_clusters * sizeof(Cluster) > bytes.size()) {
+        spdlog::error("ClusterFile: Truncated file: {}", file_path);
+        close();
+        return false;
+    }
+
+    table = { reinterpret_cast<const Cluster*>(bytes.data() + header.table_offset), header.num_clusters };
+    for (const Cluster& cluster : table) {
+        if (cluster.offset % PAGE_SIZE != 0 || cluster.offset + cluster.bytes() > header.table_offset) {
+            spdlog::error("ClusterFile: Corrupt cluster table: {}", file_path);
+            close();
+            return false;
+        }
+    }
+    scene_bounds = header.bounds;
+    spdlog::info("ClusterFile: Mapped {} clusters from {}", table.size(), file_path);
+    return true;
+}
+
+void ClusterFile::close() {
+    table = {};
+    scene_bounds = box3f();
+    file.close();
+}
+
+ClusterFile::ClusterView ClusterFile::view(uint32_t cluster) const {
+    const Cluster& c = table[cluster];
+    const std::byte* data = file.bytes().data() + c.offset;
+    const auto* vertices = reinterpret_cast<const Geometry::PackedVertex*>(data);
+    const auto* indices = reinterpret_cast<const vec3ui*>(vertices + c.num_vertices);
+    const auto* material_ids = reinterpret_cast<const uint32_t*>(indices + c.num_triangles);
+    return {
+        { vertices, c.num_vertices },
+        { indices, c.num_triangles },
+        { material_ids, c.num_triangles },
+    };
+}
+
+HostMesh ClusterFile::read(uint32_t cluster) const {
+    const ClusterView v = view(cluster);
+    HostMesh mesh;
+    mesh.vertices.assign(v.vertices.begin(), v.vertices.end());
+    mesh.indices.assign(v.indices.begin(), v.indices.end());
+    mesh.material_ids.assign(v.material_ids.begin(), v.material_ids.end());
+    return mesh;
+}
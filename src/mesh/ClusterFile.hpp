@@ -0,0 +1,75 @@
+/**
+* @file ClusterFile.hpp
+* @brief Paged file of spatial mesh clusters for meshes larger than memory.
+* @details Triangles are sorted along a Morton curve of their centroids and cut into clusters of a fixed
+* triangle count. Every cluster is unified on its own into local vertices and indices and stored on a
+* page aligned offset, followed by a table of cluster bounds and offsets. Clusters are written in batches,
+* so only the Morton keys and one batch of clusters are ever in memory besides the source views, which the
+* caller has to provide whole, mapped or loaded. Reading
+* maps the file, clusters are paged in by the OS when their data is first touched.
+*/
+
+#pragma once
+
+#ifndef CLUSTERFILE_HPP
+#define CLUSTERFILE_HPP
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include <owl/common/math/box.h>
+
+#include "HostMesh.hpp"
+#include "loaders/MappedFile.hpp"
+#include "loaders/MeshCache.hpp"
+
+class ClusterFile {
+public:
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    struct Config {
+        uint32_t triangles_per_cluster = 16384;
+        // Clusters built in parallel before they are written
+        uint32_t batch_size = 256;
+    };
+
+    struct Cluster {
+        box3f bounds;
+        uint64_t offset;
+        uint32_t num_vertices;
+        uint32_t num_triangles;
+
+        // Vertex, index and material id bytes
+        size_t bytes() const {
+            return num_vertices * sizeof(Geometry::PackedVertex) + num_triangles * (sizeof(vec3ui) + sizeof(uint32_t));
+        }
+    };
+
+    struct ClusterView {
+        std::span<const Geometry::PackedVertex> vertices;
+        std::span<const vec3ui> indices;
+        // UINT32_MAX where the source assigns no material
+        std::span<const uint32_t> material_ids;
+    };
+
+    static bool handles(const std::string& file_path);
+    static bool write(const std::string& file_path, const MeshCache::Views& views, const Config& config);
+
+    bool open(const std::string& file_path);
+    void close();
+
+    std::span<const Cluster> clusters() const { return table; }
+    const box3f& bounds() const { return scene_bounds; }
+    ClusterView view(uint32_t cluster) const;
+    /**
+     * @brief Copies a cluster out of the mapping, touching its pages.
+     */
+    HostMesh read(uint32_t cluster) const;
+private:
+    MappedFile file;
+    std::span<const Cluster> table;
+    box3f scene_bounds;
+};
+
+#endif //CLUSTERFILE_HPP
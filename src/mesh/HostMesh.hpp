@@ -0,0 +1,37 @@
+/**
+* @file HostMesh.hpp
+* @brief Host-side single-index triangle mesh, the form build_scene uploads.
+*/
+
+#pragma once
+
+#ifndef HOSTMESH_HPP
+#define HOSTMESH_HPP
+
+#include <vector>
+
+#include <owl/common/math/box.h>
+
+#include "geometry/TriangleMesh.hpp"
+
+using namespace owl;
+
+struct HostMesh {
+    std::vector<Geometry::PackedVertex> vertices;
+    std::vector<vec3ui> indices;
+    // Per triangle, empty when the source has none
+    std::vector<uint32_t> material_ids;
+
+    size_t vertex_bytes() const { return vertices.size() * sizeof(Geometry::PackedVertex); }
+    size_t index_bytes() const { return indices.size() * sizeof(vec3ui); }
+
+    box3f bounds() const {
+        box3f b;
+        for (const Geometry::PackedVertex& v : vertices) {
+            b.extend(v.position);
+        }
+        return b;
+    }
+};
+
+#endif //HOSTMESH_HPP
@@ -0,0 +1,201 @@
+/**
+* @file LodCache.cpp
+* @brief Implementation of the LodCache class.
+*/
+
+#include "LodCache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <spdlog/spdlog.h>
+
+namespace {
+    constexpr char MAGIC[8] = { 'O', 'W', 'L', 'L', 'O', 'D', 'S', '\0' };
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t ALIGNMENT = 64;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t load_flags;
+        float crease_angle;
+        float ratio;
+        uint32_t max_levels;
+        uint32_t num_chains;
+        uint64_t min_triangles;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t num_levels;
+    };
+
+    struct Entry {
+        uint32_t chain;
+        uint32_t num_vertices;
+        uint32_t num_triangles;
+        uint32_t num_material_ids;
+        float error;
+        uint32_t padding;
+        uint64_t offset;
+    };
+
+    size_t align_up(size_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+
+    size_t payload_bytes(const Entry& entry) {
+        return entry.num_vertices * sizeof(Geometry::PackedVertex) + entry.num_triangles * sizeof(vec3ui)
+            + entry.num_material_ids * sizeof(uint32_t);
+    }
+
+    template<typename T>
+    void write_span(std::ofstream& out, std::span<const T> data) {
+        out.write(reinterpret_cast<const char*>(data.data()), data.size_bytes());
+    }
+
+    template<typename T>
+    const std::byte* read_into(const std::byte* data, size_t count, std::vector<T>& out) {
+        out.resize(count);
+        std::memcpy(out.data(), data, count * sizeof(T));
+        return data + count * sizeof(T);
+    }
+}
+
+std::string LodCache::path_for(const std::string& model_path) {
+    return model_path + ".lodcache";
+}
+
+bool LodCache::write(const std::string& file_path, const MeshCache::Source& source, const MeshSimplifier::Config& config,
+                     const Chains& chains) {
+    std::vector<Entry> entries;
+    for (size_t c = 0; c < chains.size(); c++) {
+        for (const MeshSimplifier::Lod& lod : chains[c]) {
+            entries.push_back({
+                static_cast<uint32_t>(c),
+                static_cast<uint32_t>(lod.mesh.vertices.size()),
+                static_cast<uint32_t>(lod.mesh.indices.size()),
+                static_cast<uint32_t>(lod.mesh.material_ids.size()),
+                lod.error,
+                0,
+                0,
+            });
+        }
+    }
+
+    Header header {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.load_flags = source.load_flags;
+    header.crease_angle = source.crease_angle;
+    header.ratio = config.ratio;
+    header.max_levels = config.max_levels;
+    header.num_chains = static_cast<uint32_t>(chains.size());
+    header.min_triangles = config.min_triangles;
+    header.source_size = source.size;
+    header.source_mtime = source.mtime;
+    header.num_levels = entries.size();
+    size_t offset = align_up(sizeof(Header) + entries.size() * sizeof(Entry));
+    for (Entry& entry : entries) {
+        entry.offset = offset;
+        offset = align_up(offset + payload_bytes(entry));
+    }
+
+    // Written under a temporary name so an interrupted write never leaves a valid looking cache
+    const std::string tmp_path = MeshCache::temp_path_for(file_path);
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::warn("LodCache: Cannot write cache file: {}", file_path);
+            return false;
+        }
+        const char padding[ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_span(out, std::span<const Entry>(entries));
+        size_t written = sizeof(Header) + entries.size() * sizeof(Entry);
+        out.write(padding, align_up(written) - written);
+        for (const std::vector<MeshSimplifier::Lod>& chain : chains) {
+            for (const MeshSimplifier::Lod& lod : chain) {
+                write_span(out, std::span(lod.mesh.vertices));
+                write_span(out, std::span(lod.mesh.indices));
+                write_span(out, std::span(lod.mesh.material_ids));
+                written = lod.mesh.vertex_bytes() + lod.mesh.index_bytes() + lod.mesh.material_ids.size() * sizeof(uint32_t);
+                out.write(padding, align_up(written) - written);
+            }
+        }
+        if (!out) {
+            spdlog::warn("LodCache: Failed writing cache file: {}", file_path);
+            out.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, file_path, ec);
+    if (ec) {
+        spdlog::warn("LodCache: Failed to move cache file into place: {}", ec.message());
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    spdlog::info("LodCache: Wrote {} levels ({} MB): {}", entries.size(), offset >> 20, file_path);
+    return true;
+}
+
+std::optional<LodCache::Chains> LodCache::read(const std::string& file_path, const MeshCache::Source& source,
+                                               const MeshSimplifier::Config& config) {
+    MappedFile file;
+    if (!file.open(file_path)) return std::nullopt;
+
+    const std::span<const std::byte> bytes = file.bytes();
+    Header header;
+    if (bytes.size() < sizeof(Header)) {
+        spdlog::warn("LodCache: Truncated cache file: {}", file_path);
+        return std::nullopt;
+    }
+    std::memcpy(&header, bytes.data(), sizeof(Header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        spdlog::warn("LodCache: Ignoring invalid cache file: {}", file_path);
+        return std::nullopt;
+    }
+    if (header.source_size != source.size || header.source_mtime != source.mtime
+        || header.load_flags != source.load_flags || header.crease_angle != source.crease_angle
+        || header.ratio != config.ratio || header.max_levels != config.max_levels
+        || header.min_triangles != config.min_triangles) {
+        spdlog::info("LodCache: Cache is out of date: {}", file_path);
+        return std::nullopt;
+    }
+    if (header.num_levels > (bytes.size() - sizeof(Header)) / sizeof(Entry)) {
+        spdlog::warn("LodCache: Truncated cache file: {}", file_path);
+        return std::nullopt;
+    }
+
+    std::vector<Entry> entries(header.num_levels);
+    std::memcpy(entries.data(), bytes.data() + sizeof(Header), entries.size() * sizeof(Entry));
+    Chains chains(header.num_chains);
+    for (const Entry& entry : entries) {
+        if (entry.chain >= chains.size() || entry.offset > bytes.size() || payload_bytes(entry) > bytes.size() - entry.offset
+            || (entry.num_material_ids != 0 && entry.num_material_ids != entry.num_triangles)) {
+            spdlog::warn("LodCache: Corrupt cache file: {}", file_path);
+            return std::nullopt;
+        }
+        MeshSimplifier::Lod& lod = chains[entry.chain].emplace_back();
+        lod.error = entry.error;
+        const std::byte* data = bytes.data() + entry.offset;
+        data = read_into(data, entry.num_vertices, lod.mesh.vertices);
+        data = read_into(data, entry.num_triangles, lod.mesh.indices);
+        read_into(data, entry.num_material_ids, lod.mesh.material_ids);
+        // Out of range indices would read past the vertex buffer on the device
+        const bool valid = std::all_of(lod.mesh.indices.begin(), lod.mesh.indices.end(), [&](const vec3ui& i) {
+            return i.x < entry.num_vertices && i.y < entry.num_vertices && i.z < entry.num_vertices;
+        });
+        if (!valid) {
+            spdlog::warn("LodCache: Corrupt cache file: {}", file_path);
+            return std::nullopt;
+        }
+    }
+    spdlog::info("LodCache: Read {} levels: {}", entries.size(), file_path);
+    return chains;
+}
@@ -0,0 +1,37 @@
+/**
+* @file LodCache.hpp
+* @brief Level of detail chains of a model stored next to it, so they are only simplified once.
+* @details The header records the source model like a mesh cache does, plus the simplifier settings.
+* A table of levels follows, each one pointing at its vertices, indices and material ids. Full resolution
+* meshes are not stored, they come from the model or its mesh cache.
+*/
+
+#pragma once
+
+#ifndef LODCACHE_HPP
+#define LODCACHE_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "MeshSimplifier.hpp"
+#include "loaders/MeshCache.hpp"
+
+class LodCache {
+public:
+    // One chain per mesh of the model, in load order
+    using Chains = std::vector<std::vector<MeshSimplifier::Lod>>;
+
+    static std::string path_for(const std::string& model_path);
+
+    static bool write(const std::string& file_path, const MeshCache::Source& source, const MeshSimplifier::Config& config,
+                      const Chains& chains);
+    /**
+     * @brief Fails if the file is missing, truncated, or built from a different source or with other settings.
+     */
+    static std::optional<Chains> read(const std::string& file_path, const MeshCache::Source& source,
+                                      const MeshSimplifier::Config& config);
+};
+
+#endif //LODCACHE_HPP
@@ -0,0 +1,80 @@
+/**
+* @file MeshCompressor.cpp
+* @brief Implementation of the MeshCompressor class.
+*/
+
+#include "MeshCompressor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+CompressedMesh MeshCompressor::compress(const HostMesh& mesh) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    using namespace Geometry;
+
+    CompressedMesh out;
+    const box3f bounds = mesh.bounds();
+    const vec3f extent = max(bounds.span(), vec3f(1e-20f));
+    out.origin = bounds.lower;
+    out.scale = extent / 65535.f;
+
+    out.vertices.resize(mesh.vertices.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.vertices.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t v = r.begin(); v < r.end(); v++) {
+            const PackedVertex& p = mesh.vertices[v];
+            const vec3f q = (p.position - bounds.lower) / extent * 65535.f;
+            CompressedVertex& c = out.vertices[v];
+            for (int k = 0; k < 3; k++) {
+                c.position[k] = static_cast<uint16_t>(std::clamp(std::lround(q[k]), 0l, 65535l));
+            }
+            c.padding = 0;
+            c.normal = oct_encode(p.normal);
+            c.texcoord = p.texcoord;
+        }
+    });
+
+    const size_t num_triangles = mesh.indices.size();
+    const size_t num_clusters = (num_triangles + (1u << INDEX_CLUSTER_SHIFT) - 1) >> INDEX_CLUSTER_SHIFT;
+    out.cluster_bases.resize(num_clusters);
+    out.short_indices.resize(num_triangles);
+    std::atomic<bool> fits = true;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_clusters), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t c = r.begin(); c < r.end(); c++) {
+            const size_t first = c << INDEX_CLUSTER_SHIFT;
+            const size_t last = std::min(first + (1u << INDEX_CLUSTER_SHIFT), num_triangles);
+            uint32_t lo = UINT32_MAX;
+            uint32_t hi = 0;
+            for (size_t t = first; t < last; t++) {
+                const vec3ui& i = mesh.indices[t];
+                lo = std::min({lo, i.x, i.y, i.z});
+                hi = std::max({hi, i.x, i.y, i.z});
+            }
+            if (hi - lo > UINT16_MAX) {
+                fits.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            out.cluster_bases[c] = lo;
+            for (size_t t = first; t < last; t++) {
+                const vec3ui& i = mesh.indices[t];
+                out.short_indices[t] = {static_cast<uint16_t>(i.x - lo), static_cast<uint16_t>(i.y - lo), static_cast<uint16_t>(i.z - lo)};
+            }
+        }
+    });
+    if (!fits) {
+        spdlog::warn("MeshCompressor: Some index cluster spans more than 65536 vertices, keeping 32 bit indices");
+        out.short_indices.clear();
+        out.cluster_bases.clear();
+    }
+
+    const size_t index_bytes = fits ? out.index_bytes() : mesh.index_bytes();
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("MeshCompressor: Compressed in {:.1f} ms, vertex {} -> {} MB, index {} -> {} MB",
+                 std::chrono::duration<double, std::milli>(end - start).count(), mesh.vertex_bytes() >> 20,
+                 out.vertex_bytes() >> 20, mesh.index_bytes() >> 20, index_bytes >> 20);
+    return out;
+}
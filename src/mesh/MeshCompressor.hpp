@@ -0,0 +1,39 @@
+/**
+* @file MeshCompressor.hpp
+* @brief Compact shading buffers for a unified mesh.
+*/
+
+#pragma once
+
+#ifndef MESHCOMPRESSOR_HPP
+#define MESHCOMPRESSOR_HPP
+
+#include <vector>
+
+#include "HostMesh.hpp"
+
+struct CompressedMesh {
+    std::vector<Geometry::CompressedVertex> vertices;
+    // 16 bit indices relative to cluster_bases, empty when some cluster spans more than 65536 vertices
+    std::vector<Geometry::Index16> short_indices;
+    std::vector<uint32_t> cluster_bases;
+    vec3f origin;
+    vec3f scale;
+
+    size_t vertex_bytes() const { return vertices.size() * sizeof(Geometry::CompressedVertex); }
+    size_t index_bytes() const {
+        return short_indices.size() * sizeof(Geometry::Index16) + cluster_bases.size() * sizeof(uint32_t);
+    }
+};
+
+class MeshCompressor {
+public:
+    /**
+     * @brief Quantizes positions to 16 bits within the mesh bounds and octahedral encodes normals.
+     * Indices are split into clusters of 2^INDEX_CLUSTER_SHIFT triangles and stored as 16 bit offsets
+     * from the smallest index in the cluster, which fits for spatially ordered meshes.
+     */
+    static CompressedMesh compress(const HostMesh& mesh);
+};
+
+#endif //MESHCOMPRESSOR_HPP
@@ -0,0 +1,242 @@
+/**
+* @file MeshOptimizer.cpp
+* @brief Implementation of the MeshOptimizer class.
+*/
+
+#include "MeshOptimizer.hpp"
+#include "Morton.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/parallel_sort.h>
+#include <tuple>
+
+namespace {
+    struct WeldKey {
+        vec3i position;
+        vec3i normal;
+        vec2i texcoord;
+        uint32_t vertex;
+
+        auto tuple() const {
+            return std::tie(position.x, position.y, position.z, normal.x, normal.y, normal.z, texcoord.x, texcoord.y);
+        }
+        bool same_vertex(const WeldKey& other) const { return tuple() == other.tuple(); }
+        bool operator<(const WeldKey& other) const {
+            return std::tie(position.x, position.y, position.z, normal.x, normal.y, normal.z, texcoord.x, texcoord.y, vertex)
+                < std::tie(other.position.x, other.position.y, other.position.z, other.normal.x, other.normal.y,
+                           other.normal.z, other.texcoord.x, other.texcoord.y, other.vertex);
+        }
+    };
+
+    struct SortKey {
+        uint32_t code;
+        uint32_t index;
+
+        bool operator<(const SortKey& other) const {
+            return std::tie(code, index) < std::tie(other.code, other.index);
+        }
+    };
+
+    vec3i quantize(const vec3f& v, float scale) {
+        return vec3i(static_cast<int>(std::floor(v.x * scale)), static_cast<int>(std::floor(v.y * scale)),
+                     static_cast<int>(std::floor(v.z * scale)));
+    }
+
+    // Dense ids for keys sorted so that equal vertices are adjacent
+    template<typename Same>
+    uint32_t assign_ids(size_t count, std::vector<uint32_t>& ids, Same same) {
+        ids.resize(count);
+        return tbb::parallel_scan(
+            tbb::blocked_range<size_t>(0, count), 0u,
+            [&](const tbb::blocked_range<size_t>& r, uint32_t id, bool is_final) {
+                for (size_t i = r.begin(); i < r.end(); i++) {
+                    if (i > 0 && !same(i)) id++;
+                    if (is_final) ids[i] = id;
+                }
+                return id;
+            },
+            [](uint32_t a, uint32_t b) { return a + b; }
+        ) + (count > 0 ? 1u : 0u);
+    }
+
+    void remap_indices(std::vector<vec3ui>& indices, const std::vector<uint32_t>& remap) {
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                const vec3ui& i = indices[t];
+                indices[t] = vec3ui(remap[i.x], remap[i.y], remap[i.z]);
+            }
+        });
+    }
+
+    void weld(HostMesh& mesh, const box3f& bounds, float epsilon) {
+        const float cell = std::max(epsilon * length(bounds.span()), 1e-20f);
+        const size_t count = mesh.vertices.size();
+
+        std::vector<WeldKey> keys(count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                const Geometry::PackedVertex& p = mesh.vertices[v];
+                keys[v] = {
+                    quantize(p.position - bounds.lower, 1.f / cell),
+                    quantize(p.normal, 1024.f),
+                    vec2i(static_cast<int>(std::floor(p.texcoord.x * 4096.f)), static_cast<int>(std::floor(p.texcoord.y * 4096.f))),
+                    static_cast<uint32_t>(v),
+                };
+            }
+        });
+        tbb::parallel_sort(keys.begin(), keys.end());
+
+        std::vector<uint32_t> ids;
+        const uint32_t welded = assign_ids(count, ids, [&](size_t i) { return keys[i].same_vertex(keys[i - 1]); });
+
+        // The lowest original index of every group is kept
+        std::vector<Geometry::PackedVertex> vertices(welded);
+        std::vector<uint32_t> remap(count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                remap[keys[i].vertex] = ids[i];
+                if (i == 0 || !keys[i].same_vertex(keys[i - 1])) {
+                    vertices[ids[i]] = mesh.vertices[keys[i].vertex];
+                }
+            }
+        });
+        mesh.vertices = std::move(vertices);
+        remap_indices(mesh.indices, remap);
+    }
+
+    void remove_degenerate(HostMesh& mesh) {
+        const size_t count = mesh.indices.size();
+        auto keep = [&](size_t t) {
+            const vec3ui& i = mesh.indices[t];
+            if (i.x == i.y || i.y == i.z || i.x == i.z) return false;
+            const vec3f& p0 = mesh.vertices[i.x].position;
+            const vec3f n = cross(mesh.vertices[i.y].position - p0, mesh.vertices[i.z].position - p0);
+            return dot(n, n) > 0.f;
+        };
+
+        std::vector<uint32_t> slots(count);
+        const uint32_t kept = tbb::parallel_scan(
+            tbb::blocked_range<size_t>(0, count), 0u,
+            [&](const tbb::blocked_range<size_t>& r, uint32_t sum, bool is_final) {
+                for (size_t t = r.begin(); t < r.end(); t++) {
+                    if (is_final) slots[t] = sum;
+                    sum += keep(t) ? 1 : 0;
+                }
+                return sum;
+            },
+            [](uint32_t a, uint32_t b) { return a + b; }
+        );
+        if (kept == count) return;
+
+        const bool has_materials = !mesh.material_ids.empty();
+        std::vector<vec3ui> indices(kept);
+        std::vector<uint32_t> material_ids(has_materials ? kept : 0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                if (t + 1 < count ? slots[t + 1] == slots[t] : slots[t] == kept) continue;
+                indices[slots[t]] = mesh.indices[t];
+                if (has_materials) material_ids[slots[t]] = mesh.material_ids[t];
+            }
+        });
+        mesh.indices = std::move(indices);
+        mesh.material_ids = std::move(material_ids);
+    }
+
+    void reorder_triangles(HostMesh& mesh, const box3f& bounds) {
+        const size_t count = mesh.indices.size();
+        std::vector<SortKey> keys(count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                const vec3ui& i = mesh.indices[t];
+                const vec3f centroid = (mesh.vertices[i.x].position + mesh.vertices[i.y].position + mesh.vertices[i.z].position) / 3.f;
+                keys[t] = {morton_code(centroid, bounds), static_cast<uint32_t>(t)};
+            }
+        });
+        tbb::parallel_sort(keys.begin(), keys.end());
+
+        const bool has_materials = !mesh.material_ids.empty();
+        std::vector<vec3ui> indices(count);
+        std::vector<uint32_t> material_ids(has_materials ? count : 0);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                indices[t] = mesh.indices[keys[t].index];
+                if (has_materials) material_ids[t] = mesh.material_ids[keys[t].index];
+            }
+        });
+        mesh.indices = std::move(indices);
+        mesh.material_ids = std::move(material_ids);
+    }
+
+    // Drops unreferenced vertices, and sorts the rest along the Morton curve when reordering
+    void compact_vertices(HostMesh& mesh, const box3f& bounds, bool reorder) {
+        const size_t count = mesh.vertices.size();
+        std::vector<std::atomic<uint8_t>> used(count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                for (int k = 0; k < 3; k++) {
+                    used[mesh.indices[t][k]].store(1, std::memory_order_relaxed);
+                }
+            }
+        });
+
+        // Unused vertices sort behind every used one
+        std::vector<SortKey> keys(count);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, count), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                const bool is_used = used[v].load(std::memory_order_relaxed);
+                const uint32_t code = reorder ? morton_code(mesh.vertices[v].position, bounds) : 0u;
+                keys[v] = {is_used ? code : UINT32_MAX, static_cast<uint32_t>(v)};
+            }
+        });
+        if (reorder) {
+            tbb::parallel_sort(keys.begin(), keys.end());
+        }
+        else {
+            std::stable_partition(keys.begin(), keys.end(), [](const SortKey& k) { return k.code != UINT32_MAX; });
+        }
+
+        size_t kept = 0;
+        while (kept < count && used[keys[kept].index].load(std::memory_order_relaxed)) kept++;
+
+        std::vector<Geometry::PackedVertex> vertices(kept);
+        std::vector<uint32_t> remap(count, UINT32_MAX);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, kept), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                vertices[v] = mesh.vertices[keys[v].index];
+                remap[keys[v].index] = static_cast<uint32_t>(v);
+            }
+        });
+        mesh.vertices = std::move(vertices);
+        remap_indices(mesh.indices, remap);
+    }
+}
+
+MeshOptimizer::Stats MeshOptimizer::optimize(HostMesh& mesh, const Config& config) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    Stats stats;
+    stats.vertices_before = mesh.vertices.size();
+    stats.triangles_before = mesh.indices.size();
+
+    if (!mesh.indices.empty()) {
+        const box3f bounds = mesh.bounds();
+        if (config.weld) weld(mesh, bounds, config.weld_epsilon);
+        if (config.remove_degenerate) remove_degenerate(mesh);
+        if (config.reorder) reorder_triangles(mesh, bounds);
+        compact_vertices(mesh, bounds, config.reorder);
+    }
+
+    stats.vertices_after = mesh.vertices.size();
+    stats.triangles_after = mesh.indices.size();
+    const auto end = std::chrono::high_resolution_clock::now();
+    stats.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    spdlog::info("MeshOptimizer: {} -> {} vertices, {} -> {} triangles in {:.1f} ms", stats.vertices_before,
+                 stats.vertices_after, stats.triangles_before, stats.triangles_after, stats.ms);
+    return stats;
+}
@@ -0,0 +1,39 @@
+/**
+* @file MeshOptimizer.hpp
+* @brief Cleanup pass over a unified mesh before it is uploaded.
+*/
+
+#pragma once
+
+#ifndef MESHOPTIMIZER_HPP
+#define MESHOPTIMIZER_HPP
+
+#include "HostMesh.hpp"
+
+class MeshOptimizer {
+public:
+    struct Config {
+        // Fraction of the bounding box diagonal, positions in the same cell of this size are welded
+        float weld_epsilon = 1e-6f;
+        bool weld = true;
+        bool remove_degenerate = true;
+        bool reorder = true;
+    };
+
+    struct Stats {
+        size_t vertices_before = 0;
+        size_t vertices_after = 0;
+        size_t triangles_before = 0;
+        size_t triangles_after = 0;
+        double ms = 0.0;
+    };
+
+    /**
+     * @brief Welds vertices, drops degenerate triangles and sorts triangles and vertices along a Morton curve.
+     * Welding only merges vertices whose normals and texcoords also match after quantization, so hard
+     * edges and UV seams are kept. Every step is a parallel sort or scan and the result is deterministic.
+     */
+    static Stats optimize(HostMesh& mesh, const Config& config);
+};
+
+#endif //MESHOPTIMIZER_HPP
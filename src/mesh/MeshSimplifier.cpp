@@ -0,0 +1,347 @@
+/**
+* @file MeshSimplifier.cpp
+* @brief Implementation of the MeshSimplifier class.
+*/
+
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/parallel_sort.h>
+#include <tuple>
+
+namespace {
+    constexpr int MAX_ROUNDS = 64;
+
+    // Upper triangle of a symmetric 4x4 matrix: xx xy xz xw yy yz yw zz zw ww
+    struct Quadric {
+        std::array<double, 10> m {};
+
+        static Quadric plane(const vec3d& n, double d) {
+            Quadric q;
+            q.m = { n.x * n.x, n.x * n.y, n.x * n.z, n.x * d, n.y * n.y, n.y * n.z, n.y * d, n.z * n.z, n.z * d, d * d };
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other) {
+            for (size_t i = 0; i < m.size(); i++) m[i] += other.m[i];
+            return *this;
+        }
+
+        Quadric operator+(const Quadric& other) const {
+            Quadric q = *this;
+            return q += other;
+        }
+
+        // Sum of squared distances to the accumulated planes
+        double error(const vec3d& p) const {
+            return m[0] * p.x * p.x + 2.0 * m[1] * p.x * p.y + 2.0 * m[2] * p.x * p.z + 2.0 * m[3] * p.x
+                + m[4] * p.y * p.y + 2.0 * m[5] * p.y * p.z + 2.0 * m[6] * p.y
+                + m[7] * p.z * p.z + 2.0 * m[8] * p.z + m[9];
+        }
+
+        // Fails when the planes do not pin down a single point
+        bool minimum(vec3d& p) const {
+            const double a = m[0], b = m[1], c = m[2], d = m[4], e = m[5], f = m[7];
+            const double c00 = d * f - e * e;
+            const double c01 = c * e - b * f;
+            const double c02 = b * e - c * d;
+            const double det = a * c00 + b * c01 + c * c02;
+            const double scale = std::max({ a, d, f });
+            if (std::abs(det) <= 1e-9 * scale * scale * scale) return false;
+            const double c11 = a * f - c * c;
+            const double c12 = b * c - a * e;
+            const double c22 = a * d - b * b;
+            const vec3d r(-m[3], -m[6], -m[8]);
+            p = vec3d(c00 * r.x + c01 * r.y + c02 * r.z,
+                      c01 * r.x + c11 * r.y + c12 * r.z,
+                      c02 * r.x + c12 * r.y + c22 * r.z) / det;
+            return true;
+        }
+    };
+
+    struct Candidate {
+        double cost;
+        uint32_t a;
+        uint32_t b;
+        vec3f position;
+
+        bool operator<(const Candidate& other) const {
+            return std::tie(cost, a, b) < std::tie(other.cost, other.a, other.b);
+        }
+    };
+
+    vec3d to_double(const vec3f& v) {
+        return vec3d(v.x, v.y, v.z);
+    }
+
+    // Triangles around every vertex in CSR form
+    void build_adjacency(const std::vector<vec3ui>& indices, size_t num_vertices, std::vector<uint32_t>& offsets,
+                         std::vector<uint32_t>& adjacency) {
+        const size_t num_corners = 3 * indices.size();
+        std::vector<std::atomic<uint32_t>> counts(num_vertices);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t c = r.begin(); c < r.end(); c++) {
+                counts[indices[c / 3][c % 3]].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        offsets.assign(num_vertices + 1, 0);
+        tbb::parallel_scan(
+            tbb::blocked_range<size_t>(0, num_vertices), 0u,
+            [&](const tbb::blocked_range<size_t>& r, uint32_t sum, bool is_final) {
+                for (size_t v = r.begin(); v < r.end(); v++) {
+                    sum += counts[v].load(std::memory_order_relaxed);
+                    if (is_final) offsets[v + 1] = sum;
+                }
+                return sum;
+            },
+            [](uint32_t a, uint32_t b) { return a + b; }
+        );
+
+        adjacency.resize(num_corners);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                counts[v].store(offsets[v], std::memory_order_relaxed);
+            }
+        });
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t c = r.begin(); c < r.end(); c++) {
+                const uint32_t slot = counts[indices[c / 3][c % 3]].fetch_add(1, std::memory_order_relaxed);
+                adjacency[slot] = static_cast<uint32_t>(c / 3);
+            }
+        });
+    }
+
+    // Moving a vertex must not flip or collapse any triangle that survives the collapse
+    bool flips(const HostMesh& mesh, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency,
+               uint32_t v, uint32_t other, const vec3f& position) {
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+            const vec3ui& tri = mesh.indices[adjacency[i]];
+            if (tri.x == other || tri.y == other || tri.z == other) continue;
+            vec3f p[3] = { mesh.vertices[tri.x].position, mesh.vertices[tri.y].position, mesh.vertices[tri.z].position };
+            const vec3f before = cross(p[1] - p[0], p[2] - p[0]);
+            p[tri.x == v ? 0 : (tri.y == v ? 1 : 2)] = position;
+            const vec3f after = cross(p[1] - p[0], p[2] - p[0]);
+            if (dot(before, after) <= 0.f) return true;
+        }
+        return false;
+    }
+
+    void gather_ring(const HostMesh& mesh, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency,
+                     uint32_t v, std::vector<uint32_t>& ring) {
+        ring.clear();
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+            const vec3ui& tri = mesh.indices[adjacency[i]];
+            ring.insert(ring.end(), { tri.x, tri.y, tri.z });
+        }
+        std::sort(ring.begin(), ring.end());
+        ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+    }
+
+    // Endpoints that share more neighbours than the two opposite vertices would pinch the surface
+    bool pinches(const HostMesh& mesh, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency,
+                 uint32_t a, uint32_t b, std::vector<uint32_t>& ring_a, std::vector<uint32_t>& ring_b) {
+        gather_ring(mesh, offsets, adjacency, a, ring_a);
+        gather_ring(mesh, offsets, adjacency, b, ring_b);
+        size_t shared = 0;
+        for (size_t i = 0, j = 0; i < ring_a.size() && j < ring_b.size(); ) {
+            if (ring_a[i] < ring_b[j]) i++;
+            else if (ring_b[j] < ring_a[i]) j++;
+            else {
+                if (ring_a[i] != a && ring_a[i] != b) shared++;
+                i++;
+                j++;
+            }
+        }
+        return shared != 2;
+    }
+}
+
+float MeshSimplifier::simplify(HostMesh& mesh, size_t target_triangles) {
+    const size_t num_vertices = mesh.vertices.size();
+    const bool has_materials = mesh.material_ids.size() == mesh.indices.size();
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> adjacency;
+    build_adjacency(mesh.indices, num_vertices, offsets, adjacency);
+
+    // Planes of the input triangles, collapsed vertices carry the sum of both quadrics
+    std::vector<Quadric> quadrics(num_vertices);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t v = r.begin(); v < r.end(); v++) {
+            for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                const vec3ui& tri = mesh.indices[adjacency[i]];
+                const vec3d p0 = to_double(mesh.vertices[tri.x].position);
+                const vec3d n = cross(to_double(mesh.vertices[tri.y].position) - p0, to_double(mesh.vertices[tri.z].position) - p0);
+                const double len = length(n);
+                if (len <= 0.0) continue;
+                quadrics[v] += Quadric::plane(n / len, -dot(n / len, p0));
+            }
+        }
+    });
+
+    double max_cost = 0.0;
+    std::vector<uint32_t> remap(num_vertices);
+    std::vector<uint8_t> touched(num_vertices);
+    std::vector<uint32_t> ring_a;
+    std::vector<uint32_t> ring_b;
+    for (int round = 0; round < MAX_ROUNDS && mesh.indices.size() > target_triangles; round++) {
+        if (round > 0) {
+            build_adjacency(mesh.indices, num_vertices, offsets, adjacency);
+        }
+
+        // Edges as sorted vertex pairs, pairs seen once lie on an open edge and pin both vertices
+        const size_t num_corners = 3 * mesh.indices.size();
+        std::vector<uint64_t> edges(num_corners);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                const vec3ui& tri = mesh.indices[t];
+                for (int k = 0; k < 3; k++) {
+                    const uint32_t a = tri[k];
+                    const uint32_t b = tri[(k + 1) % 3];
+                    edges[3 * t + k] = (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+                }
+            }
+        });
+        tbb::parallel_sort(edges.begin(), edges.end());
+
+        std::vector<uint8_t> locked(num_vertices, 0);
+        std::vector<uint64_t> interior;
+        for (size_t i = 0; i < edges.size(); ) {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i]) j++;
+            if (j - i == 2) {
+                interior.push_back(edges[i]);
+            }
+            else {
+                locked[edges[i] >> 32] = 1;
+                locked[edges[i] & 0xffffffffu] = 1;
+            }
+            i = j;
+        }
+
+        std::vector<Candidate> candidates(interior.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, interior.size()), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t e = r.begin(); e < r.end(); e++) {
+                const uint32_t a = static_cast<uint32_t>(interior[e] >> 32);
+                const uint32_t b = static_cast<uint32_t>(interior[e] & 0xffffffffu);
+                Candidate& candidate = candidates[e];
+                candidate = { HUGE_VAL, a, b, vec3f(0.f) };
+                if (locked[a] || locked[b]) continue;
+
+                const Quadric q = quadrics[a] + quadrics[b];
+                const vec3d pa = to_double(mesh.vertices[a].position);
+                const vec3d pb = to_double(mesh.vertices[b].position);
+                // The optimum is only trusted near the edge, flat regions fall back to the endpoints
+                vec3d options[4] = { pa, pb, 0.5 * (pa + pb), vec3d(0.0) };
+                const int count = q.minimum(options[3]) && length(options[3] - options[2]) <= length(pb - pa) ? 4 : 3;
+                for (int o = 0; o < count; o++) {
+                    const double cost = std::max(q.error(options[o]), 0.0);
+                    if (cost < candidate.cost) {
+                        candidate.cost = cost;
+                        candidate.position = vec3f(options[o].x, options[o].y, options[o].z);
+                    }
+                }
+            }
+        });
+        tbb::parallel_sort(candidates.begin(), candidates.end());
+
+        // Greedy independent set, every collapse claims all triangles around both vertices
+        std::fill(touched.begin(), touched.end(), 0);
+        for (size_t v = 0; v < num_vertices; v++) remap[v] = static_cast<uint32_t>(v);
+        size_t remaining = mesh.indices.size();
+        size_t collapses = 0;
+        for (const Candidate& candidate : candidates) {
+            if (remaining <= target_triangles || candidate.cost == HUGE_VAL) break;
+            const uint32_t a = candidate.a;
+            const uint32_t b = candidate.b;
+            if (touched[a] || touched[b]) continue;
+            if (pinches(mesh, offsets, adjacency, a, b, ring_a, ring_b)
+                || flips(mesh, offsets, adjacency, a, b, candidate.position)
+                || flips(mesh, offsets, adjacency, b, a, candidate.position)) {
+                continue;
+            }
+
+            for (const uint32_t v : { a, b }) {
+                for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                    const vec3ui& tri = mesh.indices[adjacency[i]];
+                    touched[tri.x] = touched[tri.y] = touched[tri.z] = 1;
+                }
+            }
+            // Interior edges are shared by exactly two triangles, both of which degenerate
+            remap[b] = a;
+            mesh.vertices[a].position = candidate.position;
+            quadrics[a] += quadrics[b];
+            max_cost = std::max(max_cost, candidate.cost);
+            remaining -= std::min<size_t>(remaining, 2);
+            collapses++;
+        }
+        if (collapses == 0) break;
+
+        size_t kept = 0;
+        for (size_t t = 0; t < mesh.indices.size(); t++) {
+            const vec3ui& i = mesh.indices[t];
+            const vec3ui tri(remap[i.x], remap[i.y], remap[i.z]);
+            if (tri.x == tri.y || tri.y == tri.z || tri.z == tri.x) continue;
+            mesh.indices[kept] = tri;
+            if (has_materials) mesh.material_ids[kept] = mesh.material_ids[t];
+            kept++;
+        }
+        mesh.indices.resize(kept);
+        if (has_materials) mesh.material_ids.resize(kept);
+    }
+
+    // Drop the vertices no triangle references anymore
+    std::vector<uint32_t> used(num_vertices, 0);
+    for (const vec3ui& tri : mesh.indices) {
+        used[tri.x] = used[tri.y] = used[tri.z] = 1;
+    }
+    uint32_t next = 0;
+    for (size_t v = 0; v < num_vertices; v++) {
+        if (!used[v]) continue;
+        remap[v] = next;
+        mesh.vertices[next++] = mesh.vertices[v];
+    }
+    mesh.vertices.resize(next);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t t = r.begin(); t < r.end(); t++) {
+            const vec3ui& i = mesh.indices[t];
+            mesh.indices[t] = vec3ui(remap[i.x], remap[i.y], remap[i.z]);
+        }
+    });
+    return static_cast<float>(std::sqrt(max_cost));
+}
+
+std::vector<MeshSimplifier::Lod> MeshSimplifier::build_lods(const HostMesh& mesh, const Config& config) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::vector<Lod> lods;
+    // Levels point at the one before them while they are built
+    lods.reserve(config.max_levels);
+    const HostMesh* previous = &mesh;
+    float error = 0.f;
+    for (uint32_t level = 1; level < config.max_levels; level++) {
+        const size_t target = static_cast<size_t>(previous->indices.size() * config.ratio);
+        if (target < config.min_triangles) break;
+
+        Lod lod { *previous, 0.f };
+        const float collapse_error = simplify(lod.mesh, target);
+        // A level that barely shrank would only cost memory, locked seams usually are the reason
+        if (lod.mesh.indices.size() > previous->indices.size() * (1.f + config.ratio) / 2.f) break;
+        error += collapse_error;
+        lod.error = error;
+        lods.push_back(std::move(lod));
+        previous = &lods.back().mesh;
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("MeshSimplifier: {} levels below {} triangles, coarsest {} triangles with error {:.3g} in {:.1f} ms",
+                 lods.size(), mesh.indices.size(), previous->indices.size(), error,
+                 std::chrono::duration<double, std::milli>(end - start).count());
+    return lods;
+}
@@ -0,0 +1,49 @@
+/**
+* @file MeshSimplifier.hpp
+* @brief Quadric error edge collapse and the level of detail chains built with it.
+*/
+
+#pragma once
+
+#ifndef MESHSIMPLIFIER_HPP
+#define MESHSIMPLIFIER_HPP
+
+#include <vector>
+
+#include "HostMesh.hpp"
+
+class MeshSimplifier {
+public:
+    struct Config {
+        // Fraction of the triangles of the previous level every level keeps
+        float ratio = 0.5f;
+        // Including the full resolution mesh
+        uint32_t max_levels = 6;
+        // No level is made smaller than this
+        size_t min_triangles = 512;
+    };
+
+    struct Lod {
+        HostMesh mesh;
+        // Approximate bound on the distance to the full resolution surface, in object space
+        float error = 0.f;
+    };
+
+    /**
+     * @brief Collapses edges in order of quadric error until the mesh has at most target_triangles.
+     * Collapses run in rounds. Edge costs are evaluated and sorted in parallel, then an independent set of
+     * the cheapest edges is collapsed, so no two collapses of a round share a triangle and the fold-over
+     * test sees the final positions. Vertices on open edges never move, which keeps mesh borders and the
+     * seams where the unified mesh splits vertices by normal or texcoord.
+     * @return Square root of the largest quadric error of any collapse.
+     */
+    static float simplify(HostMesh& mesh, size_t target_triangles);
+
+    /**
+     * @brief Levels coarser than the given mesh, each simplified from the one before it.
+     * Errors add up along the chain, so every level is bounded against the full resolution mesh.
+     */
+    static std::vector<Lod> build_lods(const HostMesh& mesh, const Config& config);
+};
+
+#endif //MESHSIMPLIFIER_HPP
@@ -0,0 +1,35 @@
+/**
+* @file Morton.hpp
+* @brief 30 bit Morton codes for spatial ordering of mesh data.
+*/
+
+#pragma once
+
+#ifndef MORTON_HPP
+#define MORTON_HPP
+
+#include <cstdint>
+
+#include <owl/common/math/box.h>
+
+using namespace owl;
+
+// Spreads the low 10 bits so two zero bits follow each one
+inline uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// 10 bits per axis of the position within bounds
+inline uint32_t morton_code(const vec3f& p, const box3f& bounds) {
+    const vec3f extent = max(bounds.span(), vec3f(1e-20f));
+    const vec3f n = min(max((p - bounds.lower) / extent, vec3f(0.f)), vec3f(1.f)) * 1023.f;
+    return (expand_bits(static_cast<uint32_t>(n.x)) << 2)
+        | (expand_bits(static_cast<uint32_t>(n.y)) << 1)
+        | expand_bits(static_cast<uint32_t>(n.z));
+}
+
+#endif //MORTON_HPP
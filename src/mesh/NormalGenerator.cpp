@@ -0,0 +1,138 @@
+/**
+* @file NormalGenerator.cpp
+* @brief Implementation of the NormalGenerator class.
+*/
+
+#include "NormalGenerator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+
+namespace {
+    float corner_angle(const vec3f& p, const vec3f& a, const vec3f& b) {
+        const vec3f e0 = a - p;
+        const vec3f e1 = b - p;
+        const float len = std::sqrt(dot(e0, e0) * dot(e1, e1));
+        if (len <= 0.f) return 0.f;
+        return std::acos(std::clamp(dot(e0, e1) / len, -1.f, 1.f));
+    }
+}
+
+NormalGenerator::Result NormalGenerator::generate(std::span<const vec3f> positions, std::span<const vec3ui> indices, float crease_angle) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    const size_t num_triangles = indices.size();
+    const size_t num_corners = 3 * num_triangles;
+    const size_t num_vertices = positions.size();
+    const bool crease = crease_angle < 180.f;
+    const float cos_crease = std::cos(crease_angle * static_cast<float>(M_PI) / 180.f);
+
+    // Face normals scaled by twice the area, and the unit normal used for the crease test
+    std::vector<vec3f> face_normals(num_triangles);
+    std::vector<vec3f> face_dirs(num_triangles);
+    std::vector<float> angles(num_corners);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_triangles), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t t = r.begin(); t < r.end(); t++) {
+            const vec3f& p0 = positions[indices[t].x];
+            const vec3f& p1 = positions[indices[t].y];
+            const vec3f& p2 = positions[indices[t].z];
+            const vec3f n = cross(p1 - p0, p2 - p0);
+            const float len = length(n);
+            face_normals[t] = n;
+            face_dirs[t] = len > 0.f ? n / len : vec3f(0.f);
+            angles[3 * t + 0] = corner_angle(p0, p1, p2);
+            angles[3 * t + 1] = corner_angle(p1, p2, p0);
+            angles[3 * t + 2] = corner_angle(p2, p0, p1);
+        }
+    });
+
+    // Corners around every vertex in CSR form
+    std::vector<std::atomic<uint32_t>> counts(num_vertices);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t c = r.begin(); c < r.end(); c++) {
+            counts[indices[c / 3][c % 3]].fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    std::vector<uint32_t> offsets(num_vertices + 1, 0);
+    tbb::parallel_scan(
+        tbb::blocked_range<size_t>(0, num_vertices), 0u,
+        [&](const tbb::blocked_range<size_t>& r, uint32_t sum, bool is_final) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                sum += counts[v].load(std::memory_order_relaxed);
+                if (is_final) offsets[v + 1] = sum;
+            }
+            return sum;
+        },
+        [](uint32_t a, uint32_t b) { return a + b; }
+    );
+
+    std::vector<uint32_t> adjacency(num_corners);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t v = r.begin(); v < r.end(); v++) {
+            counts[v].store(offsets[v], std::memory_order_relaxed);
+        }
+    });
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t c = r.begin(); c < r.end(); c++) {
+            const uint32_t slot = counts[indices[c / 3][c % 3]].fetch_add(1, std::memory_order_relaxed);
+            adjacency[slot] = static_cast<uint32_t>(c);
+        }
+    });
+    // Fixed order so the float sums do not depend on scheduling
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t v = r.begin(); v < r.end(); v++) {
+            std::sort(adjacency.begin() + offsets[v], adjacency.begin() + offsets[v + 1]);
+        }
+    });
+
+    Result result;
+    if (!crease) {
+        result.normals.resize(num_vertices);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_vertices), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t v = r.begin(); v < r.end(); v++) {
+                vec3f n(0.f);
+                for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                    const uint32_t c = adjacency[i];
+                    n += angles[c] * face_normals[c / 3];
+                }
+                const float len = length(n);
+                result.normals[v] = len > 0.f ? n / len : vec3f(0.f);
+            }
+        });
+        result.normal_indices.assign(indices.begin(), indices.end());
+    }
+    else {
+        result.normals.resize(num_corners);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t c = r.begin(); c < r.end(); c++) {
+                const uint32_t v = indices[c / 3][c % 3];
+                const vec3f& dir = face_dirs[c / 3];
+                vec3f n(0.f);
+                for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+                    const uint32_t other = adjacency[i];
+                    if (dot(dir, face_dirs[other / 3]) < cos_crease) continue;
+                    n += angles[other] * face_normals[other / 3];
+                }
+                const float len = length(n);
+                result.normals[c] = len > 0.f ? n / len : dir;
+            }
+        });
+        result.normal_indices.resize(num_triangles);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_triangles), [&](const tbb::blocked_range<size_t>& r) {
+            for (size_t t = r.begin(); t < r.end(); t++) {
+                const uint32_t c = static_cast<uint32_t>(3 * t);
+                result.normal_indices[t] = vec3ui(c, c + 1, c + 2);
+            }
+        });
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("NormalGenerator: Generated {} normals for {} triangles in {:.1f} ms", result.normals.size(),
+                 num_triangles, std::chrono::duration<double, std::milli>(end - start).count());
+    return result;
+}
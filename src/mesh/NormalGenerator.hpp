@@ -0,0 +1,34 @@
+/**
+* @file NormalGenerator.hpp
+* @brief Smooth vertex normals for meshes that come without them.
+*/
+
+#pragma once
+
+#ifndef NORMALGENERATOR_HPP
+#define NORMALGENERATOR_HPP
+
+#include <span>
+#include <vector>
+
+#include <owl/common/math/vec.h>
+
+using namespace owl;
+
+class NormalGenerator {
+public:
+    struct Result {
+        std::vector<vec3f> normals;
+        std::vector<vec3ui> normal_indices;
+    };
+
+    /**
+     * @brief Weights every adjacent face normal by its area and by the corner angle at the vertex.
+     * With a crease angle below 180 degrees, faces only smooth with neighbors whose normal is within
+     * the crease angle of their own. Normals are then generated per corner, and the unifier merges
+     * identical ones. Otherwise there is one normal per position.
+     */
+    static Result generate(std::span<const vec3f> positions, std::span<const vec3ui> indices, float crease_angle = 180.f);
+};
+
+#endif //NORMALGENERATOR_HPP
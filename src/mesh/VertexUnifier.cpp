@@ -0,0 +1,132 @@
+/**
+* @file VertexUnifier.cpp
+* @brief Implementation of the VertexUnifier class.
+*/
+
+#include "VertexUnifier.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/parallel_sort.h>
+#include <tuple>
+
+namespace {
+    struct Corner {
+        uint32_t position;
+        uint32_t normal;
+        uint32_t texcoord;
+        uint32_t corner;
+
+        bool same_vertex(const Corner& other) const {
+            return position == other.position && normal == other.normal && texcoord == other.texcoord;
+        }
+        bool operator<(const Corner& other) const {
+            return std::tie(position, normal, texcoord, corner) < std::tie(other.position, other.normal, other.texcoord, other.corner);
+        }
+    };
+}
+
+HostMesh VertexUnifier::unify(const MeshCache::Views& views, bool verbose) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    const size_t num_corners = views.indices.size() * 3;
+    const bool has_normals = views.normal_indices.size() == views.indices.size();
+    const bool has_texcoords = views.texcoord_indices.size() == views.indices.size();
+
+    // Missing or out of range attribute indices collapse to one "none" value
+    auto attribute = [](std::span<const vec3ui> indices, bool present, size_t count, size_t corner) {
+        if (!present) return UINT32_MAX;
+        const uint32_t i = indices[corner / 3][corner % 3];
+        return i < count ? i : UINT32_MAX;
+    };
+
+    std::vector<Corner> corners(num_corners);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t c = r.begin(); c < r.end(); c++) {
+            corners[c] = {
+                views.indices[c / 3][c % 3],
+                attribute(views.normal_indices, has_normals, views.normals.size(), c),
+                attribute(views.texcoord_indices, has_texcoords, views.texcoords.size(), c),
+                static_cast<uint32_t>(c),
+            };
+        }
+    });
+    tbb::parallel_sort(corners.begin(), corners.end());
+
+    // Vertex id of every sorted corner, a new vertex starts wherever the tuple changes
+    std::vector<uint32_t> vertex_ids(num_corners);
+    const uint32_t num_vertices = tbb::parallel_scan(
+        tbb::blocked_range<size_t>(0, num_corners), 0u,
+        [&](const tbb::blocked_range<size_t>& r, uint32_t id, bool is_final) {
+            for (size_t i = r.begin(); i < r.end(); i++) {
+                if (i > 0 && !corners[i].same_vertex(corners[i - 1])) id++;
+                if (is_final) vertex_ids[i] = id;
+            }
+            return id;
+        },
+        [](uint32_t a, uint32_t b) { return a + b; }
+    ) + (num_corners > 0 ? 1u : 0u);
+
+    HostMesh mesh;
+    mesh.vertices.resize(num_vertices);
+    std::vector<uint32_t> remap(num_corners);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_corners), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            const Corner& c = corners[i];
+            remap[c.corner] = vertex_ids[i];
+            if (i > 0 && c.same_vertex(corners[i - 1])) continue;
+
+            Geometry::PackedVertex& v = mesh.vertices[vertex_ids[i]];
+            v.position = views.vertices[c.position];
+            v.normal = c.normal != UINT32_MAX ? views.normals[c.normal] : vec3f(0.f);
+            v.texcoord = c.texcoord != UINT32_MAX ? views.texcoords[c.texcoord] : vec2f(0.f);
+        }
+    });
+
+    mesh.indices.resize(views.indices.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.indices.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t t = r.begin(); t < r.end(); t++) {
+            mesh.indices[t] = vec3ui(remap[3 * t], remap[3 * t + 1], remap[3 * t + 2]);
+        }
+    });
+    mesh.material_ids.assign(views.material_ids.begin(), views.material_ids.end());
+
+    if (!verbose) return mesh;
+
+    const size_t before = views.vertices.size_bytes() + views.normals.size_bytes() + views.texcoords.size_bytes()
+        + views.indices.size_bytes() + views.normal_indices.size_bytes() + views.texcoord_indices.size_bytes();
+    const auto end = std::chrono::high_resolution_clock::now();
+    spdlog::info("VertexUnifier: {} corners -> {} vertices in {:.1f} ms, index {} MB + vertex {} MB (was {} MB)",
+                 num_corners, num_vertices, std::chrono::duration<double, std::milli>(end - start).count(),
+                 mesh.index_bytes() >> 20, mesh.vertex_bytes() >> 20, before >> 20);
+    return mesh;
+}
+
+HostMesh VertexUnifier::interleave(const MeshCache::Views& views) {
+    const bool has_normals = views.normals.size() == views.vertices.size();
+    const bool has_texcoords = views.texcoords.size() == views.vertices.size();
+
+    HostMesh mesh;
+    mesh.vertices.resize(views.vertices.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, mesh.vertices.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            Geometry::PackedVertex& v = mesh.vertices[i];
+            v.position = views.vertices[i];
+            v.normal = has_normals ? views.normals[i] : vec3f(0.f);
+            v.texcoord = has_texcoords ? views.texcoords[i] : vec2f(0.f);
+        }
+    });
+    mesh.indices.assign(views.indices.begin(), views.indices.end());
+    mesh.material_ids.assign(views.material_ids.begin(), views.material_ids.end());
+    return mesh;
+}
+
+HostMesh VertexUnifier::convert(const MeshCache::Views& views) {
+    // Smooth generated normals repeat the position indices, only normals generated with creases differ
+    const bool single_indexed = views.normal_indices.empty() || views.normal_indices.data() == views.indices.data()
+        || std::equal(views.normal_indices.begin(), views.normal_indices.end(), views.indices.begin(), views.indices.end());
+    return single_indexed ? interleave(views) : unify(views);
+}
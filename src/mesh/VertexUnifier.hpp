@@ -0,0 +1,36 @@
+/**
+* @file VertexUnifier.hpp
+* @brief Converts OBJ style per-attribute indexing into a single index buffer.
+*/
+
+#pragma once
+
+#ifndef VERTEXUNIFIER_HPP
+#define VERTEXUNIFIER_HPP
+
+#include "HostMesh.hpp"
+#include "loaders/MeshCache.hpp"
+
+class VertexUnifier {
+public:
+    /**
+     * @brief Builds one interleaved vertex per unique (position, normal, texcoord) index tuple.
+     * Corners are sorted by their tuple in parallel, so the result is deterministic and vertices end up
+     * ordered by position index. Missing normal or texcoord indices produce zero attributes.
+     */
+    static HostMesh unify(const MeshCache::Views& views, bool verbose = true);
+
+    /**
+     * @brief Interleaves views that are already single indexed, as glTF primitives are.
+     * Normals and texcoords are taken per position, so their index streams must be the position indices.
+     * Generated normals with crease edges have their own indices and go through unify instead.
+     */
+    static HostMesh interleave(const MeshCache::Views& views);
+
+    /**
+     * @brief Interleaves views whose normals share the position indices and unifies anything else.
+     */
+    static HostMesh convert(const MeshCache::Views& views);
+};
+
+#endif //VERTEXUNIFIER_HPP
@@ -0,0 +1,190 @@
+/**
+* @file Denoiser.cpp
+* @brief Implementation of the à-trous denoiser.
+*/
+
+#include "Denoiser.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace {
+    // B3 spline, separable weights of the 5x5 kernel
+    constexpr float KERNEL[5] = { 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+    constexpr float LOG2E = 1.44269504f;
+
+    inline float luminance(float r, float g, float b) {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    // Edge stop weights only need a few digits, and unlike std::exp and std::pow these approximations are plain
+    // arithmetic and bit operations the compiler turns into vector code.
+
+    // 2^x for x <= 0, relative error below 1e-5, everything under 2^-125 is 0 so a zero normal still stops a tap.
+    // Range checks stay in the integer domain, a float compare feeding further arithmetic keeps the loop scalar
+    // under the default trapping math.
+    inline float exp2_approx(float x) {
+        // Adding 1.5 * 2^23 rounds to an integer in the low mantissa bits
+        constexpr float ROUND = 12582912.f;
+        const float rounded = x + ROUND;
+        const int32_t i = std::bit_cast<int32_t>(rounded) - std::bit_cast<int32_t>(ROUND);
+        const float f = x - (rounded - ROUND);
+        const float p = 1.f + f * (0.693128033f + f * (0.240236785f + f * (0.0558704178f + f * 0.0095902286f)));
+        const float value = std::bit_cast<float>((i + 127) << 23) * p;
+        return std::bit_cast<float>(std::bit_cast<int32_t>(value) & (i > -126 ? -1 : 0));
+    }
+
+    // log2(x) for normal x > 0, absolute error below 3e-5. Zero and negative values map to -127, which exp2_approx
+    // turns into a zero weight.
+    inline float log2_approx(float x) {
+        const int32_t raw = std::bit_cast<int32_t>(x);
+        const int32_t bits = raw & ~(raw >> 31);
+        const float e = static_cast<float>((bits >> 23) - 127);
+        const float m = std::bit_cast<float>((bits & 0x007fffff) | 0x3f800000) - 1.f;
+        return e + m * (1.4418255f + m * (-0.708678912f + m * (0.415411186f + m * (-0.194408323f + m * 0.0458789501f))));
+    }
+
+    // Color and guide planes of one row, starting at its first pixel
+    struct Row {
+        const float *r, *g, *b, *lum, *depth, *nx, *ny, *nz;
+    };
+
+    struct EdgeStops {
+        float sigma_color, sigma_depth, sigma_normal;
+    };
+
+    /**
+     * Adds the tap offset pixels to the right in the tap row to the sums of pixels [x0, x1).
+     * The sums are written through nothing else, and __restrict tells the compiler so. Otherwise the run time
+     * alias checks against this many planes exceed its limit and the loop stays scalar.
+     */
+    void accumulate_tap(const Row& center, const Row& tap, int offset, int x0, int x1, float kernel, const EdgeStops& stops,
+                        float* __restrict sum_r, float* __restrict sum_g, float* __restrict sum_b, float* __restrict sum_w) {
+        for (int x = x0; x < x1; x++) {
+            const int t = x + offset;
+            const float r = tap.r[t];
+            const float g = tap.g[t];
+            const float b = tap.b[t];
+            const float d_lum = std::abs(center.lum[x] - luminance(r, g, b)) / (stops.sigma_color * center.lum[x] + 1e-4f);
+            const float d_depth = std::abs(center.depth[x] - tap.depth[t]) / (stops.sigma_depth * center.depth[x] + 1e-4f);
+            const float n_dot = center.nx[x] * tap.nx[t] + center.ny[x] * tap.ny[t] + center.nz[x] * tap.nz[t];
+            // exp(-d_lum - d_depth) * n_dot^sigma_normal as a single power of two
+            const float w = kernel * exp2_approx(stops.sigma_normal * log2_approx(n_dot) - LOG2E * (d_lum + d_depth));
+
+            sum_r[x] += w * r;
+            sum_g[x] += w * g;
+            sum_b[x] += w * b;
+            sum_w[x] += w;
+        }
+    }
+}
+
+void Denoiser::denoise(std::span<const vec4f> color, std::span<const vec4f> albedo, std::span<const vec4f> normal,
+                       vec2i size, std::span<vec4f> out) {
+    const size_t num_pixels = static_cast<size_t>(size.x) * size.y;
+    for (Planes& planes : irradiance) planes.resize(num_pixels);
+    albedo_planes.resize(num_pixels);
+    nx.resize(num_pixels);
+    ny.resize(num_pixels);
+    nz.resize(num_pixels);
+    depth.resize(num_pixels);
+
+    // Demodulate albedo so that texture detail is not blurred, and split into planes
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_pixels), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            const float frames = std::max(albedo[i].w, 1.f);
+            const vec3f a = max(vec3f(albedo[i].x, albedo[i].y, albedo[i].z) / frames, vec3f(1e-3f));
+            const vec3f c = vec3f(color[i].x, color[i].y, color[i].z) / std::max(color[i].w, 1.f);
+            albedo_planes.r[i] = a.x;
+            albedo_planes.g[i] = a.y;
+            albedo_planes.b[i] = a.z;
+            irradiance[0].r[i] = c.x / a.x;
+            irradiance[0].g[i] = c.y / a.y;
+            irradiance[0].b[i] = c.z / a.z;
+
+            // Misses leave a zero normal, which stops every tap
+            const vec3f n(normal[i].x, normal[i].y, normal[i].z);
+            const float len = length(n);
+            const vec3f N = len > 0.f ? n / len : vec3f(0.f);
+            nx[i] = N.x;
+            ny[i] = N.y;
+            nz[i] = N.z;
+            depth[i] = normal[i].w / frames;
+        }
+    });
+
+    float sigma_color = config.sigma_color;
+    for (int i = 0; i < config.iterations; i++) {
+        filter_pass(irradiance[i & 1], irradiance[(i + 1) & 1], size, 1 << i, sigma_color);
+        sigma_color *= 0.5f;
+    }
+
+    const Planes& result = irradiance[config.iterations & 1];
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_pixels), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i < r.end(); i++) {
+            out[i] = vec4f(
+                result.r[i] * albedo_planes.r[i],
+                result.g[i] * albedo_planes.g[i],
+                result.b[i] * albedo_planes.b[i],
+                1.f
+            );
+        }
+    });
+}
+
+/**
+ * One à-trous pass with taps step pixels apart.
+ * Rows are filtered in parallel. Within a row the loop runs over pixels for a fixed tap, and the pixel range
+ * is clipped so the tap stays inside the image, which keeps the innermost loop free of branches and gathers.
+ */
+void Denoiser::filter_pass(const Planes& src, Planes& dst, vec2i size, int step, float sigma_color) {
+    const int width = size.x;
+    const EdgeStops stops = { sigma_color, config.sigma_depth * step, config.sigma_normal };
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, size.y), [&](const tbb::blocked_range<int>& rows) {
+        std::vector<float> sum_r(width), sum_g(width), sum_b(width), sum_w(width), lum_p(width);
+        auto row_at = [&](int y, const float* lum) {
+            const size_t row = static_cast<size_t>(y) * width;
+            return Row { &src.r[row], &src.g[row], &src.b[row], lum, &depth[row], &nx[row], &ny[row], &nz[row] };
+        };
+
+        for (int y = rows.begin(); y < rows.end(); y++) {
+            const size_t row = static_cast<size_t>(y) * width;
+            std::fill(sum_r.begin(), sum_r.end(), 0.f);
+            std::fill(sum_g.begin(), sum_g.end(), 0.f);
+            std::fill(sum_b.begin(), sum_b.end(), 0.f);
+            std::fill(sum_w.begin(), sum_w.end(), 0.f);
+            for (int x = 0; x < width; x++) {
+                lum_p[x] = luminance(src.r[row + x], src.g[row + x], src.b[row + x]);
+            }
+            const Row center = row_at(y, lum_p.data());
+
+            for (int ky = -2; ky <= 2; ky++) {
+                const int yy = y + ky * step;
+                if (yy < 0 || yy >= size.y) continue;
+                const Row tap = row_at(yy, nullptr);
+
+                for (int kx = -2; kx <= 2; kx++) {
+                    const int offset = kx * step;
+                    const int x0 = std::max(0, -offset);
+                    const int x1 = std::min(width, width - offset);
+                    accumulate_tap(center, tap, offset, x0, x1, KERNEL[ky + 2] * KERNEL[kx + 2], stops,
+                                   sum_r.data(), sum_g.data(), sum_b.data(), sum_w.data());
+                }
+            }
+
+            for (int x = 0; x < width; x++) {
+                const bool valid = sum_w[x] > 0.f;
+                const float inv = valid ? 1.f / sum_w[x] : 0.f;
+                dst.r[row + x] = valid ? sum_r[x] * inv : src.r[row + x];
+                dst.g[row + x] = valid ? sum_g[x] * inv : src.g[row + x];
+                dst.b[row + x] = valid ? sum_b[x] * inv : src.b[row + x];
+            }
+        }
+    });
+}
@@ -0,0 +1,56 @@
+/**
+* @file Denoiser.hpp
+* @brief Edge-avoiding à-trous wavelet denoiser for accumulated frames.
+*/
+
+#pragma once
+
+#ifndef DENOISER_HPP
+#define DENOISER_HPP
+
+#include <span>
+#include <vector>
+
+#include "owl/common/math/vec.h"
+
+using namespace owl;
+
+class Denoiser {
+public:
+    struct Config {
+        // Passes of the 5x5 kernel, pass i samples every 2^i-th pixel
+        int iterations = 5;
+        // Scale of the relative irradiance edge stop, halved every pass
+        float sigma_color = 0.6f;
+        // Exponent of the normal similarity
+        float sigma_normal = 64.f;
+        // Scale of the relative camera distance edge stop, grows with the tap spacing
+        float sigma_depth = 0.05f;
+    };
+
+    explicit Denoiser(const Config& config) : config(config) {}
+
+    /**
+     * @brief Filters one accumulated frame.
+     * All inputs use the pbo layout: color and albedo carry their frame count in w, normal carries the
+     * accumulated camera distance in w. The result is written with w = 1.
+     */
+    void denoise(std::span<const vec4f> color, std::span<const vec4f> albedo, std::span<const vec4f> normal,
+                 vec2i size, std::span<vec4f> out);
+
+    Config config;
+private:
+    // Planes are kept separate so that the tap loop reads contiguous floats and vectorizes
+    struct Planes {
+        std::vector<float> r, g, b;
+        void resize(size_t n) { r.resize(n); g.resize(n); b.resize(n); }
+    };
+
+    Planes irradiance[2];
+    Planes albedo_planes;
+    std::vector<float> nx, ny, nz, depth;
+
+    void filter_pass(const Planes& src, Planes& dst, vec2i size, int step, float sigma_color);
+};
+
+#endif //DENOISER_HPP
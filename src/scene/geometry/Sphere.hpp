@@ -35,6 +35,7 @@ namespace Geometry {
         static void intersect() {
             const int prim_id = optixGetPrimitiveIndex();
             const auto &self = owl::getProgramData<SpheresGeom>().prims[prim_id];
+            COUNT_COST(owl::getPRD<Trace::Record>(), prim_tests);
 
             const vec3f ray_org = optixGetObjectRayOrigin();
             const vec3f ray_dir = optixGetObjectRayDirection();
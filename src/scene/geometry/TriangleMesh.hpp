@@ -10,23 +10,112 @@
 #include <cuda_runtime.h>
 #include <owl/common/math/AffineSpace.h>
 
+#include "materials/MeshMaterial.hpp"
+
 namespace Geometry {
     using namespace owl;
 
+    /**
+     * @brief Interleaved vertex, positions come first so the buffer doubles as the BVH vertex input.
+     */
+    struct PackedVertex {
+        vec3f position;
+        vec3f normal; // zero when the model has none
+        vec2f texcoord;
+    };
+
+    /**
+     * @brief 20 byte vertex, positions are 16 bit fixed point within the mesh bounds and the normal is
+     * octahedral encoded into two 16 bit snorms.
+     */
+    struct CompressedVertex {
+        uint16_t position[3];
+        uint16_t padding;
+        uint32_t normal; // zero when the model has none
+        vec2f texcoord;
+    };
+
+    struct Index16 {
+        uint16_t x, y, z;
+    };
+
+    // Triangles per cluster of 16 bit indices, every cluster has its own 32 bit vertex base
+    constexpr uint32_t INDEX_CLUSTER_SHIFT = 6;
+
+    inline __both__
+    float sign_not_zero(float v) {
+        return v >= 0.f ? 1.f : -1.f;
+    }
+
+    inline __both__
+    uint32_t oct_encode(vec3f n) {
+        const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+        if (l1 == 0.f) return 0u;
+        vec2f p = vec2f(n.x, n.y) / l1;
+        if (n.z < 0.f) {
+            p = vec2f((1.f - fabsf(p.y)) * sign_not_zero(p.x), (1.f - fabsf(p.x)) * sign_not_zero(p.y));
+        }
+        const int x = static_cast<int>(roundf(fminf(fmaxf(p.x, -1.f), 1.f) * 32767.f));
+        const int y = static_cast<int>(roundf(fminf(fmaxf(p.y, -1.f), 1.f) * 32767.f));
+        // The offset keeps every encoded normal nonzero, zero means the vertex has none
+        return (static_cast<uint32_t>(x + 32768) << 16) | static_cast<uint32_t>(y + 32768);
+    }
+
+    inline __both__
+    vec3f oct_decode(uint32_t e) {
+        if (e == 0u) return vec3f(0.f);
+        const vec2f p(static_cast<float>(static_cast<int>(e >> 16) - 32768) / 32767.f,
+                      static_cast<float>(static_cast<int>(e & 0xFFFFu) - 32768) / 32767.f);
+        vec3f n(p.x, p.y, 1.f - fabsf(p.x) - fabsf(p.y));
+        const float t = fmaxf(-n.z, 0.f);
+        n.x += n.x >= 0.f ? -t : t;
+        n.y += n.y >= 0.f ? -t : t;
+        return normalize(n);
+    }
+
     struct TriangleMesh {
-        // Geometry
-        vec3f* vertices;
-        vec3f* normals;
-        vec2f* tex_coords;
+        // Geometry, either full precision or compressed when vertices is null
+        PackedVertex* vertices;
         vec3ui* indices;
-        vec3ui* normal_indices;
-        vec3ui* texcoord_indices;
+        CompressedVertex* compressed_vertices;
+        Index16* short_indices; // relative to the cluster base when set, otherwise indices is used
+        uint32_t* cluster_bases;
+        vec3f quant_origin;
+        vec3f quant_scale;
 
-        // Material
+        // Index into materials, per triangle when material_ids is set. UINT32_MAX shades a default gray
         uint material_id;
-        bool has_tex;
-        cudaTextureObject_t tex;
+        uint32_t* material_ids;
+        // Scene wide tables shared by every mesh
+        Material::MeshMaterial* materials;
+        cudaTextureObject_t* textures;
     };
+
+#ifdef __CUDA_ARCH__
+    inline __device__
+    uint32_t material_of(const TriangleMesh& mesh, int prim_id) {
+        return mesh.material_ids ? mesh.material_ids[prim_id] : mesh.material_id;
+    }
+
+    inline __device__
+    vec3ui triangle_of(const TriangleMesh& mesh, int prim_id) {
+        if (!mesh.short_indices) return mesh.indices[prim_id];
+        const Index16 i = mesh.short_indices[prim_id];
+        const uint32_t base = mesh.cluster_bases[prim_id >> INDEX_CLUSTER_SHIFT];
+        return vec3ui(base + i.x, base + i.y, base + i.z);
+    }
+
+    inline __device__
+    PackedVertex vertex_of(const TriangleMesh& mesh, uint32_t index) {
+        if (mesh.vertices) return mesh.vertices[index];
+        const CompressedVertex& c = mesh.compressed_vertices[index];
+        PackedVertex v;
+        v.position = mesh.quant_origin + mesh.quant_scale * vec3f(c.position[0], c.position[1], c.position[2]);
+        v.normal = oct_decode(c.normal);
+        v.texcoord = c.texcoord;
+        return v;
+    }
+#endif
 }
 
 #endif //TRIMESH_HPP
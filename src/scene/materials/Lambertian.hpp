@@ -75,6 +75,8 @@ namespace Material {
             prd.out.scattered_origin = P;
             prd.out.scattered_direction = W_i;
             prd.out.attenuation = (material.albedo / (M_PIf)) * w_i.y;
+            prd.out.albedo = material.albedo;
+            prd.out.emission = vec3f(0.f);
             prd.out.normal = N;
             prd.out.pdf = w_i.y / M_PIf;
             return true;
@@ -0,0 +1,33 @@
+/**
+* @file MeshMaterial.hpp
+*
+* @brief Host/device shared material of triangle meshes, indexed by the mesh material ids.
+*/
+
+#pragma once
+
+#ifndef MESHMATERIAL_HPP
+#define MESHMATERIAL_HPP
+
+#include <owl/common/math/vec.h>
+
+using namespace owl;
+
+namespace Material {
+    struct MeshMaterial {
+        vec3f diffuse;
+        vec3f emission;
+        // Indices into the scene texture table, -1 when unset. Texels are sRGB and multiply the colors
+        int diffuse_tex;
+        int emission_tex;
+    };
+
+#ifdef __CUDA_ARCH__
+    inline __device__
+    vec3f srgb_to_linear(const float4& c) {
+        return vec3f(powf(c.x, 2.2f), powf(c.y, 2.2f), powf(c.z, 2.2f));
+    }
+#endif
+}
+
+#endif //MESHMATERIAL_HPP
@@ -0,0 +1,141 @@
+/**
+* @file Guiding.hpp
+*
+* @brief Host/device shared path guiding definitions.
+* @details The guide is a spatial binary tree over the scene bounds whose leaves each own a
+* directional quadtree. Directions are parameterized over the unit square with cylindrical
+* coordinates (cos(theta), phi), which is area preserving, so a quadtree over the square is a
+* piecewise constant distribution over the sphere.
+*/
+
+#pragma once
+
+#ifndef GUIDING_HPP
+#define GUIDING_HPP
+
+#include <owl/common/math/vec.h>
+#include <owl/common/math/box.h>
+
+using namespace owl;
+
+namespace Guiding {
+    constexpr float PI = 3.14159265358979323846f;
+
+    /**
+     * @brief Flattened spatial tree node.
+     * Interior nodes split at `split` along `axis`, leaves have axis == -1 and store the root of
+     * their directional quadtree in children[0].
+     */
+    struct SpatialNode {
+        int axis;
+        float split;
+        int children[2];
+    };
+
+    /**
+     * @brief Flattened directional quadtree node.
+     * Quadrant q covers [qx/2, qx/2 + 1/2) x [qy/2, qy/2 + 1/2) with q = qx + 2 * qy.
+     * A negative child marks a leaf quadrant.
+     */
+    struct DirNode {
+        float sum[4];
+        int children[4];
+    };
+
+    /**
+     * @brief Radiance sample recorded on the device during training passes.
+     */
+    struct Sample {
+        vec3f position;
+        vec3f direction;
+        float radiance;
+    };
+
+    inline __both__
+    vec2f dir_to_square(const vec3f& dir) {
+        const float cos_theta = fminf(fmaxf(dir.z, -1.f), 1.f);
+        float phi = atan2f(dir.y, dir.x);
+        if (phi < 0.f) phi += 2.f * PI;
+        return vec2f(
+            fminf(0.5f * (cos_theta + 1.f), 0.99999994f),
+            fminf(phi / (2.f * PI), 0.99999994f)
+        );
+    }
+
+    inline __both__
+    vec3f square_to_dir(const vec2f& p) {
+        const float cos_theta = 2.f * p.x - 1.f;
+        const float sin_theta = sqrtf(fmaxf(0.f, 1.f - cos_theta * cos_theta));
+        const float phi = 2.f * PI * p.y;
+        return vec3f(sin_theta * cosf(phi), sin_theta * sinf(phi), cos_theta);
+    }
+
+    inline __both__
+    int quadrant(vec2f& p) {
+        const int qx = p.x >= 0.5f;
+        const int qy = p.y >= 0.5f;
+        p = vec2f(2.f * p.x - qx, 2.f * p.y - qy);
+        return qx + 2 * qy;
+    }
+
+    /**
+     * @brief Returns the directional quadtree root of the spatial leaf containing P.
+     */
+    inline __both__
+    int lookup(const SpatialNode* nodes, const vec3f& P) {
+        int node = 0;
+        while (nodes[node].axis >= 0) {
+            const SpatialNode& n = nodes[node];
+            node = n.children[P[n.axis] >= n.split ? 1 : 0];
+        }
+        return nodes[node].children[0];
+    }
+
+    /**
+     * @brief Solid angle pdf of sampling dir from the quadtree rooted at root.
+     */
+    inline __both__
+    float pdf(const DirNode* nodes, int root, const vec3f& dir) {
+        vec2f p = dir_to_square(dir);
+        float density = 1.f;
+        int node = root;
+        while (node >= 0) {
+            const DirNode& n = nodes[node];
+            const float total = n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+            if (total <= 0.f) break;
+            const int q = quadrant(p);
+            density *= 4.f * n.sum[q] / total;
+            node = n.children[q];
+        }
+        return density / (4.f * PI);
+    }
+
+    /**
+     * @brief Draws a direction proportional to the learned radiance in the quadtree rooted at root.
+     */
+    template<typename Rng>
+    inline __both__
+    vec3f sample(const DirNode* nodes, int root, Rng& rng) {
+        vec2f origin(0.f);
+        float size = 1.f;
+        int node = root;
+        while (node >= 0) {
+            const DirNode& n = nodes[node];
+            const float total = n.sum[0] + n.sum[1] + n.sum[2] + n.sum[3];
+            if (total <= 0.f) break;
+
+            float r = rng() * total;
+            int q = 0;
+            while (q < 3 && r >= n.sum[q]) {
+                r -= n.sum[q];
+                q++;
+            }
+            size *= 0.5f;
+            origin += size * vec2f(float(q & 1), float(q >> 1));
+            node = n.children[q];
+        }
+        return square_to_dir(origin + size * vec2f(rng(), rng()));
+    }
+}
+
+#endif //GUIDING_HPP
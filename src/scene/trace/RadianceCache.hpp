@@ -0,0 +1,153 @@
+/**
+* @file RadianceCache.hpp
+*
+* @brief Host/device shared world-space hash grid radiance cache.
+* @details Cells are keyed by quantized position and the dominant axis of the shading normal, and
+* live in a fixed-size open addressing table. A cell whose last update is older than max_age frames
+* may be reclaimed by a new key, which bounds memory to capacity * sizeof(Cell).
+*/
+
+#pragma once
+
+#ifndef RADIANCECACHE_HPP
+#define RADIANCECACHE_HPP
+
+#include <owl/common/math/vec.h>
+
+using namespace owl;
+
+namespace RadianceCache {
+    constexpr int MAX_PROBES = 8;
+
+    struct Cell {
+        unsigned long long key; // 0 marks an empty cell
+        float radiance[3];
+        float weight;
+        unsigned int last_frame;
+    };
+
+    struct Params {
+        bool enabled = false;
+        float cell_size = 0.25f;
+        // Number of cells, must be a power of two
+        unsigned int capacity = 0;
+        Cell* cells = nullptr;
+        // One in update_stride paths is traced to full length and trains the cache
+        int update_stride = 16;
+        // Remaining paths read the cache at this bounce
+        int terminate_depth = 1;
+        // Cells with fewer samples are ignored and the path continues
+        float min_weight = 8.f;
+        // Cells untouched for this many frames may be evicted
+        unsigned int max_age = 120;
+    };
+
+    inline __both__
+    unsigned long long make_key(const Params& params, const vec3f& P, const vec3f& N) {
+        const int x = static_cast<int>(floorf(P.x / params.cell_size));
+        const int y = static_cast<int>(floorf(P.y / params.cell_size));
+        const int z = static_cast<int>(floorf(P.z / params.cell_size));
+
+        // Dominant normal axis and sign
+        const vec3f A(fabsf(N.x), fabsf(N.y), fabsf(N.z));
+        const int axis = A.x > A.y ? (A.x > A.z ? 0 : 2) : (A.y > A.z ? 1 : 2);
+        const int sign = N[axis] < 0.f;
+
+        const unsigned long long mask = (1ull << 18) - 1;
+        return ((static_cast<unsigned long long>(x) & mask)
+            | (static_cast<unsigned long long>(y) & mask) << 18
+            | (static_cast<unsigned long long>(z) & mask) << 36
+            | static_cast<unsigned long long>(2 * axis + sign) << 54) + 1;
+    }
+
+    inline __both__
+    unsigned int hash(unsigned long long key) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        key ^= key >> 33;
+        return static_cast<unsigned int>(key);
+    }
+
+#ifdef __CUDA_ARCH__
+    inline __device__
+    int find(const Params& params, unsigned long long key) {
+        const unsigned int h = hash(key);
+        for (int i = 0; i < MAX_PROBES; i++) {
+            const unsigned int slot = (h + i) & (params.capacity - 1);
+            const unsigned long long k = params.cells[slot].key;
+            if (k == key) return slot;
+            if (k == 0) return -1;
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Finds the cell for key, claiming an empty or stale cell if needed.
+     * Returns -1 when every probed cell is live and owned by another key.
+     * A claim stamps last_frame before the slot is returned. A keyed cell whose last_frame is still 0 is being
+     * claimed by another thread and is never evicted, so frames are stamped as at least 1.
+     */
+    inline __device__
+    int find_or_claim(const Params& params, unsigned long long key, unsigned int frame) {
+        const unsigned int h = hash(key);
+        const unsigned int stamp = max(frame, 1u);
+        for (int i = 0; i < MAX_PROBES; i++) {
+            const unsigned int slot = (h + i) & (params.capacity - 1);
+            const unsigned long long k = params.cells[slot].key;
+            if (k == key) return slot;
+            if (k == 0) {
+                const unsigned long long prev = atomicCAS(&params.cells[slot].key, 0ull, key);
+                if (prev == 0) atomicExch(&params.cells[slot].last_frame, stamp);
+                if (prev == 0 || prev == key) return slot;
+            }
+        }
+
+        // Evict the first stale cell along the probe sequence
+        for (int i = 0; i < MAX_PROBES; i++) {
+            const unsigned int slot = (h + i) & (params.capacity - 1);
+            Cell& cell = params.cells[slot];
+            const unsigned long long k = cell.key;
+            const unsigned int last_frame = cell.last_frame;
+            if (k == 0 || last_frame == 0 || stamp - last_frame <= params.max_age) continue;
+            if (atomicCAS(&cell.key, k, key) == k) {
+                atomicExch(&cell.last_frame, stamp);
+                // Splats of the evicted key may still be in flight, atomics keep the reset whole
+                atomicExch(&cell.radiance[0], 0.f);
+                atomicExch(&cell.radiance[1], 0.f);
+                atomicExch(&cell.radiance[2], 0.f);
+                atomicExch(&cell.weight, 0.f);
+                return slot;
+            }
+        }
+        return -1;
+    }
+
+    inline __device__
+    void splat(const Params& params, const vec3f& P, const vec3f& N, const vec3f& L, unsigned int frame) {
+        const int slot = find_or_claim(params, make_key(params, P, N), frame);
+        if (slot < 0) return;
+        Cell& cell = params.cells[slot];
+        atomicAdd(&cell.radiance[0], L.x);
+        atomicAdd(&cell.radiance[1], L.y);
+        atomicAdd(&cell.radiance[2], L.z);
+        atomicAdd(&cell.weight, 1.f);
+        cell.last_frame = max(frame, 1u);
+    }
+
+    inline __device__
+    bool query(const Params& params, const vec3f& P, const vec3f& N, unsigned int frame, vec3f& L) {
+        const int slot = find(params, make_key(params, P, N));
+        if (slot < 0) return false;
+        Cell& cell = params.cells[slot];
+        const float weight = cell.weight;
+        if (weight < params.min_weight) return false;
+        L = vec3f(cell.radiance[0], cell.radiance[1], cell.radiance[2]) / weight;
+        cell.last_frame = max(frame, 1u);
+        return true;
+    }
+#endif
+}
+
+#endif //RADIANCECACHE_HPP
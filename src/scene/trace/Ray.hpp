@@ -11,6 +11,13 @@
 
 using namespace owl;
 
+// Cost counters are compiled in with -DENABLE_COST_COUNTERS=ON, otherwise counting is a no-op
+#ifdef COST_COUNTERS
+#define COUNT_COST(prd, counter) ((prd).cost.counter++)
+#else
+#define COUNT_COST(prd, counter)
+#endif
+
 namespace Trace {
     typedef LCG<8> Random;
 
@@ -27,9 +34,18 @@ namespace Trace {
             vec3f scattered_origin;
             vec3f scattered_direction;
             vec3f attenuation;
+            vec3f albedo;
+            vec3f emission;
             vec3f normal;
             float pdf;
         } out;
+#ifdef COST_COUNTERS
+        struct {
+            unsigned int bounces;
+            unsigned int prim_tests;
+            unsigned int shadow_rays;
+        } cost;
+#endif
     };
 }
 
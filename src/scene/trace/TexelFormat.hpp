@@ -0,0 +1,43 @@
+/**
+* @file TexelFormat.hpp
+*
+* @brief Host/device shared storage formats of float textures.
+* @details Every format is sampled with point filtering. The texture unit converts RGBA16F and BC6H
+* texels to floats. RGB9E5 has no CUDA texture format, so its texels are read as 32-bit integers and
+* decoded in the shader.
+*/
+
+#pragma once
+
+#ifndef TEXELFORMAT_HPP
+#define TEXELFORMAT_HPP
+
+#include <cstdint>
+#include <owl/common/math/vec.h>
+
+using namespace owl;
+
+namespace Trace {
+    enum class TexelFormat : int {
+        RGBA32F,
+        RGBA16F,
+        // Three 9-bit mantissas sharing a 5-bit exponent, red in the low bits
+        RGB9E5,
+        // Unsigned BC6H, 4x4 blocks of 16 bytes
+        BC6H,
+    };
+
+    constexpr float RGB9E5_MAX = 65408.f;
+
+    inline __both__
+    vec3f decode_rgb9e5(uint32_t texel) {
+        const float scale = ldexpf(1.f, static_cast<int>(texel >> 27) - 15 - 9);
+        return vec3f(
+            static_cast<float>(texel & 0x1ff),
+            static_cast<float>((texel >> 9) & 0x1ff),
+            static_cast<float>((texel >> 18) & 0x1ff)
+        ) * scale;
+    }
+}
+
+#endif //TEXELFORMAT_HPP
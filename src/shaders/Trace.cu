@@ -5,9 +5,11 @@
 #include <optix_device.h>
 
 #include "geometry/TriangleMesh.hpp"
+#include "trace/TexelFormat.hpp"
 
-#define SAMPLES_PER_PIXEL 2
 #define MAX_DEPTH 50
+#define GUIDE_MAX_VERTICES 8
+#define CACHE_MAX_VERTICES 4
 
 /**
  * @brief Y-up
@@ -27,10 +29,9 @@ __device__
 static bool scatter(const vec3f diffuse,
                     const vec3f &P,
                     vec3f N,
+                    const vec3f &W_o,
                     Trace::Record &prd
 ) {
-    const vec3f W_o = optixGetWorldRayDirection();
-
     // Flip
     if (dot(N, W_o) > 0.0f) {
         N = -N;
@@ -51,11 +52,22 @@ static bool scatter(const vec3f diffuse,
     prd.out.scattered_origin = P;
     prd.out.scattered_direction = W_i;
     prd.out.attenuation = (diffuse / (M_PIf)) * w_i.y;
+    prd.out.albedo = diffuse;
+    prd.out.emission = vec3f(0.f);
     prd.out.normal = N;
     prd.out.pdf = w_i.y / M_PIf;
     return true;
 }
 
+__device__
+static bool scatter(const vec3f diffuse,
+                    const vec3f &P,
+                    vec3f N,
+                    Trace::Record &prd
+) {
+    return scatter(diffuse, P, N, optixGetWorldRayDirection(), prd);
+}
+
 OPTIX_CLOSEST_HIT_PROGRAM(TriangleMesh)() {
     const auto& self = owl::getProgramData<Geometry::TriangleMesh>();
     Trace::Record& prd = owl::getPRD<Trace::Record>();
@@ -64,23 +76,43 @@ OPTIX_CLOSEST_HIT_PROGRAM(TriangleMesh)() {
     const vec3f ray_dir = optixGetWorldRayDirection();
     const float hit_t = optixGetRayTmax();
     const vec3f hit_point = ray_org + hit_t * ray_dir;
-    // Tri data
+    // Tri data, one index fetch and three interleaved vertices
     const int prim_id = optixGetPrimitiveIndex();
-    const vec3ui nindex = self.normal_indices[prim_id];
-    const vec3f& n0 = self.normals[nindex.x];
-    const vec3f& n1 = self.normals[nindex.y];
-    const vec3f& n2 = self.normals[nindex.z];
+    const vec3ui index = Geometry::triangle_of(self, prim_id);
+    const Geometry::PackedVertex v0 = Geometry::vertex_of(self, index.x);
+    const Geometry::PackedVertex v1 = Geometry::vertex_of(self, index.y);
+    const Geometry::PackedVertex v2 = Geometry::vertex_of(self, index.z);
+    // OptiX barycentrics weight the second and third vertex
     const vec2f bary = optixGetTriangleBarycentrics();
-    const vec3f N = normalize(bary.x * n0 + bary.y * n1 + (1.0f - bary.x - bary.y) * n2);
+    vec3f N = (1.0f - bary.x - bary.y) * v0.normal + bary.x * v1.normal + bary.y * v2.normal;
+    if (dot(N, N) == 0.f) {
+        N = cross(v1.position - v0.position, v2.position - v0.position);
+    }
+    // Quantized positions can collapse a sliver to a line or point, face it towards the ray instead
+    if (dot(N, N) == 0.f) {
+        N = -vec3f(optixGetObjectRayDirection());
+    }
+    // Vertex data is in object space, glTF meshes are instanced with transforms
+    N = normalize(vec3f(optixTransformNormalFromObjectToWorldSpace(static_cast<float3>(N))));
+    // Material, textures wrap so uvs are used as is
+    const uint32_t material_id = Geometry::material_of(self, prim_id);
+    vec3f diffuse(0.8f);
+    vec3f emission(0.f);
+    if (material_id != UINT32_MAX) {
+        const Material::MeshMaterial& material = self.materials[material_id];
+        const vec2f uv = (1.0f - bary.x - bary.y) * v0.texcoord + bary.x * v1.texcoord + bary.y * v2.texcoord;
+        diffuse = material.diffuse;
+        emission = material.emission;
+        if (material.diffuse_tex >= 0) {
+            diffuse *= Material::srgb_to_linear(tex2D<float4>(self.textures[material.diffuse_tex], uv.x, uv.y));
+        }
+        if (material.emission_tex >= 0) {
+            emission *= Material::srgb_to_linear(tex2D<float4>(self.textures[material.emission_tex], uv.x, uv.y));
+        }
+    }
     // Scatter
-    // const vec3ui tindex = self.texcoord_indices[prim_id];
-    // const vec2f& t0 = self.tex_coords[tindex.x];
-    // const vec2f& t1 = self.tex_coords[tindex.y];
-    // const vec2f& t2 = self.tex_coords[tindex.z];
-    // vec2f uv = bary.x * t0 + bary.y * t1 + (1.0f - bary.x - bary.y) * t2;
-    // uv.x = fmodf(uv.x, 1.0f);
-    // uv.y = fmodf(uv.y, 1.0f);
-    scatter({0.8, 0.8, 0.8}, hit_point, N, prd);
+    scatter(diffuse, hit_point, N, prd);
+    prd.out.emission = emission;
     prd.out.scatter_event = Trace::ScatterEvent::RayScattered;
 }
 
@@ -173,32 +205,147 @@ bool traceShadowRay(vec3f origin, vec3f direction, Trace::Record& prd) {
     const float tmax = 1e10f;
     Ray ray(origin, direction, tmin, tmax);
     prd.out.scatter_event = Trace::ScatterEvent::RayMissed;
+    COUNT_COST(prd, shadow_rays);
     traceRay(owl::getProgramData<RayGenData>().world, ray, prd);
     // True if missed
     return prd.out.scatter_event != Trace::ScatterEvent::RayScattered;
 }
 
 inline __device__
-vec3f trace_path(const RayGenData& self, Ray& ray, Trace::Record& prd) {
+float luminance(const vec3f& c) {
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+struct GuideVertex {
+    vec3f position;
+    vec3f direction;
+    vec3f throughput;
+    float pdf;
+    // Path contribution when the vertex was recorded
+    vec3f emitted;
+};
+
+/**
+ * @brief Splats the incident radiance seen by each recorded path vertex into the training buffer.
+ * @details The radiance arriving at vertex i is the path contribution added after the vertex was
+ * recorded divided by the throughput accumulated up to and including vertex i.
+ */
+inline __device__
+void record_guide_samples(const LaunchParams::Guide& guide, const GuideVertex* vertices, int num_vertices, const vec3f& L) {
+    for (int i = 0; i < num_vertices; i++) {
+        const vec3f& T = vertices[i].throughput;
+        const vec3f L_after = L - vertices[i].emitted;
+        const vec3f L_i(
+            T.x > 0.f ? L_after.x / T.x : 0.f,
+            T.y > 0.f ? L_after.y / T.y : 0.f,
+            T.z > 0.f ? L_after.z / T.z : 0.f
+        );
+        const float radiance = luminance(L_i) / vertices[i].pdf;
+        if (!(radiance > 0.f) || isinf(radiance)) continue;
+
+        const unsigned int slot = atomicAdd(guide.sample_count, 1u);
+        if (slot >= guide.max_samples) return;
+        guide.samples[slot] = { vertices[i].position, vertices[i].direction, radiance };
+    }
+}
+
+struct CacheVertex {
+    vec3f position;
+    vec3f normal;
+    vec3f throughput;
+    vec3f emitted;
+};
+
+/**
+ * @brief Traces one path.
+ * @details Paths with cache_train set run to full length and splat the outgoing radiance of their
+ * first vertices into the radiance cache. All other paths read the cache at cache.terminate_depth.
+ * When replay is given, the primary hit is taken from the G-buffer instead of being traced.
+ */
+inline __device__
+vec3f trace_path(const RayGenData& self, Ray& ray, Trace::Record& prd, bool cache_train,
+                 PrimaryHit* primary, const PrimaryHit* replay, unsigned int& num_rays) {
+    const LaunchParams::Guide& guide = self.launch->guide;
+    const RadianceCache::Params& cache = self.launch->cache;
+    const unsigned int frame = self.launch->frame.id;
     vec3f accum_attenuation = 1.f;
+    vec3f L = 0.f;
+    GuideVertex vertices[GUIDE_MAX_VERTICES];
+    int num_vertices = 0;
+    CacheVertex cache_vertices[CACHE_MAX_VERTICES];
+    int num_cache_vertices = 0;
 
     for (int depth = 0; depth < MAX_DEPTH; depth++) {
-        traceRay(self.world, ray, prd);
+        COUNT_COST(prd, bounces);
+        if (depth == 0 && replay) {
+            if (replay->hit) {
+                scatter(replay->albedo, replay->position, replay->normal, ray.direction, prd);
+                prd.out.emission = replay->emission;
+                prd.out.scatter_event = Trace::ScatterEvent::RayScattered;
+            }
+            else {
+                prd.out.scatter_event = Trace::ScatterEvent::RayMissed;
+                prd.out.attenuation = replay->albedo;
+            }
+        }
+        else {
+            traceRay(self.world, ray, prd);
+            num_rays++;
+        }
+
+        if (depth == 0 && primary) {
+            primary->hit = prd.out.scatter_event == Trace::ScatterEvent::RayScattered;
+            primary->position = primary->hit ? prd.out.scattered_origin : normalize(ray.direction);
+            primary->normal = prd.out.normal;
+            primary->albedo = primary->hit ? prd.out.albedo : prd.out.attenuation;
+            primary->emission = primary->hit ? prd.out.emission : vec3f(0.f);
+        }
 
         // BG
         if (prd.out.scatter_event == Trace::ScatterEvent::RayMissed) {
             // Missed the scene, return background color
-            return accum_attenuation * prd.out.attenuation;
+            L += accum_attenuation * prd.out.attenuation;
+            break;
         }
 
-        // Light (not implemented)
         if (prd.out.scatter_event == Trace::ScatterEvent::RayCancelled) {
-            return vec3f(0.f);
+            break;
+        }
+
+        // Terminate into the cache once the cell has enough samples
+        if (cache.enabled && !cache_train && depth == cache.terminate_depth) {
+            vec3f cached;
+            if (RadianceCache::query(cache, prd.out.scattered_origin, prd.out.normal, frame, cached)) {
+                L += accum_attenuation * cached;
+                break;
+            }
+        }
+
+        if (cache_train && num_cache_vertices < CACHE_MAX_VERTICES) {
+            cache_vertices[num_cache_vertices++] = { prd.out.scattered_origin, prd.out.normal, accum_attenuation, L };
         }
 
-        const vec3f brdf = prd.out.attenuation;
+        // Emissive surfaces, the cached outgoing radiance above already includes them
+        L += accum_attenuation * prd.out.emission;
+
+        vec3f brdf = prd.out.attenuation;
         vec3f dir = prd.out.scattered_direction;
-        const float pdf = bsdf_pdf(dir, prd.out.normal);
+        float pdf = bsdf_pdf(dir, prd.out.normal);
+
+        // One-sample MIS between the diffuse lobe and the learned guide
+        if (guide.active) {
+            const int root = Guiding::lookup(guide.spatial, prd.out.scattered_origin);
+            if (prd.random() >= guide.bsdf_fraction) {
+                dir = Guiding::sample(guide.directional, root, prd.random);
+            }
+            const float cos_theta = dot(dir, prd.out.normal);
+            if (cos_theta <= 0.f) {
+                break;
+            }
+            brdf = (prd.out.albedo / M_PIf) * cos_theta;
+            pdf = guide.bsdf_fraction * bsdf_pdf(dir, prd.out.normal)
+                + (1.f - guide.bsdf_fraction) * Guiding::pdf(guide.directional, root, dir);
+        }
 
         const vec3f throughput = brdf / pdf;
         float roulette_weight =
@@ -206,12 +353,16 @@ vec3f trace_path(const RayGenData& self, Ray& ray, Trace::Record& prd) {
         if (depth <= 3) roulette_weight = 0.f;
 
         if (prd.random() < roulette_weight) {
-            return vec3f(0.f);
+            break;
         }
 
         vec3f l = (throughput / (1.0f - roulette_weight));
         accum_attenuation *= l;
 
+        if (guide.training && num_vertices < GUIDE_MAX_VERTICES) {
+            vertices[num_vertices++] = { prd.out.scattered_origin, dir, accum_attenuation, pdf, L };
+        }
+
         ray = Ray(
             prd.out.scattered_origin,
             dir,
@@ -220,26 +371,73 @@ vec3f trace_path(const RayGenData& self, Ray& ray, Trace::Record& prd) {
         );
     }
 
-    return vec3f(0.f);
+    if (guide.training) {
+        record_guide_samples(guide, vertices, num_vertices, L);
+    }
+
+    // Terminated paths splat zero so that cells stay unbiased estimates
+    for (int i = 0; i < num_cache_vertices; i++) {
+        const vec3f& T = cache_vertices[i].throughput;
+        const vec3f L_after = L - cache_vertices[i].emitted;
+        const vec3f L_o(
+            T.x > 0.f ? L_after.x / T.x : 0.f,
+            T.y > 0.f ? L_after.y / T.y : 0.f,
+            T.z > 0.f ? L_after.z / T.z : 0.f
+        );
+        if (isinf(L_o.x) || isinf(L_o.y) || isinf(L_o.z)) continue;
+        RadianceCache::splat(cache, cache_vertices[i].position, cache_vertices[i].normal, L_o, frame);
+    }
+
+    return L;
 }
 
 OPTIX_RAYGEN_PROGRAM(RayGen)() {
     const RayGenData& self = owl::getProgramData<RayGenData>();
-    // Get our pixel indices
-    const vec2i pixel_id = owl::getLaunchIndex();
-    const int pboOfs = pixel_id.x + self.pbo_size.x * pixel_id.y;
+    // Get our pixel indices, interleaved passes only launch every step-th pixel
+    const LaunchParams::Frame::Interleave& interleave = self.launch->frame.interleave;
+    const vec2i pixel_id = interleave.origin + vec2i(owl::getLaunchIndex()) * interleave.step;
+    const vec2i size = self.launch->frame.size;
+    const int pboOfs = pixel_id.x + size.x * pixel_id.y;
 
     // Build primary rays
     Trace::Record prd;
     prd.random.init(pboOfs, self.launch->frame.id);
+#ifdef COST_COUNTERS
+    prd.cost = {};
+#endif
+
+    // A sparse, per-frame varying subset of pixels keeps the radiance cache up to date
+    const RadianceCache::Params& cache = self.launch->cache;
+    const bool cache_train = cache.enabled
+        && RadianceCache::hash(static_cast<unsigned long long>(pboOfs) << 32 | self.launch->frame.id) % cache.update_stride == 0;
+
+    const LaunchParams::Reprojection& reproject = self.launch->reproject;
+    const LaunchParams::GBuffer& gbuffer = self.launch->gbuffer;
+    const int strata = gbuffer.resolution * gbuffer.resolution;
+    PrimaryHit primary;
+    unsigned int num_rays = 0;
+    vec3f aov_albedo = 0.f;
+    vec4f aov_normal = 0.f;
 
     vec3f color = 0.f;
     for (int sample_id = 0; sample_id < SAMPLES_PER_PIXEL; sample_id++) {
         // Build primary ray
         Ray ray;
 
-        const vec2f pixel_offset(prd.random(), prd.random());
-        const vec2f uv = (vec2f(pixel_id) + pixel_offset) / vec2f(self.pbo_size);
+        // Jitter strata are traced during the first frames after a reset and replayed afterwards. Replay reuses the
+        // first jitter of each stratum, so the image converges to a resolution^2 point sampled pixel filter rather
+        // than the box filter of the uncached path, a bias traded for the primary rays saved
+        const int stratum_index = (self.launch->frame.accum_frames - 1) * SAMPLES_PER_PIXEL + sample_id;
+        const int stratum = stratum_index % strata;
+        PrimaryHit* cached = gbuffer.enabled ? &gbuffer.hits[pboOfs * strata + stratum] : nullptr;
+        const bool replay = cached && stratum_index >= strata;
+
+        vec2f pixel_offset(prd.random(), prd.random());
+        if (gbuffer.enabled) {
+            pixel_offset = (vec2f(stratum % gbuffer.resolution, stratum / gbuffer.resolution) + pixel_offset)
+                / float(gbuffer.resolution);
+        }
+        const vec2f uv = (vec2f(pixel_id) + pixel_offset) / vec2f(size);
         const vec3f origin = self.launch->camera.pos;
         const vec3f direction = self.launch->camera.dir_00
             + uv.x * self.launch->camera.dir_du
@@ -247,11 +445,30 @@ OPTIX_RAYGEN_PROGRAM(RayGen)() {
 
         ray.origin = origin;
         ray.direction = normalize(direction);
+        if (replay) {
+            ray.direction = cached->hit ? normalize(cached->position - origin) : cached->position;
+        }
 
         // Trace
         prd.out.pdf = 1.f;
-        color += trace_path(self, ray, prd);
+        PrimaryHit hit;
+        color += trace_path(self, ray, prd, cache_train, &hit, replay ? cached : nullptr, num_rays);
+        if (sample_id == 0) primary = hit;
+        if (cached && !replay) *cached = hit;
+
+        // Misses keep the background as albedo so demodulation leaves them flat
+        aov_albedo += hit.albedo;
+        if (hit.hit) {
+            aov_normal += vec4f(hit.normal, length(hit.position - origin));
+        }
+    }
+
+    if (self.launch->ray_count) {
+        atomicAdd(self.launch->ray_count, static_cast<unsigned long long>(num_rays));
     }
+#ifdef COST_COUNTERS
+    self.launch->cost[pboOfs] = vec4ui(num_rays, prd.cost.bounces, prd.cost.prim_tests, prd.cost.shadow_rays);
+#endif
 
     if (isnan(color.x) || isnan(color.y) || isnan(color.z)) {
         color = vec3f(0.f);
@@ -261,11 +478,115 @@ OPTIX_RAYGEN_PROGRAM(RayGen)() {
         color = vec3f(0.f);
     }
 
-    if (self.launch->dirty) {
+    if (reproject.enabled) {
+        reproject.positions[pboOfs] = vec4f(primary.position, primary.hit ? 1.f : 0.f);
+    }
+
+    // Resolve merges the sample with the reprojected history
+    if (reproject.active) {
+        reproject.samples[pboOfs] = vec4f(color * (1.f / SAMPLES_PER_PIXEL), 1.f);
+    } else if (self.launch->dirty && interleave.pass == 0) {
         self.pbo_ptr[pboOfs] = vec4f(color * (1.f / SAMPLES_PER_PIXEL), 1.f);
     } else {
         self.pbo_ptr[pboOfs] += vec4f(color * (1.f / SAMPLES_PER_PIXEL), 1.f);
     }
+
+    const LaunchParams::AOV& aov = self.launch->aov;
+    if (aov.albedo) {
+        const vec4f albedo(aov_albedo * (1.f / SAMPLES_PER_PIXEL), 1.f);
+        const vec4f normal = aov_normal * (1.f / SAMPLES_PER_PIXEL);
+        if ((self.launch->dirty && interleave.pass == 0) || reproject.active) {
+            aov.albedo[pboOfs] = albedo;
+            aov.normal[pboOfs] = normal;
+        } else {
+            aov.albedo[pboOfs] += albedo;
+            aov.normal[pboOfs] += normal;
+        }
+    }
+
+    // Odd frames also go to the half buffer, the host compares it against the remaining frames
+    if (self.launch->half_buffer && !reproject.active && (self.launch->frame.accum_frames & 1)) {
+        if (self.launch->dirty && interleave.pass == 0) {
+            self.launch->half_buffer[pboOfs] = vec4f(color * (1.f / SAMPLES_PER_PIXEL), 1.f);
+        } else {
+            self.launch->half_buffer[pboOfs] += vec4f(color * (1.f / SAMPLES_PER_PIXEL), 1.f);
+        }
+    }
+}
+
+/**
+ * @brief Projects a camera relative point (or a direction for misses) onto the image plane.
+ */
+inline __device__
+bool project(const LaunchParams::Camera& camera, const vec3f& d, vec2f& uv) {
+    const vec3f forward = camera.dir_00 + 0.5f * camera.dir_du + 0.5f * camera.dir_dv;
+    const float depth = dot(d, forward);
+    if (depth <= 0.f) return false;
+
+    // Scale d onto the image plane and measure it along dir_du and dir_dv
+    const vec3f q = d * (dot(forward, forward) / depth) - camera.dir_00;
+    uv = vec2f(
+        dot(q, camera.dir_du) / dot(camera.dir_du, camera.dir_du),
+        dot(q, camera.dir_dv) / dot(camera.dir_dv, camera.dir_dv)
+    );
+    return uv.x >= 0.f && uv.x < 1.f && uv.y >= 0.f && uv.y < 1.f;
+}
+
+/**
+ * @brief Merges this frame's samples with the accumulated history of the previous camera.
+ * @details History is fetched at the reprojected primary hit, rejected when the previous frame saw
+ * a different surface there, and clamped to the 3x3 neighborhood of the new samples otherwise.
+ * The per-pixel sample count is kept in the w channel.
+ */
+OPTIX_RAYGEN_PROGRAM(Resolve)() {
+    const RayGenData& self = owl::getProgramData<RayGenData>();
+    const LaunchParams::Reprojection& reproject = self.launch->reproject;
+    const vec2i pixel_id = owl::getLaunchIndex();
+    const vec2i size = self.launch->frame.size;
+    const vec2i prev_size = self.launch->frame.prev_size;
+    const int pboOfs = pixel_id.x + size.x * pixel_id.y;
+
+    const vec4f sample = reproject.samples[pboOfs];
+    const vec4f P = reproject.positions[pboOfs];
+    const vec3f position(P.x, P.y, P.z);
+    const bool hit = P.w > 0.f;
+
+    vec3f lo(1e30f), hi(-1e30f);
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const int x = clamp(pixel_id.x + dx, 0, size.x - 1);
+            const int y = clamp(pixel_id.y + dy, 0, size.y - 1);
+            const vec4f c = reproject.samples[x + size.x * y];
+            lo = min(lo, vec3f(c.x, c.y, c.z));
+            hi = max(hi, vec3f(c.x, c.y, c.z));
+        }
+    }
+
+    vec4f result(sample.x, sample.y, sample.z, 1.f);
+    const LaunchParams::Camera& prev = self.launch->prev_camera;
+    vec2f uv;
+    if (project(prev, hit ? position - prev.pos : position, uv)) {
+        const vec2i prev_pixel(uv.x * prev_size.x, uv.y * prev_size.y);
+        const int prevOfs = prev_pixel.x + prev_size.x * prev_pixel.y;
+        const vec4f prev_P = reproject.prev_positions[prevOfs];
+        const vec3f prev_position(prev_P.x, prev_P.y, prev_P.z);
+
+        bool valid = hit == (prev_P.w > 0.f);
+        if (valid && hit) {
+            const float tolerance = reproject.depth_tolerance * length(position - self.launch->camera.pos);
+            valid = length(prev_position - position) < tolerance;
+        }
+
+        const vec4f history = reproject.history[prevOfs];
+        if (valid && history.w > 0.f) {
+            vec3f mean = vec3f(history.x, history.y, history.z) / history.w;
+            mean = min(max(mean, lo), hi);
+            const float n = fminf(history.w, float(reproject.max_history));
+            result = vec4f(mean * n + vec3f(sample.x, sample.y, sample.z), n + 1.f);
+        }
+    }
+
+    self.pbo_ptr[pboOfs] = result;
 }
 
 OPTIX_MISS_PROGRAM(Miss)() {
@@ -281,10 +602,18 @@ OPTIX_MISS_PROGRAM(Miss)() {
     const float u = theta / (2.0f * M_PIf) + 0.5f;
     const float v = phi / M_PIf;
 
-    // Retrieve environment map color
-    const vec4f bg_color = tex2D<float4>(self.env_map, u, v);
+    // Retrieve environment map color, RGB9E5 texels are decoded here
+    const vec2f uv = vec2f(u, v) * self.env_uv_scale;
+    vec3f bg_color;
+    if (self.env_format == static_cast<int>(Trace::TexelFormat::RGB9E5)) {
+        bg_color = Trace::decode_rgb9e5(tex2D<unsigned int>(self.env_map, uv.x, uv.y));
+    }
+    else {
+        const float4 texel = tex2D<float4>(self.env_map, uv.x, uv.y);
+        bg_color = vec3f(texel.x, texel.y, texel.z);
+    }
 
     Trace::Record& prd = owl::getPRD<Trace::Record>();
     prd.out.scatter_event = Trace::ScatterEvent::RayMissed;
-    prd.out.attenuation = vec3f(bg_color.x, bg_color.y, bg_color.z);
+    prd.out.attenuation = bg_color;
 }
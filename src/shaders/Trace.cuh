@@ -4,8 +4,41 @@
 #include <owl/common/math/vec.h>
 #include <cuda_runtime.h>
 
+#include "trace/Guiding.hpp"
+#include "trace/RadianceCache.hpp"
+
 using namespace owl;
 
+#define SAMPLES_PER_PIXEL 2
+
+/**
+* @brief First surface seen by a camera ray.
+*/
+struct PrimaryHit {
+    vec3f position; // ray direction on a miss
+    vec3f normal;
+    vec3f albedo; // background radiance on a miss
+    vec3f emission;
+    bool hit;
+};
+
+/**
+* @brief Adam7 interleaving, pass p renders pixels origin + k * step.
+*/
+struct Adam7Pass {
+    int origin_x, origin_y, step_x, step_y;
+};
+
+static constexpr Adam7Pass ADAM7_PASSES[7] = {
+    { 0, 0, 8, 8 },
+    { 4, 0, 8, 8 },
+    { 0, 4, 4, 8 },
+    { 2, 0, 4, 4 },
+    { 0, 2, 2, 4 },
+    { 1, 0, 2, 2 },
+    { 0, 1, 1, 2 },
+};
+
 /**
 * @brief Launch parameters
 * @details This struct holds the camera parameters and frame information.
@@ -21,13 +54,76 @@ struct LaunchParams {
         vec3f dir_du;
         vec3f dir_dv;
     } camera;
+    /*! camera of the previous launch, equal to camera while it is still */
+    Camera prev_camera;
 
     struct Frame {
         int id = 0;
         int accum_frames = 0;
+        /*! internal render resolution, at most the pbo size, pixels are packed with this stride */
+        vec2i size;
+        vec2i prev_size;
+        /*! progressive preview, pass 0 renders every pixel, passes 1-7 follow ADAM7_PASSES */
+        struct Interleave {
+            int pass = 0;
+            vec2i origin = vec2i(0);
+            vec2i step = vec2i(1);
+        } interleave;
     } frame;
 
+    /*! path guiding state, tree pointers are reallocated on every refinement */
+    struct Guide {
+        bool active = false; // sample directions from the guide
+        bool training = false; // record radiance samples
+        float bsdf_fraction = 0.5f;
+        Guiding::SpatialNode* spatial = nullptr;
+        Guiding::DirNode* directional = nullptr;
+        Guiding::Sample* samples = nullptr;
+        unsigned int* sample_count = nullptr;
+        unsigned int max_samples = 0;
+    } guide;
+
+    /*! radiance cache, cells are allocated once at startup */
+    RadianceCache::Params cache;
+
+    /*! history reprojection, every buffer holds one vec4f per pixel */
+    struct Reprojection {
+        bool enabled = false; // primary hits are recorded every frame
+        bool active = false; // this frame is resolved against the reprojected history
+        int max_history = 32; // frames of history kept through camera motion
+        float depth_tolerance = 0.02f; // relative world distance for history to be accepted
+        vec4f* history = nullptr;
+        vec4f* samples = nullptr;
+        vec4f* positions = nullptr; // xyz primary hit (or direction on a miss), w = hit
+        vec4f* prev_positions = nullptr;
+    } reproject;
+
+    /*! primary hits cached per jitter stratum while the camera is still */
+    struct GBuffer {
+        bool enabled = false;
+        int resolution = 2; // resolution^2 jitter strata per pixel
+        PrimaryHit* hits = nullptr;
+    } gbuffer;
+
+    /*! rays traced this frame, reset by the host after every launch */
+    unsigned long long* ray_count = nullptr;
+
+    /*! first-hit guides for the denoiser, accumulated like the pbo */
+    struct AOV {
+        vec4f* albedo = nullptr; // w = frames accumulated
+        vec4f* normal = nullptr; // w = camera distance
+    } aov;
+
+#ifdef COST_COUNTERS
+    /*! per pixel cost of the last frame: rays, bounces, custom primitive tests, shadow rays */
+    vec4ui* cost = nullptr;
+#endif
+
+    /*! accumulation of every other frame, used to estimate the remaining error */
+    vec4f* half_buffer = nullptr;
+
     void set_camera(const Camera& next) {
+        prev_camera = camera;
         if (next.pos != camera.pos ||
             next.dir_00 != camera.dir_00 ||
             next.dir_du != camera.dir_du ||
@@ -59,4 +155,7 @@ struct RayGenData {
 struct MissProgData {
     /*! env_map */
     cudaTextureObject_t env_map;
+    // Trace::TexelFormat of env_map
+    int env_format;
+    vec2f env_uv_scale;
 };
\ No newline at end of file